@@ -39,9 +39,10 @@ void stats_callback(fuse_t *self, fuse_event_t *evt, void* user_data)
     // Print the stats
     size_t cur, max;
     fuse_memstats(self, &cur, &max);
+    size_t count = fuse_memcount(self, FUSE_MAGIC_ANY, NULL);
 
     // Print the stats
-    fuse_printf(self, "Memory: %u bytes/%u bytes\n", cur, max);
+    fuse_printf(self, "Memory: %u bytes/%u bytes (%u values)\n", cur, max, count);
 }
 
 int run(fuse_t *self)
@@ -0,0 +1,146 @@
+/** @file alloc.h
+ *  @brief Fuse memory allocators
+ *
+ *  This file contains the function prototypes for creating memory allocators,
+ *  which can be passed to fuse_new_ex in order to select how memory for values
+ *  is allocated and released.
+ */
+#ifndef FUSE_ALLOC_H
+#define FUSE_ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief An opaque allocator object
+ */
+typedef struct fuse_allocator fuse_allocator_t;
+
+/** @brief Flags for memory blocks mapped with mmap
+ */
+#define FUSE_ALLOCATOR_MMAP_POPULATE 0x01 ///< Fault in the pages when the memory block is allocated
+#define FUSE_ALLOCATOR_MMAP_HUGEPAGE 0x02 ///< Advise the kernel to use transparent hugepages
+
+#if defined(__linux__)
+#define FUSE_ALLOCATOR_MMAP_THRESHOLD (1024 * 1024) ///< The default size at which memory blocks are mapped with mmap
+#else
+#define FUSE_ALLOCATOR_MMAP_THRESHOLD 0 ///< Memory blocks are never mapped with mmap
+#endif
+
+/** @brief Create a new builtin allocator
+ *
+ * Create a new allocator which uses the system malloc and free functions to create
+ * and destroy memory blocks.
+ *
+ * @returns A pointer to the new allocator, or NULL if memory could not be allocated
+ */
+fuse_allocator_t *fuse_allocator_builtin_new();
+
+/** @brief Create a new slab allocator
+ *
+ * Create a new allocator which carves memory blocks from pages, with one set of pages
+ * for each size class. Allocating and freeing a block within a size class is O(1).
+ * Blocks which are larger than the largest size class use the system malloc and free
+ * functions.
+ *
+ * @returns A pointer to the new allocator, or NULL if memory could not be allocated
+ */
+fuse_allocator_t *fuse_allocator_slab_new();
+
+/** @brief Create a new allocator for a fixed region of memory
+ *
+ * Create a new allocator which manages a region of memory supplied by the caller,
+ * and does not use the system malloc. Memory blocks are rounded up to a power-of-two
+ * size class between 8 and 8192 bytes, and freed blocks are kept in a bin for their
+ * size class, so allocating and freeing a block is O(1) and wasted memory is bounded
+ * by the size class rounding. Blocks larger than the largest size class cannot be
+ * allocated.
+ *
+ * The allocator structure is placed at the start of the region, so the region needs
+ * to remain valid until the allocator is destroyed.
+ *
+ * @param buf A pointer to the region of memory
+ * @param sz The size of the region of memory, in bytes
+ * @returns A pointer to the new allocator, or NULL if the region is too small
+ */
+fuse_allocator_t *fuse_allocator_static_new(void *buf, size_t sz);
+
+/** @brief Allocate memory from the allocator
+ *
+ *  @param self The allocator object
+ *  @param size The size of the memory block to allocate
+ *  @param magic The magic number to use for the memory block
+ *  @param file The file where the allocation was made
+ *  @param line The line where the allocation was made
+ *  @returns A pointer to the allocated memory block, or NULL if no memory could be allocated
+ */
+void *fuse_allocator_malloc(fuse_allocator_t *self, size_t size, uint16_t magic, const char *file, int line);
+
+/** @brief Allocate aligned memory from the allocator
+ *
+ * The memory block is aligned to a power of two, for example 16, 32 or 64 bytes
+ * for vector code or cache lines. The static allocator cannot allocate memory
+ * blocks with an alignment larger than 8 bytes.
+ *
+ *  @param self The allocator object
+ *  @param size The size of the memory block to allocate
+ *  @param align The alignment of the memory block, in bytes
+ *  @param magic The magic number to use for the memory block
+ *  @param file The file where the allocation was made
+ *  @param line The line where the allocation was made
+ *  @returns A pointer to the allocated memory block, or NULL if no memory could be allocated
+ */
+void *fuse_allocator_malloc_aligned(fuse_allocator_t *self, size_t size, size_t align, uint16_t magic, const char *file, int line);
+
+/** @brief Free a memory block in the memory pool
+ *
+ *  @param self The allocator object
+ *  @param ptr A pointer to the memory block
+ */
+void fuse_allocator_free(fuse_allocator_t *self, void *ptr);
+
+/** @brief Check that a pointer refers to an allocated memory block
+ *
+ * The pointer can be any value, including a pointer which was not allocated by
+ * the allocator, or a pointer to a memory block which has been freed. The check
+ * takes constant time.
+ *
+ *  @param self The allocator object
+ *  @param ptr Any pointer
+ *  @returns True if the pointer refers to an allocated memory block
+ */
+bool fuse_allocator_valid(fuse_allocator_t *self, void *ptr);
+
+/** @brief Set the memory budget for the allocator
+ *
+ * When the budget is non-zero, an allocation which would take the number of bytes
+ * allocated, including headers, above the budget fails and is counted. Above the
+ * high watermark, the run loop drains released values before executing each event,
+ * and events are rejected or shed according to the event policy.
+ *
+ *  @param self The allocator object
+ *  @param budget The maximum number of bytes allocated, or 0 for no limit
+ *  @param watermark The high watermark in bytes, or 0 for no watermark
+ */
+void fuse_allocator_set_budget(fuse_allocator_t *self, size_t budget, size_t watermark);
+
+/** @brief Set when large memory blocks are mapped with mmap
+ *
+ * Memory blocks which use the system malloc, and which are at least the threshold
+ * size, are mapped with mmap so that they do not fragment the heap and are returned
+ * to the system when freed. This is only supported on Linux, where the default
+ * threshold is FUSE_ALLOCATOR_MMAP_THRESHOLD.
+ *
+ *  @param self The allocator object
+ *  @param threshold The size in bytes at which memory blocks are mapped, or 0 to never use mmap
+ *  @param flags FUSE_ALLOCATOR_MMAP_POPULATE and FUSE_ALLOCATOR_MMAP_HUGEPAGE
+ */
+void fuse_allocator_set_mmap(fuse_allocator_t *self, size_t threshold, uint8_t flags);
+
+/** @brief Release all memory in the pool and destroy the allocator
+ *
+ *  @param self The allocator object
+ */
+void fuse_allocator_destroy(fuse_allocator_t *self);
+
+#endif /* FUSE_ALLOC_H */
@@ -20,14 +20,44 @@
 
 // Maximum number of events
 #define FUSE_EVENT_COUNT 0x08       ///< Maximum number of events
-#define FUSE_EVENT_CALLBACK_COUNT 3 ///< Maximum number of callbacks per event
+#define FUSE_EVENT_DISPATCH_MAX 32  ///< Maximum number of events taken from a queue in one batch
+#define FUSE_EVENT_PRIORITY_COUNT 3 ///< Number of event priority classes
+#define FUSE_EVENT_STARVATION 8     ///< Maximum number of events served from a priority class while a lower class waits
+#define FUSE_EVENT_COALESCE_COUNT 16 ///< Maximum number of sources which coalesce events
+#define FUSE_EVENT_PAYLOAD_SIZE 24   ///< Maximum size of the payload copied into an event
+#define FUSE_EVENT_ROUTE_COUNT 16    ///< Maximum number of sources with their own route
+
+/** @brief Maximum number of callbacks per event
+ *
+ * @deprecated There is no limit on the number of callbacks for an event type, so
+ *             this is only kept for existing code and will be removed
+ */
+#define FUSE_EVENT_CALLBACK_COUNT 3
+
+// Event queues which events are routed to
+#define FUSE_EVENT_ROUTE_CORE0   0x01 ///< Route events to the core 0 event queue
+#define FUSE_EVENT_ROUTE_CORE1   0x02 ///< Route events to the core 1 event queue
+#define FUSE_EVENT_ROUTE_ALL     0x03 ///< Route events to every event queue
+#define FUSE_EVENT_ROUTE_DEFAULT 0xFF ///< Remove the route for a source, so the route for the event type applies
 
 #ifdef DEBUG
 #define fuse_new_event(self, source, type, data) \
     ((fuse_event_t *)fuse_new_event_ex((self), (source), (type), (data), __FILE__, __LINE__))
+#define fuse_new_event_priority(self, source, type, priority, data) \
+    ((fuse_event_t *)fuse_new_event_priority_ex((self), (source), (type), (priority), (data), __FILE__, __LINE__))
+#define fuse_new_event_payload(self, source, type, payload, size) \
+    ((fuse_event_t *)fuse_new_event_payload_ex((self), (source), (type), (payload), (size), __FILE__, __LINE__))
+#define fuse_post_event(self, q, source, type, data) \
+    ((fuse_event_t *)fuse_post_event_ex((self), (q), (source), (type), (data), __FILE__, __LINE__))
 #else
 #define fuse_new_event(self, source, type, data) \
     ((fuse_event_t *)fuse_new_event_ex((self), (source), (type), (data), 0, 0))
+#define fuse_new_event_priority(self, source, type, priority, data) \
+    ((fuse_event_t *)fuse_new_event_priority_ex((self), (source), (type), (priority), (data), 0, 0))
+#define fuse_new_event_payload(self, source, type, payload, size) \
+    ((fuse_event_t *)fuse_new_event_payload_ex((self), (source), (type), (payload), (size), 0, 0))
+#define fuse_post_event(self, q, source, type, data) \
+    ((fuse_event_t *)fuse_post_event_ex((self), (q), (source), (type), (data), 0, 0))
 #endif
 
 //////////////////////////////////////////////////////////////////////////////
@@ -41,10 +71,39 @@
  */
 typedef struct event_context fuse_event_t;
 
+/** @brief Policy for creating events above the high watermark of the memory budget
+ */
+typedef enum
+{
+    FUSE_EVENT_POLICY_ACCEPT = 0, ///< Create events until the memory budget is exhausted
+    FUSE_EVENT_POLICY_REJECT,     ///< Reject all events above the high watermark
+    FUSE_EVENT_POLICY_SHED,       ///< Reject low-priority events above the high watermark
+} fuse_event_policy_t;
+
+/** @brief Priority class for events
+ *
+ * Each event queue has a ring of events for each priority class. Events are
+ * taken from the highest priority class which is not empty, but after
+ * FUSE_EVENT_STARVATION events from one class while a lower class is waiting,
+ * one batch is taken from the lower class, so that lower classes are not starved.
+ */
+typedef enum
+{
+    FUSE_EVENT_PRIORITY_HIGH = 0, ///< For example, GPIO inputs or feeding a watchdog
+    FUSE_EVENT_PRIORITY_NORMAL,   ///< The default priority for all event types
+    FUSE_EVENT_PRIORITY_LOW,      ///< For example, bulk data such as ADC samples
+} fuse_event_priority_t;
+
 /** @brief Place a new event on the event queues
  *
- * An event is created and placed on all event queues for the application.
- * The event is retained by each event queue.
+ * An event is created and placed on the event queues in the route set by
+ * fuse_set_event_route for the source and event type, with the priority set for the
+ * event type by fuse_set_event_priority. The event is retained by each event queue.
+ *
+ * The returned event is only retained by the event queues, so when another thread
+ * runs an event queue the event may already have been executed and reused when the
+ * function returns. It must then only be compared with other events, and not passed
+ * to other functions.
  *
  * @param self The fuse instance
  * @param source The source of the event
@@ -54,10 +113,166 @@ typedef struct event_context fuse_event_t;
  */
 fuse_event_t *fuse_new_event_ex(fuse_t *self, fuse_value_t *source, uint8_t type, void *user_data, const char *file, const int line);
 
+/** @brief Place a new event on the event queues with a priority
+ *
+ * The event is placed on the event queues as for fuse_new_event_ex, and the returned
+ * event is subject to the same rules.
+ *
+ * @param self The fuse instance
+ * @param source The source of the event
+ * @param type The event type
+ * @param priority The priority class of the event
+ * @param user_data User data associated with the event, if any
+ * @return The event is returned, or NULL if the event could not be created
+ */
+fuse_event_t *fuse_new_event_priority_ex(fuse_t *self, fuse_value_t *source, uint8_t type, fuse_event_priority_t priority, void *user_data, const char *file, const int line);
+
+/** @brief Place a new event on the event queues with a copy of a payload
+ *
+ * The payload is copied into the event, so the producer can reuse its memory as soon
+ * as the function returns, and the consumer reads the payload as it was when the
+ * event was created. The callbacks for the event are passed a pointer to the copy
+ * of the payload as the user data. Events are taken from a pool which is preallocated
+ * for the event queue, so no memory is allocated unless the pool is empty. The returned
+ * event is subject to the same rules as for fuse_new_event_ex.
+ *
+ * @param self The fuse instance
+ * @param source The source of the event
+ * @param type The event type
+ * @param payload The payload, which is copied into the event
+ * @param size The size of the payload, in bytes, which is at most FUSE_EVENT_PAYLOAD_SIZE
+ * @return The event is returned, or NULL if the event could not be created
+ */
+fuse_event_t *fuse_new_event_payload_ex(fuse_t *self, fuse_value_t *source, uint8_t type, const void *payload, size_t size, const char *file, const int line);
+
+/** @brief Place a new event on one event queue
+ *
+ * The event is placed on the event queue for a core, whatever the route for the
+ * event type or source, so only that queue retains the event and only the
+ * callbacks registered for that core are executed. The returned event is subject
+ * to the same rules as for fuse_new_event_ex.
+ *
+ * @param self The fuse instance
+ * @param q The queue to place the event on (0 or 1)
+ * @param source The source of the event
+ * @param type The event type
+ * @param user_data User data associated with the event, if any
+ * @return The event is returned, or NULL if the event could not be created or there is
+ *         no event queue for the core
+ */
+fuse_event_t *fuse_post_event_ex(fuse_t *self, uint8_t q, fuse_value_t *source, uint8_t type, void *user_data, const char *file, const int line);
+
+/** @brief Return the payload of an event
+ *
+ * @param self The fuse instance
+ * @param evt The event
+ * @param size Set to the size of the payload in bytes, if not NULL
+ * @return The payload, or NULL if the event was created without a payload
+ */
+const void *fuse_event_payload(fuse_t *self, fuse_event_t *evt, size_t *size);
+
+/** @brief Set the priority class for an event type
+ *
+ * @param self The fuse instance
+ * @param type The event type
+ * @param priority The priority class for events of the type created with fuse_new_event
+ */
+void fuse_set_event_priority(fuse_t *self, uint8_t type, fuse_event_priority_t priority);
+
+/** @brief Set the policy for creating events when there is memory pressure
+ *
+ * The policy is applied when the number of bytes allocated is above the high
+ * watermark set by fuse_allocator_set_budget. Every event which is not created,
+ * either because of the policy or because memory could not be allocated, is
+ * counted as a dropped event.
+ *
+ * @param self The fuse instance
+ * @param policy The event policy
+ * @param low A bitmask of low-priority event types, with bit n set for event type n,
+ *            which are rejected by FUSE_EVENT_POLICY_SHED
+ */
+void fuse_set_event_policy(fuse_t *self, fuse_event_policy_t policy, uint32_t low);
+
+/** @brief Set the dispatch budget for the run loop
+ *
+ * The run loop takes a batch of events from its queue in one operation, and
+ * executes them back-to-back before draining released values. A batch ends when
+ * the number of events or the time budget is reached. Events which were taken
+ * from the queue but not executed start the next batch. The default is a batch
+ * of 16 events with no time budget.
+ *
+ * @param self The fuse instance
+ * @param events The maximum number of events in a batch, between 1 and FUSE_EVENT_DISPATCH_MAX
+ * @param us The time budget for a batch in microseconds, or 0 for no time budget. At least
+ *           one event is executed in each batch.
+ */
+void fuse_set_dispatch(fuse_t *self, size_t events, uint32_t us);
+
+/** @brief Set whether events from a source are coalesced
+ *
+ * When events are coalesced and an event of the type from the source is queued
+ * but has not yet been taken from the queue, a new event updates the queued
+ * event in place instead of creating another one. The user data of the queued
+ * event is replaced with the latest user data, and the number of coalesced
+ * events is counted, see fuse_event_count. This bounds the length of the queue
+ * when a source fires faster than the run loop executes events.
+ *
+ * The source is retained while it coalesces events, and released when coalescing
+ * is disabled or the fuse instance is destroyed.
+ *
+ * @param self The fuse instance
+ * @param source The source of the events
+ * @param type The event type
+ * @param coalesce True to coalesce events, or false to create a new event each time
+ * @return Returns false if coalescing could not be enabled, because FUSE_EVENT_COALESCE_COUNT
+ *         sources already coalesce events
+ */
+bool fuse_set_event_coalesce(fuse_t *self, fuse_value_t *source, uint8_t type, bool coalesce);
+
+/** @brief Set the event queues which events are placed on
+ *
+ * Events created with fuse_new_event, fuse_new_event_priority and fuse_new_event_payload
+ * are placed on the event queues in the route for the source and event type, or when
+ * the source has no route of its own, the route for the event type. By default events
+ * of every type are routed to every event queue. Routing an event type only to the
+ * cores which register callbacks for it means that other queues do not retain and
+ * execute the event. An event which is routed to no event queue is counted as dropped.
+ * A pending event for a coalescing source remains on the queues it was placed on.
+ * A source with its own route is retained until the route is removed, or the fuse
+ * instance is destroyed.
+ *
+ * @param self The fuse instance
+ * @param type The event type
+ * @param source The source of the events, or NULL to set the route for the event type
+ * @param queues A combination of FUSE_EVENT_ROUTE_CORE0 and FUSE_EVENT_ROUTE_CORE1, or
+ *               FUSE_EVENT_ROUTE_DEFAULT to remove the route for the source, or to route
+ *               the event type to every event queue
+ * @return Returns false if the route could not be set, because FUSE_EVENT_ROUTE_COUNT
+ *         sources already have a route
+ */
+bool fuse_set_event_route(fuse_t *self, uint8_t type, fuse_value_t *source, uint8_t queues);
+
+/** @brief Return the number of times an event was placed on the event queues
+ *
+ * @param self The fuse instance
+ * @param evt The event
+ * @return The number of events which were coalesced into the event, which is one
+ *         for an event which was not coalesced
+ */
+uint32_t fuse_event_count(fuse_t *self, fuse_event_t *evt);
+
+/** @brief Return the number of dropped events for an event type
+ *
+ * @param self The fuse instance
+ * @param type The event type
+ * @return The number of events which were not created
+ */
+size_t fuse_event_drops(fuse_t *self, uint8_t type);
+
 /** @brief Retrieve an event from the event queue
  *
  * An event is retrieved from an event queue for the application. The event is released
- * from the queue.
+ * from the queue, and is valid until the next call to fuse_next_event for the queue.
  *
  * @param self The fuse instance
  * @param q The queue to retrieve the event from (0 or 1)
@@ -71,8 +286,8 @@ typedef void (*fuse_callback_t)(fuse_t *self, fuse_event_t *evt, void *user_data
 
 /** @brief Register a callback for an event
  *
- * An event is retrieved from an event queue for the application. The event is released
- * from the queue.
+ * The callback is called for every event of the type, from any source, with the
+ * user data of the event. There is no limit on the number of callbacks.
  *
  * @param self The fuse instance
  * @param q The cpre to implement the callback execution for (0 or 1)
@@ -81,9 +296,60 @@ typedef void (*fuse_callback_t)(fuse_t *self, fuse_event_t *evt, void *user_data
  */
 bool fuse_register_callback(fuse_t *self, uint8_t type, uint8_t q, fuse_callback_t callback);
 
+/** @brief Register a callback for events from one source
+ *
+ * The callback is only called for events of the type from the source, so it does
+ * not need to check the source itself. Callbacks are found by type and source
+ * in constant time, however many sources have callbacks. The callback needs to be
+ * unregistered before the source is released.
+ *
+ * @param self The fuse instance
+ * @param type The event type
+ * @param q The core to implement the callback execution for (0 or 1)
+ * @param source The source of the events, or NULL for events from any source
+ * @param callback The callback
+ * @param user_data The user data passed to the callback, or NULL to pass the user data of the event
+ * @return Returns true if the callback was registered, otherwise false
+ */
+bool fuse_register_source_callback(fuse_t *self, uint8_t type, uint8_t q, fuse_value_t *source, fuse_callback_t callback, void *user_data);
+
+/** @brief Unregister a callback
+ *
+ * Callbacks can be registered and unregistered on any thread or core, including
+ * from a callback while an event is executing. A callback which is unregistered
+ * while an event is executing may still be called for that event.
+ *
+ * @param self The fuse instance
+ * @param type The event type
+ * @param q The core the callback was registered for (0 or 1)
+ * @param source The source the callback was registered for, or NULL for any source
+ * @param callback The callback
+ * @return Returns true if the callback was unregistered, or false if it was not registered
+ */
+bool fuse_unregister_callback(fuse_t *self, uint8_t type, uint8_t q, fuse_value_t *source, fuse_callback_t callback);
+
+/** @brief Set whether a callback can be called on any worker thread
+ *
+ * When the run loop has several worker threads, see fuse_set_workers, an event is
+ * executed on any worker if all its callbacks are thread-safe. Otherwise the event
+ * is executed on the thread which called fuse_run, so that callbacks which are not
+ * thread-safe are never called concurrently. Callbacks are not thread-safe when
+ * they are registered.
+ *
+ * @param self The fuse instance
+ * @param type The event type
+ * @param q The core the callback was registered for (0 or 1)
+ * @param source The source the callback was registered for, or NULL for any source
+ * @param callback The callback
+ * @param threadsafe True if the callback can be called on any worker thread
+ * @return Returns true if the flag was set, or false if the callback was not registered
+ */
+bool fuse_set_callback_threadsafe(fuse_t *self, uint8_t type, uint8_t q, fuse_value_t *source, fuse_callback_t callback, bool threadsafe);
+
 /** @brief Execute callbacks for an event
  *
- * Callbacks for an event are called in order.
+ * The callbacks for the source of the event are called in the order they were
+ * registered, followed by the callbacks for any source.
  *
  * @param self The fuse instance
  * @param q The queue to retrieve the event callbacks from (0 or 1)
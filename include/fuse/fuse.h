@@ -12,6 +12,7 @@
  */
 typedef struct fuse_application fuse_t;
 
+#include "alloc.h"
 #include "assert.h"
 #include "event.h"
 #include "list.h"
@@ -19,12 +20,15 @@ typedef struct fuse_application fuse_t;
 #include "map.h"
 #include "mutex.h"
 #include "printf.h"
+#include "profile.h"
 #include "random.h"
 #include "sleep.h"
 #include "str.h"
 #include "timer.h"
 #include "value.h"
 
+#define FUSE_WORKER_MAX 16 ///< Maximum number of worker threads for the run loop
+
 /** @brief Create a new fuse application
  *
  *  @param flags The flags to use for the fuse application, to modify behaviour
@@ -32,6 +36,16 @@ typedef struct fuse_application fuse_t;
  */
 fuse_t *fuse_new();
 
+/** @brief Create a new fuse application with an allocator
+ *
+ *  The application takes ownership of the allocator, which is destroyed when
+ *  the application is destroyed, or if the application could not be created.
+ *
+ *  @param allocator The allocator to use for values, for example from fuse_allocator_slab_new
+ *  @returns A new fuse application, or NULL if memory could not be allocated
+ */
+fuse_t *fuse_new_ex(fuse_allocator_t *allocator);
+
 /** @brief Deallocate a fuse application
  *
  *  This method releases all resources associated with a fuse application and returns
@@ -46,7 +60,9 @@ int fuse_destroy(fuse_t *fuse);
 /** @brief Allocate memory
  *
  *  This method allocates memory from the fuse memory pool. It will return NULL
- *  if the memory could not be allocated.
+ *  if the memory could not be allocated. On the thread which runs the run loop
+ *  the memory is freed by the next drain unless it is retained. On any other
+ *  thread it is not freed until it has been retained and released.
  *
  *  @param self The fuse application
  *  @param magic The magic number to use for the memory block
@@ -85,6 +101,24 @@ void fuse_free(fuse_t *self, void *ptr);
  */
 void fuse_run(fuse_t *self, int (*callback)(fuse_t *));
 
+/** @brief Set the number of worker threads for the run loop
+ *
+ * When there is more than one worker, fuse_run executes events on the calling
+ * thread and on workers - 1 additional threads. Each worker takes batches of
+ * events from the event queue for core 0 into its own deque, and a worker with
+ * no events steals events from the other workers. Events with callbacks which
+ * are not thread-safe are executed on the calling thread, see
+ * fuse_set_callback_threadsafe. Callbacks should be registered and unregistered
+ * before fuse_run, or from callbacks executed on the calling thread.
+ *
+ * Worker threads are only supported on Linux.
+ *
+ * @param self The fuse application
+ * @param workers The number of workers, between 1 and FUSE_WORKER_MAX
+ * @return Returns false if the number of workers is not supported
+ */
+bool fuse_set_workers(fuse_t *self, size_t workers);
+
 /** @brief Set the fuse exit code
  *
  *  This method should be called after the run loop has been started, in order to
@@ -97,7 +131,10 @@ void fuse_exit(fuse_t *self, const int exit_code);
 
 /** @brief Drain the memory allocation pool
  *
- * This method empties auto-releaaed values (with a zero retain count).
+ * This method empties auto-releaaed values (with a zero retain count). Values
+ * with a zero retain count are kept in their own list, so the cost of draining
+ * is proportional to the number of values released, not the number of values
+ * allocated. Values released while draining are also drained.
  *
  * @param self The fuse instance
  * @param sz The maximum number of values to release, or 0 for all
@@ -107,7 +144,8 @@ size_t fuse_drain(fuse_t *self, size_t cap);
 
 /** @brief Return the memory statistics
  *
- * This method empties auto-releaaed values (with a zero retain count).
+ * The number of bytes includes the header for each value. Building with FUSE_COMPACT
+ * reduces the size of the header.
  *
  * @param self The fuse instance
  * @param cur Pointer to the currently allocated number of bytes (or NULL)
@@ -115,4 +153,15 @@ size_t fuse_drain(fuse_t *self, size_t cap);
  */
 void fuse_memstats(fuse_t *self, size_t *cur, size_t* max);
 
+/** @brief Return the number of values currently allocated
+ *
+ * The number of bytes used for each value is cur divided by the number of values.
+ *
+ * @param self The fuse instance
+ * @param magic The type of value, or FUSE_MAGIC_ANY for values of all types
+ * @param cur Pointer to the number of bytes allocated for the values, including headers (or NULL)
+ * @return The number of values currently allocated
+ */
+size_t fuse_memcount(fuse_t *self, uint16_t magic, size_t *cur);
+
 #endif
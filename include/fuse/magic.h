@@ -39,9 +39,15 @@
 #define FUSE_MAGIC_BME280 0x1D   ///< BME280 temperature, humidity, and pressure sensor
 #define FUSE_MAGIC_UC8151 0x1E   ///< UC8151 e-ink display driver
 #define FUSE_MAGIC_WATCHDOG 0x1F ///< Watchdog timer
+#define FUSE_MAGIC_PROFILE 0x20  ///< Allocation profile
+#define FUSE_MAGIC_QUEUE 0x21    ///< Event queue
+#define FUSE_MAGIC_HANDLER 0x22  ///< Event callback registration
+#define FUSE_MAGIC_EVENTPOOL 0x23 ///< Pool of preallocated events for an event queue
+#define FUSE_MAGIC_NODE 0x24      ///< List node for an immediate or shared value
+#define FUSE_MAGIC_ANY 0xFFFF     ///< Any type of value, when counting values
 
 // Maximum number of magic numbers
-#define FUSE_MAGIC_COUNT 0x20 ///< Maximum number of magic numbers
+#define FUSE_MAGIC_COUNT 0x25 ///< Maximum number of magic numbers
 
 // Define exit codes
 #define FUSE_EXIT_SUCCESS 1     ///< Successful completion
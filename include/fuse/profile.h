@@ -0,0 +1,34 @@
+/** @file profile.h
+ *  @brief Fuse allocation profiles
+ *
+ *  This file contains methods for profiling memory allocation by value type
+ *  and by the allocation site in the source code.
+ */
+#ifndef FUSE_PROFILE_H
+#define FUSE_PROFILE_H
+
+/** @brief Allocation profile
+ */
+typedef struct fuse_profile fuse_profile_t;
+
+/** @brief Create a new allocation profile
+ *
+ * The profile is a snapshot of the allocation statistics when it is created. For
+ * each value type it contains the number of bytes currently allocated (including
+ * headers), the maximum number of bytes allocated, and the number of allocations
+ * and frees. When DEBUG and FUSE_PROFILE are defined, the same statistics are
+ * included for each file and line where values were allocated. Use vtostr to
+ * serialize the profile as JSON, or as text with one line for each type and site.
+ *
+ * @param self The fuse instance
+ * @return The profile, which is autoreleased
+ */
+#ifdef DEBUG
+#define fuse_new_profile(self) \
+    ((fuse_profile_t *)fuse_new_value_ex((self), (FUSE_MAGIC_PROFILE), (0), __FILE__, __LINE__))
+#else
+#define fuse_new_profile(self) \
+    ((fuse_profile_t *)fuse_new_value_ex((self), (FUSE_MAGIC_PROFILE), (0), 0, 0))
+#endif
+
+#endif /* FUSE_PROFILE_H */
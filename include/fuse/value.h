@@ -47,23 +47,125 @@ bool fuse_is_registered_value(fuse_t *self, uint16_t magic);
     (fuse_new_value_ex((self), (FUSE_MAGIC_NULL), (0), __FILE__, __LINE__))
 #define fuse_new_data(self, sz) \
     (fuse_new_value_ex((self), (FUSE_MAGIC_DATA), (void *)(sz), __FILE__, __LINE__))
+#define fuse_new_data_aligned(self, sz, align) \
+    (fuse_new_data_aligned_ex((self), (sz), (align), __FILE__, __LINE__))
+#define fuse_data_resize(self, data, newsz) \
+    (fuse_data_resize_ex((self), (data), (newsz), __FILE__, __LINE__))
 #define fuse_new_u8(self, u8) \
     (fuse_new_value_ex((self), (FUSE_MAGIC_U8), (void *)(uintptr_t)(u8), __FILE__, __LINE__))
+#define fuse_new_bool(self, b) \
+    (fuse_new_value_ex((self), (FUSE_MAGIC_BOOL), (void *)(uintptr_t)((b) ? 1 : 0), __FILE__, __LINE__))
 #else
 #define fuse_new_null(self) \
     (fuse_new_value_ex((self), (FUSE_MAGIC_NULL), (0), 0, 0))
 #define fuse_new_data(self, sz) \
     (fuse_new_value_ex((self), (FUSE_MAGIC_DATA), (void *)(sz), 0, 0))
+#define fuse_new_data_aligned(self, sz, align) \
+    (fuse_new_data_aligned_ex((self), (sz), (align), 0, 0))
+#define fuse_data_resize(self, data, newsz) \
+    (fuse_data_resize_ex((self), (data), (newsz), 0, 0))
 #define fuse_new_u8(self, u8) \
     (fuse_new_value_ex((self), (FUSE_MAGIC_U8), (void *)(uintptr_t)(u8), 0, 0))
+#define fuse_new_bool(self, b) \
+    (fuse_new_value_ex((self), (FUSE_MAGIC_BOOL), (void *)(uintptr_t)((b) ? 1 : 0), 0, 0))
 #endif
 
+#ifdef DEBUG
+#define fuse_new_values_batch(self, magic, n, out) \
+    (fuse_new_values_batch_ex((self), (magic), (n), (out), __FILE__, __LINE__))
+#else
+#define fuse_new_values_batch(self, magic, n, out) \
+    (fuse_new_values_batch_ex((self), (magic), (n), (out), 0, 0))
+#endif
+
+/** @brief Immediate values
+ *
+ * Small scalar values can be stored in the value pointer itself rather than being
+ * allocated. The lowest bit of the pointer is set, the next five bits are the magic
+ * number, and the remaining bits are the signed value. Immediate values are not
+ * allocated, retained, released or drained, but fuse_retain, fuse_release,
+ * fuse_value_type, fuse_value_int and vtostr accept them. They cannot be modified
+ * through the pointer. When added to a list they are held by a separate list node,
+ * so the list returns the same pointer.
+ */
+#define FUSE_VALUE_IMM_SHIFT 6 ///< The number of bits for the tag and magic number of an immediate value
+
+/** @brief Return true if a value pointer is an immediate value
+ */
+#define fuse_value_is_imm(v) \
+    (((uintptr_t)(v) & 1) != 0)
+
+/** @brief Return the magic number of an immediate value
+ */
+#define fuse_value_imm_magic(v) \
+    ((uint16_t)(((uintptr_t)(v) >> 1) & 0x1F))
+
+/** @brief Return the signed value of an immediate value
+ */
+#define fuse_value_imm_int(v) \
+    ((intptr_t)(v) >> FUSE_VALUE_IMM_SHIFT)
+
+#ifdef DEBUG
+#define fuse_new_imm_null(self) \
+    (fuse_new_imm_ex((self), (FUSE_MAGIC_NULL), (0), __FILE__, __LINE__))
+#define fuse_new_imm_bool(self, b) \
+    (fuse_new_imm_ex((self), (FUSE_MAGIC_BOOL), ((b) ? 1 : 0), __FILE__, __LINE__))
+#define fuse_new_imm_u8(self, u8) \
+    (fuse_new_imm_ex((self), (FUSE_MAGIC_U8), (uint8_t)(u8), __FILE__, __LINE__))
+#define fuse_new_imm_s32(self, s32) \
+    (fuse_new_imm_ex((self), (FUSE_MAGIC_S32), (int32_t)(s32), __FILE__, __LINE__))
+#else
+#define fuse_new_imm_null(self) \
+    (fuse_new_imm_ex((self), (FUSE_MAGIC_NULL), (0), 0, 0))
+#define fuse_new_imm_bool(self, b) \
+    (fuse_new_imm_ex((self), (FUSE_MAGIC_BOOL), ((b) ? 1 : 0), 0, 0))
+#define fuse_new_imm_u8(self, u8) \
+    (fuse_new_imm_ex((self), (FUSE_MAGIC_U8), (uint8_t)(u8), 0, 0))
+#define fuse_new_imm_s32(self, s32) \
+    (fuse_new_imm_ex((self), (FUSE_MAGIC_S32), (int32_t)(s32), 0, 0))
+#endif
+
+/** @brief Create a new immediate value for a small scalar
+ *
+ *  The magic number can be FUSE_MAGIC_NULL, FUSE_MAGIC_BOOL or an integer type up to
+ *  32 bits. If the value does not fit in the pointer (on a 32-bit platform, a value
+ *  outside of the range -2^25 to 2^25-1) then an autoreleased value is allocated
+ *  instead.
+ *
+ * @param self The fuse instance
+ * @param magic The magic number of the value
+ * @param v The value
+ * @param file The file name of the caller
+ * @param line The line number of the caller
+ * @return The new value or NULL if the value could not be created
+ */
+fuse_value_t *fuse_new_imm_ex(fuse_t *self, const uint16_t magic, int64_t v, const char *file, const int line);
+
+/** @brief Return the integer value of a bool or integer value
+ *
+ * The value can be an immediate value or an allocated value.
+ *
+ * @param self The fuse instance
+ * @param value The value
+ * @return The integer value, or zero if the value is not a bool or integer value
+ */
+int64_t fuse_value_int(fuse_t *self, fuse_value_t *value);
+
 /** @brief Create a new autoreleased value
  *
  *  This method creates a new value. The value is initialized with user_data, the behavior of which is
  *  determined by the magic number. The value is set to be automatically released, so to take ownership
  *  of the value, you must retain it with fuse_value_retain.
  *
+ *  Values are only autoreleased on the thread which runs the run loop, which is
+ *  the thread that drains released values. A value created on any other thread is
+ *  not freed until it has been retained and then released.
+ *
+ *  NULL, true, false and small u8 values are shared, immortal values which are
+ *  allocated once by the application and never drained. Retaining and releasing
+ *  them does nothing, and they must not be modified. When added to a list they are
+ *  held by a separate list node, so the list returns the same pointer.
+ *
  * @param self The fuse instance
  * @param magic The magic number of the value
  * @param size The size of the value, which is ignored if the magic number is 0
@@ -73,6 +175,69 @@ bool fuse_is_registered_value(fuse_t *self, uint16_t magic);
  */
 fuse_value_t *fuse_new_value_ex(fuse_t *self, const uint16_t magic, const void *user_data, const char *file, const int line);
 
+/** @brief Create a new autoreleased data value with aligned memory
+ *
+ *  The data is aligned to a power of two, for example 16, 32 or 64 bytes for
+ *  vector code or cache lines. Large data values are mapped with mmap on Linux,
+ *  see fuse_allocator_set_mmap.
+ *
+ * @param self The fuse instance
+ * @param size The size of the data, in bytes
+ * @param align The alignment of the data, in bytes
+ * @param file The file name of the caller
+ * @param line The line number of the caller
+ * @return The new value or NULL if the value could not be created
+ */
+fuse_value_t *fuse_new_data_aligned_ex(fuse_t *self, size_t size, size_t align, const char *file, const int line);
+
+/** @brief Change the size of a data value
+ *
+ *  The data value is resized in place if the allocator reserved enough memory for
+ *  it. Otherwise a new autoreleased data value is returned which contains a copy of
+ *  the data, with memory reserved up to the next power of two so that repeated
+ *  growth is resized in place, and with the same alignment up to 64 bytes. The
+ *  original value is not changed in that case, so the caller should retain the new
+ *  value and release the original. Any new bytes are set to zero.
+ *
+ * @param self The fuse instance
+ * @param data The data value
+ * @param newsz The new size of the data, in bytes
+ * @param file The file name of the caller
+ * @param line The line number of the caller
+ * @return The resized data value, which may be a new value, or NULL if memory could not be allocated
+ */
+fuse_value_t *fuse_data_resize_ex(fuse_t *self, fuse_value_t *data, size_t newsz, const char *file, const int line);
+
+/** @brief Create several new autoreleased values of the same type
+ *
+ *  The values are allocated with a single acquisition of the allocator lock and
+ *  initialised with NULL user data, so numbers are zero. The values are never
+ *  shared, so they can be set through the pointer. If any value cannot be
+ *  created, then no values are created.
+ *
+ * @param self The fuse instance
+ * @param magic The magic number of the values
+ * @param n The number of values to create
+ * @param out The array which is filled with the new values
+ * @param file The file name of the caller
+ * @param line The line number of the caller
+ * @return True if the values were created
+ */
+bool fuse_new_values_batch_ex(fuse_t *self, const uint16_t magic, size_t n, fuse_value_t **out, const char *file, const int line);
+
+/** @brief Release several values
+ *
+ *  This is equivalent to calling fuse_release for each value, but values which
+ *  reach a zero reference count are queued for draining with one acquisition of
+ *  the allocator lock for each block of values. NULL and immediate values are
+ *  skipped.
+ *
+ * @param self The fuse instance
+ * @param n The number of values
+ * @param values The values to release
+ */
+void fuse_release_batch(fuse_t *self, size_t n, fuse_value_t **values);
+
 /** @brief Retain the value and return it.
  *
  * This method increments the reference count of the value, to take ownership of the value.
@@ -96,7 +261,9 @@ void fuse_release(fuse_t *self, void *value);
 /** @brief Check type of a value
  *
  * This method returns the value type, or 0 if the value is not
- * a valid value or a NULL value.
+ * a valid value or a NULL value. Any pointer can be checked, and the check
+ * takes constant time. Immediate values and the shared values for NULL, true,
+ * false and small integers are checked without taking a lock.
  *
  * @param self The fuse instance
  * @param value The value
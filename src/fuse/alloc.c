@@ -1,9 +1,45 @@
 #include <fuse/fuse.h>
 #include "alloc.h"
 
+///////////////////////////////////////////////////////////////////////////////
+// DECLARATIONS
+
+static void fuse_allocator_link(struct fuse_allocator *self, struct fuse_allocator_shard *shard, struct fuse_allocator_header *block, fuse_allocator_link_t link);
+static bool fuse_allocator_charge(struct fuse_allocator *self, size_t bytes, size_t n);
+static void fuse_allocator_unlink(struct fuse_allocator *self, struct fuse_allocator_header *block);
+static void fuse_allocator_max(_Atomic size_t *max, size_t cur);
+static void fuse_allocator_stats_add(struct fuse_allocator_stats *stats, size_t size);
+static void fuse_allocator_stats_remove(struct fuse_allocator_stats *stats, size_t size);
+static void fuse_allocator_stats_resize(struct fuse_allocator_stats *stats, size_t from, size_t to);
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+static struct fuse_allocator_site *fuse_allocator_site(struct fuse_allocator *self, const char *file, int line, uint16_t magic);
+#endif
+static void fuse_allocator_list_append(struct fuse_allocator_header **head, struct fuse_allocator_header **tail, struct fuse_allocator_header *block);
+static void fuse_allocator_list_remove(struct fuse_allocator_header **head, struct fuse_allocator_header **tail, struct fuse_allocator_header *block);
+
 ///////////////////////////////////////////////////////////////////////////////
 // PUBLIC METHODS
 
+void fuse_allocator_init(struct fuse_allocator *self)
+{
+    assert(self);
+    fuse_lock_init(&self->lock);
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SHARDS; i++)
+    {
+        fuse_lock_init(&self->shard[i].lock);
+    }
+}
+
+void fuse_allocator_deinit(struct fuse_allocator *self)
+{
+    assert(self);
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SHARDS; i++)
+    {
+        fuse_lock_destroy(&self->shard[i].lock);
+    }
+    fuse_lock_destroy(&self->lock);
+}
+
 inline void fuse_allocator_destroy(struct fuse_allocator *self)
 {
     assert(self);
@@ -13,20 +49,371 @@ inline void fuse_allocator_destroy(struct fuse_allocator *self)
 inline void *fuse_allocator_malloc(struct fuse_allocator *self, size_t size, uint16_t magic, const char *file, int line)
 {
     assert(self);
-    return self->malloc(self, size, magic, file, line);
+    return fuse_allocator_malloc_aligned_ex(self, size, 0, magic, FUSE_ALLOCATOR_AUTORELEASE, file, line);
 }
 
-inline void fuse_allocator_free(struct fuse_allocator *self, void *ptr)
+inline void *fuse_allocator_malloc_retained(struct fuse_allocator *self, size_t size, uint16_t magic, const char *file, int line)
+{
+    assert(self);
+    return fuse_allocator_malloc_aligned_ex(self, size, 0, magic, FUSE_ALLOCATOR_RETAINED, file, line);
+}
+
+inline void *fuse_allocator_malloc_aligned(struct fuse_allocator *self, size_t size, size_t align, uint16_t magic, const char *file, int line)
+{
+    assert(self);
+    return fuse_allocator_malloc_aligned_ex(self, size, align, magic, FUSE_ALLOCATOR_AUTORELEASE, file, line);
+}
+
+void fuse_allocator_set_mmap(struct fuse_allocator *self, size_t threshold, uint8_t flags)
+{
+    assert(self);
+    fuse_lock_acquire(&self->lock);
+#if defined(__linux__)
+    self->mmap_threshold = threshold;
+    self->mmap_flags = flags;
+#else
+    (void)threshold;
+    (void)flags;
+#endif
+    fuse_lock_release(&self->lock);
+}
+
+void fuse_allocator_set_budget(struct fuse_allocator *self, size_t budget, size_t watermark)
+{
+    assert(self);
+    assert(budget == 0 || watermark <= budget);
+    atomic_store(&self->budget, budget);
+    atomic_store(&self->watermark, watermark);
+}
+
+inline bool fuse_allocator_pressure(struct fuse_allocator *self)
+{
+    assert(self);
+    size_t watermark = atomic_load_explicit(&self->watermark, memory_order_relaxed);
+    return watermark != 0 && atomic_load_explicit(&self->cur, memory_order_relaxed) >= watermark;
+}
+
+void fuse_allocator_free(struct fuse_allocator *self, void *ptr)
 {
     assert(self);
     assert(ptr);
+
+    // Get the header
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+
+    // Unlink from the list, then return the memory block to the implementation
+    fuse_allocator_unlink(self, block);
     self->free(self, ptr);
 }
 
+bool fuse_allocator_malloc_batch(struct fuse_allocator *self, size_t size, uint16_t magic, fuse_allocator_link_t link, size_t n, void **ptrs, const char *file, int line)
+{
+    assert(self);
+    assert(ptrs || n == 0);
+
+    // The implementation allocates the memory blocks together if it can, or else each
+    // memory block in turn. If any allocation fails, no memory blocks are allocated
+    if (self->malloc_batch != NULL)
+    {
+        if (!self->malloc_batch(self, size, magic, n, ptrs, file, line))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            ptrs[i] = self->malloc(self, size, 0, magic, file, line);
+            if (ptrs[i] == NULL)
+            {
+                while (i > 0)
+                {
+                    self->free(self, ptrs[--i]);
+                }
+                return false;
+            }
+        }
+    }
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        assert(FUSE_ALLOCATOR_VALID(FUSE_ALLOCATOR_HEADER(ptrs[i])));
+        bytes += sizeof(struct fuse_allocator_header) + FUSE_ALLOCATOR_HEADER(ptrs[i])->size;
+    }
+
+    // Check the budget, and link all memory blocks into the lists for the shard
+    if (!fuse_allocator_charge(self, bytes, n))
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            self->free(self, ptrs[i]);
+        }
+        return false;
+    }
+    struct fuse_allocator_shard *shard = &self->shard[fuse_lock_shard() % FUSE_ALLOCATOR_SHARDS];
+    fuse_lock_acquire(&shard->lock);
+    for (size_t i = 0; i < n; i++)
+    {
+        fuse_allocator_link(self, shard, FUSE_ALLOCATOR_HEADER(ptrs[i]), link);
+    }
+    fuse_lock_release(&shard->lock);
+
+    // Return success
+    return true;
+}
+
+void fuse_allocator_release_batch(struct fuse_allocator *self, size_t n, void **ptrs)
+{
+    assert(self);
+    assert(ptrs || n == 0);
+
+    for (size_t j = 0; j < n; j += FUSE_ALLOCATOR_BATCH)
+    {
+        size_t k = (n - j) < FUSE_ALLOCATOR_BATCH ? (n - j) : FUSE_ALLOCATOR_BATCH;
+
+        // Decrement the reference counts, and mark the memory blocks which reach zero
+        uint64_t zero = 0;
+        for (size_t i = 0; i < k; i++)
+        {
+            void *ptr = ptrs[j + i];
+            if (ptr == NULL)
+            {
+                continue;
+            }
+            struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+            assert(FUSE_ALLOCATOR_VALID(block));
+            if (atomic_load(&block->ref) == FUSE_ALLOCATOR_IMMORTAL)
+            {
+                continue;
+            }
+            uint16_t ref = atomic_fetch_sub(&block->ref, 1);
+            assert(ref > 0);
+            if (ref == 1)
+            {
+                zero |= ((uint64_t)1 << i);
+            }
+        }
+        if (zero == 0)
+        {
+            continue;
+        }
+
+        // Move the marked memory blocks to the list of memory blocks to be drained, with
+        // one acquisition of the lock for each shard. The reference count may have been
+        // incremented again by another thread
+        while (zero != 0)
+        {
+            struct fuse_allocator_shard *shard = &self->shard[FUSE_ALLOCATOR_HEADER(ptrs[j + __builtin_ctzll(zero)])->shard];
+            fuse_lock_acquire(&shard->lock);
+            for (size_t i = 0; i < k; i++)
+            {
+                if ((zero & ((uint64_t)1 << i)) == 0)
+                {
+                    continue;
+                }
+                struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptrs[j + i]);
+                if (&self->shard[block->shard] != shard)
+                {
+                    continue;
+                }
+#ifdef FUSE_COMPACT
+                assert(!block->listed);
+#endif
+                if (block->retained && atomic_load(&block->ref) == 0)
+                {
+                    fuse_allocator_list_remove(&shard->head, &shard->tail, block);
+                    fuse_allocator_list_append(&shard->zhead, &shard->ztail, block);
+                    block->retained = false;
+                }
+                zero &= ~((uint64_t)1 << i);
+            }
+            fuse_lock_release(&shard->lock);
+        }
+    }
+}
+
+bool fuse_allocator_resize(struct fuse_allocator *self, void *ptr, size_t size)
+{
+    assert(self);
+    assert(ptr);
+
+    // Get the header
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+    size_t from = block->size;
+    if (size == from)
+    {
+        return true;
+    }
+
+    // A memory block accounted at its capacity stays within that capacity, and the
+    // statistics do not change
+    if (block->flags & FUSE_ALLOCATOR_FLAG_RESERVE)
+    {
+        if (fuse_allocator_capacity(size) != fuse_allocator_capacity(from) || self->resize == NULL)
+        {
+            return false;
+        }
+        return self->resize(self, ptr, size);
+    }
+
+    // Check the budget, ask the implementation to resize, and then update the stats
+    if (size > from && !fuse_allocator_charge(self, size - from, 0))
+    {
+        return false;
+    }
+    if (self->resize == NULL || !self->resize(self, ptr, size))
+    {
+        if (size > from)
+        {
+            atomic_fetch_sub(&self->cur, size - from);
+        }
+        return false;
+    }
+    if (size < from)
+    {
+        atomic_fetch_sub(&self->cur, from - size);
+    }
+    if (block->magic < FUSE_MAGIC_COUNT)
+    {
+        fuse_allocator_stats_resize(&self->stats[block->magic], from, size);
+    }
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+    struct fuse_allocator_site *site = fuse_allocator_site(self, block->file, block->line, block->magic);
+    if (site != NULL)
+    {
+        fuse_allocator_stats_resize(&site->stats, from, size);
+    }
+#endif
+
+    // Return success
+    return true;
+}
+
+size_t fuse_allocator_capacity(size_t size)
+{
+    size_t capacity = FUSE_ALLOCATOR_CAPACITY_MIN;
+    while (capacity < size && capacity <= SIZE_MAX / 2)
+    {
+        capacity <<= 1;
+    }
+    return capacity < size ? size : capacity;
+}
+
+void fuse_allocator_reserve(struct fuse_allocator *self, void *ptr, size_t size)
+{
+    assert(self);
+    assert(ptr);
+
+    // Get the header, which was allocated at the capacity for the size
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+    assert(block->size == fuse_allocator_capacity(size));
+    assert(self->resize);
+
+    // Set the size, which is within the capacity so does not move
+    bool success = self->resize(self, ptr, size);
+    assert(success);
+    (void)success;
+    block->flags |= FUSE_ALLOCATOR_FLAG_RESERVE;
+}
+
+void fuse_allocator_attach(struct fuse_allocator *self, void *ptr)
+{
+    assert(self);
+    assert(ptr);
+#ifdef FUSE_COMPACT
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+
+    // Remove from the list of retained blocks, and clear the pointers for the list
+    struct fuse_allocator_shard *shard = &self->shard[block->shard];
+    fuse_lock_acquire(&shard->lock);
+    assert(block->retained && !block->listed);
+    fuse_allocator_list_remove(&shard->head, &shard->tail, block);
+    block->listed = true;
+    fuse_lock_release(&shard->lock);
+#endif
+}
+
+void fuse_allocator_detach(struct fuse_allocator *self, void *ptr)
+{
+    assert(self);
+    assert(ptr);
+#ifdef FUSE_COMPACT
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+
+    // Return to the list of retained blocks
+    struct fuse_allocator_shard *shard = &self->shard[block->shard];
+    fuse_lock_acquire(&shard->lock);
+    assert(block->retained && block->listed);
+    assert(block->head == NULL && block->tail == NULL);
+    block->listed = false;
+    fuse_allocator_list_append(&shard->head, &shard->tail, block);
+    fuse_lock_release(&shard->lock);
+#endif
+}
+
+void fuse_allocator_immortal(struct fuse_allocator *self, void *ptr)
+{
+    assert(self);
+    assert(ptr);
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+    assert(block->retained);
+    atomic_store(&block->ref, FUSE_ALLOCATOR_IMMORTAL);
+}
+
+inline bool fuse_allocator_is_immortal(struct fuse_allocator *self, void *ptr)
+{
+    assert(self);
+    assert(ptr);
+    return atomic_load(&FUSE_ALLOCATOR_HEADER(ptr)->ref) == FUSE_ALLOCATOR_IMMORTAL;
+}
+
+void fuse_allocator_teardown(struct fuse_allocator *self)
+{
+    assert(self);
+    fuse_lock_acquire(&self->lock);
+    self->teardown = true;
+    fuse_lock_release(&self->lock);
+}
+
+void *fuse_allocator_zombie(struct fuse_allocator *self)
+{
+    assert(self);
+
+    // Start with the shard which last had memory blocks to be drained
+    uint8_t first = atomic_load(&self->zshard);
+    for (uint8_t i = 0; i < FUSE_ALLOCATOR_SHARDS; i++)
+    {
+        uint8_t s = (first + i) % FUSE_ALLOCATOR_SHARDS;
+        struct fuse_allocator_shard *shard = &self->shard[s];
+        fuse_lock_acquire(&shard->lock);
+        void *ptr = (shard->zhead == NULL) ? NULL : FUSE_ALLOCATOR_PTR(shard->zhead);
+        fuse_lock_release(&shard->lock);
+        if (ptr != NULL)
+        {
+            atomic_store(&self->zshard, s);
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
 inline uint16_t fuse_allocator_magic(struct fuse_allocator *self, void *ptr)
 {
     assert(self);
     assert(ptr);
+
+    // Immediate values have no header, and contain the magic number
+    if (fuse_value_is_imm(ptr))
+    {
+        return fuse_value_imm_magic(ptr);
+    }
     return self->magic(self, ptr);
 }
 
@@ -37,6 +424,13 @@ inline size_t fuse_allocator_size(struct fuse_allocator *self, void *ptr)
     return self->size(self, ptr);
 }
 
+inline bool fuse_allocator_valid(struct fuse_allocator *self, void *ptr)
+{
+    assert(self);
+    assert(self->valid);
+    return ptr != NULL && self->valid(self, ptr);
+}
+
 inline void fuse_allocator_retain(struct fuse_allocator *self, void *ptr)
 {
     assert(self);
@@ -50,3 +444,351 @@ inline bool fuse_allocator_release(struct fuse_allocator *self, void *ptr)
     assert(ptr);
     return self->release(self, ptr);
 }
+
+/** @brief Allocate a memory block from the implementation, and link it into the list of
+ *         memory blocks
+ */
+void *fuse_allocator_malloc_aligned_ex(struct fuse_allocator *self, size_t size, size_t align, uint16_t magic, fuse_allocator_link_t link, const char *file, int line)
+{
+    assert(self);
+    assert((align & (align - 1)) == 0);
+
+    // The implementation allocates the memory block and sets the header
+    void *ptr = self->malloc(self, size, align, magic, file, line);
+    if (ptr == NULL)
+    {
+        return NULL;
+    }
+
+    // Get the header
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+
+    // Check the budget, and link into the lists for the shard
+    if (!fuse_allocator_charge(self, sizeof(struct fuse_allocator_header) + block->size, 1))
+    {
+        self->free(self, ptr);
+        return NULL;
+    }
+    struct fuse_allocator_shard *shard = &self->shard[fuse_lock_shard() % FUSE_ALLOCATOR_SHARDS];
+    fuse_lock_acquire(&shard->lock);
+    fuse_allocator_link(self, shard, block, link);
+    fuse_lock_release(&shard->lock);
+
+    // Return pointer to the memory block
+    return ptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// IMPLEMENTATION METHODS
+
+void fuse_allocator_retained(struct fuse_allocator *self, struct fuse_allocator_header *block)
+{
+    assert(self);
+    assert(block);
+
+    // The reference count may have been decremented again by another thread
+    // before the lock was acquired
+    struct fuse_allocator_shard *shard = &self->shard[block->shard];
+    fuse_lock_acquire(&shard->lock);
+    if (!block->retained && atomic_load(&block->ref) > 0)
+    {
+        fuse_allocator_list_remove(&shard->zhead, &shard->ztail, block);
+        fuse_allocator_list_append(&shard->head, &shard->tail, block);
+        block->retained = true;
+    }
+    fuse_lock_release(&shard->lock);
+}
+
+void fuse_allocator_released(struct fuse_allocator *self, struct fuse_allocator_header *block)
+{
+    assert(self);
+    assert(block);
+
+    // The reference count may have been incremented again by another thread
+    // before the lock was acquired
+    struct fuse_allocator_shard *shard = &self->shard[block->shard];
+    fuse_lock_acquire(&shard->lock);
+#ifdef FUSE_COMPACT
+    assert(!block->listed);
+#endif
+    if (block->retained && atomic_load(&block->ref) == 0)
+    {
+        fuse_allocator_list_remove(&shard->head, &shard->tail, block);
+        fuse_allocator_list_append(&shard->zhead, &shard->ztail, block);
+        block->retained = false;
+    }
+    fuse_lock_release(&shard->lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PRIVATE METHODS
+
+/** @brief Link a memory block header into the list of retained memory blocks, or the list of
+ *         memory blocks to be drained, and update the statistics. The lock for the shard
+ *         is held by the caller, and the memory block has been charged to the budget.
+ */
+static void fuse_allocator_link(struct fuse_allocator *self, struct fuse_allocator_shard *shard, struct fuse_allocator_header *block, fuse_allocator_link_t link)
+{
+    assert(self);
+    assert(shard);
+    assert(block);
+    assert(block->ref == 0);
+
+    // Set stats
+    size_t size = sizeof(struct fuse_allocator_header) + block->size;
+    if (block->magic < FUSE_MAGIC_COUNT)
+    {
+        fuse_allocator_stats_add(&self->stats[block->magic], size);
+    }
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+    struct fuse_allocator_site *site = fuse_allocator_site(self, block->file, block->line, block->magic);
+    if (site != NULL)
+    {
+        fuse_allocator_stats_add(&site->stats, size);
+    }
+#endif
+
+    // Link into the list of retained blocks, or the list of blocks to be drained. A
+    // held block stays in the list of retained blocks with a zero reference count,
+    // and moves to the list of blocks to be drained when it is first released
+    block->shard = (uint8_t)(shard - self->shard);
+    if (link == FUSE_ALLOCATOR_AUTORELEASE)
+    {
+        fuse_allocator_list_append(&shard->zhead, &shard->ztail, block);
+        block->retained = false;
+    }
+    else
+    {
+        atomic_store(&block->ref, link == FUSE_ALLOCATOR_RETAINED ? 1 : 0);
+        fuse_allocator_list_append(&shard->head, &shard->tail, block);
+        block->retained = true;
+    }
+}
+
+/** @brief Add a number of bytes to the total, and count a number of memory blocks.
+ *         Returns false and counts the rejection if the bytes would exceed the budget.
+ */
+static bool fuse_allocator_charge(struct fuse_allocator *self, size_t bytes, size_t n)
+{
+    assert(self);
+
+    // Add the bytes, and take them away again if they exceed the budget
+    size_t cur = atomic_fetch_add(&self->cur, bytes) + bytes;
+    size_t budget = atomic_load(&self->budget);
+    if (budget != 0 && cur > budget)
+    {
+        atomic_fetch_sub(&self->cur, bytes);
+        atomic_fetch_add(&self->rejected, 1);
+        return false;
+    }
+    atomic_fetch_add(&self->count, n);
+    fuse_allocator_max(&self->max, cur);
+    return true;
+}
+
+/** @brief Unlink a memory block header from the list of memory blocks, and update the
+ *         memory statistics
+ */
+static void fuse_allocator_unlink(struct fuse_allocator *self, struct fuse_allocator_header *block)
+{
+    assert(self);
+    assert(block);
+
+    // Unlink from the list
+    struct fuse_allocator_shard *shard = &self->shard[block->shard];
+    fuse_lock_acquire(&shard->lock);
+#ifdef FUSE_COMPACT
+    if (block->listed)
+    {
+        // Not in either list
+    }
+    else
+#endif
+    if (block->retained)
+    {
+        fuse_allocator_list_remove(&shard->head, &shard->tail, block);
+    }
+    else
+    {
+        fuse_allocator_list_remove(&shard->zhead, &shard->ztail, block);
+    }
+    fuse_lock_release(&shard->lock);
+
+    // Set stats, using the capacity which was accounted for a reserved memory block
+    size_t size = sizeof(struct fuse_allocator_header) + ((block->flags & FUSE_ALLOCATOR_FLAG_RESERVE) ? fuse_allocator_capacity(block->size) : block->size);
+    atomic_fetch_sub(&self->cur, size);
+    atomic_fetch_sub(&self->count, 1);
+    if (block->magic < FUSE_MAGIC_COUNT)
+    {
+        fuse_allocator_stats_remove(&self->stats[block->magic], size);
+    }
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+    struct fuse_allocator_site *site = fuse_allocator_site(self, block->file, block->line, block->magic);
+    if (site != NULL)
+    {
+        fuse_allocator_stats_remove(&site->stats, size);
+    }
+#endif
+}
+
+/** @brief Raise a maximum to a new value, if it is larger
+ */
+static inline void fuse_allocator_max(_Atomic size_t *max, size_t cur)
+{
+    assert(max);
+    size_t prev = atomic_load(max);
+    while (cur > prev && !atomic_compare_exchange_weak(max, &prev, cur))
+    {
+        continue;
+    }
+}
+
+/** @brief Add a memory block to allocation statistics
+ */
+static void fuse_allocator_stats_add(struct fuse_allocator_stats *stats, size_t size)
+{
+    assert(stats);
+
+    size_t cur = atomic_fetch_add(&stats->cur, size) + size;
+    atomic_fetch_add(&stats->allocs, 1);
+    fuse_allocator_max(&stats->max, cur);
+}
+
+/** @brief Remove a memory block from allocation statistics
+ */
+static void fuse_allocator_stats_remove(struct fuse_allocator_stats *stats, size_t size)
+{
+    assert(stats);
+
+    size_t cur = atomic_fetch_sub(&stats->cur, size);
+    assert(cur >= size);
+    (void)cur;
+    atomic_fetch_add(&stats->frees, 1);
+}
+
+/** @brief Change the size of a memory block in allocation statistics
+ */
+static void fuse_allocator_stats_resize(struct fuse_allocator_stats *stats, size_t from, size_t to)
+{
+    assert(stats);
+
+    if (to > from)
+    {
+        size_t cur = atomic_fetch_add(&stats->cur, to - from) + (to - from);
+        fuse_allocator_max(&stats->max, cur);
+    }
+    else
+    {
+        atomic_fetch_sub(&stats->cur, from - to);
+    }
+}
+
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+/** @brief Return the statistics for an allocation site, adding the site if it is
+ *         not yet profiled. Returns NULL if the allocation site is unknown or
+ *         there are no free slots.
+ */
+static struct fuse_allocator_site *fuse_allocator_site(struct fuse_allocator *self, const char *file, int line, uint16_t magic)
+{
+    assert(self);
+
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    // Probe the table without the lock, starting at the hash of the file and line. A
+    // site is only claimed under the lock, and the file is set after the line
+    size_t hash = ((uintptr_t)file >> 2) * 31 + (size_t)line;
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SITES; i++)
+    {
+        struct fuse_allocator_site *site = &self->sites[(hash + i) % FUSE_ALLOCATOR_SITES];
+        const char *sitefile = atomic_load(&site->file);
+        if (sitefile == file && site->line == line)
+        {
+            return site;
+        }
+        if (sitefile == NULL)
+        {
+            break;
+        }
+    }
+
+    // Claim a free slot under the lock, probing again in case another thread has
+    // claimed one for the same site
+    struct fuse_allocator_site *result = NULL;
+    fuse_lock_acquire(&self->lock);
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SITES; i++)
+    {
+        struct fuse_allocator_site *site = &self->sites[(hash + i) % FUSE_ALLOCATOR_SITES];
+        const char *sitefile = atomic_load(&site->file);
+        if (sitefile == file && site->line == line)
+        {
+            result = site;
+            break;
+        }
+        if (sitefile == NULL)
+        {
+            site->line = line;
+            site->magic = magic;
+            atomic_store(&site->file, file);
+            result = site;
+            break;
+        }
+    }
+    fuse_lock_release(&self->lock);
+
+    // Return the site, or NULL if there are no free slots
+    return result;
+}
+#endif
+
+/** @brief Append a memory block header to the end of a list
+ */
+static void fuse_allocator_list_append(struct fuse_allocator_header **head, struct fuse_allocator_header **tail, struct fuse_allocator_header *block)
+{
+    assert(head);
+    assert(tail);
+    assert(block);
+
+    if (*head == NULL)
+    {
+        *head = block;
+    }
+    if (*tail != NULL)
+    {
+        (*tail)->next = block;
+    }
+    block->prev = *tail;
+    block->next = NULL;
+    *tail = block;
+}
+
+/** @brief Remove a memory block header from a list
+ */
+static void fuse_allocator_list_remove(struct fuse_allocator_header **head, struct fuse_allocator_header **tail, struct fuse_allocator_header *block)
+{
+    assert(head);
+    assert(tail);
+    assert(block);
+
+    if (block->prev != NULL)
+    {
+        block->prev->next = block->next;
+    }
+    else
+    { // Update head if this block was at the head
+        *head = block->next;
+    }
+    if (block->next != NULL)
+    {
+        block->next->prev = block->prev;
+    } // Update tail if this block was at the tail
+    else
+    {
+        *tail = block->prev;
+    }
+    block->prev = NULL;
+    block->next = NULL;
+}
@@ -7,68 +7,227 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <fuse/alloc.h>
+#include <fuse/magic.h>
+#include "lock.h"
+
+// Define the number of allocation sites which are profiled
+#define FUSE_ALLOCATOR_SITES 32 ///< The maximum number of allocation sites which are profiled
+#define FUSE_ALLOCATOR_BATCH 64 ///< The number of memory blocks released for each acquisition of the lock
+
+// Define the number of shards for the lists of memory blocks
+#if defined(TARGET_PICO)
+#define FUSE_ALLOCATOR_SHARDS 2 ///< The number of shards, one for each core
+#else
+#define FUSE_ALLOCATOR_SHARDS 8 ///< The number of shards, shared between threads
+#endif
 
 /** @brief Represents a memory block header
+ *
+ * When FUSE_COMPACT is defined, the header does not store a pointer to the memory
+ * block, the size is stored in 32 bits, and the pointers for the list of memory
+ * blocks are shared with the pointers for a value which is a member of a list. A
+ * list member is not in the list of retained memory blocks, since it is retained
+ * by the list which it is a member of.
  */
 struct fuse_allocator_header
 {
+#ifdef FUSE_COMPACT
+    uint32_t size;        ///< The size of the memory block, in bytes
+    uint16_t magic;       ///< A magic number
+    _Atomic uint16_t ref; ///< The reference count of the memory block
+    bool retained;        ///< True if the memory block is in the list of retained memory blocks
+    bool listed;          ///< True if the memory block is a member of a list value
+    uint8_t flags;        ///< Flags for how the memory block was allocated
+    uint8_t shard;        ///< The shard whose lists contain the memory block
+    union
+    {
+        struct
+        {
+            struct fuse_allocator_header *prev; ///< The previous memory block header, or NULL if this is the first memory block header
+            struct fuse_allocator_header *next; ///< The next memory block header, or NULL if this is the last memory block header
+        };
+        struct
+        {
+            void *head; ///< The previous value in a linked list
+            void *tail; ///< The next value in a linked list
+        };
+    };
+#else
     void *ptr;                          ///< A pointer to the memory block
     size_t size;                        ///< The size of the memory block, in bytes
     uint16_t magic;                     ///< A magic number
-    uint16_t ref;                       ///< The reference count of the memory block
+    _Atomic uint16_t ref;               ///< The reference count of the memory block
+    bool retained;                      ///< True if the memory block is in the list of retained memory blocks
+    uint8_t flags;                      ///< Flags for how the memory block was allocated
+    uint8_t shard;                      ///< The shard whose lists contain the memory block
     struct fuse_allocator_header *prev; ///< The previous memory block header, or NULL if this is the first memory block header
     struct fuse_allocator_header *next; ///< The next memory block header, or NULL if this is the last memory block header
     void *head;                         ///< The previous value in a linked list
     void *tail;                         ///< The next value in a linked list
+#endif
 #ifdef DEBUG
     const char *file; ///< The file where the allocation was made
     int line;         ///< The line of the file where the allocation was made
 #endif
 };
 
+/** @brief How a new memory block is linked into the lists of memory blocks
+ */
+typedef enum
+{
+    FUSE_ALLOCATOR_AUTORELEASE = 0, ///< A zero reference count, in the list of memory blocks to be drained
+    FUSE_ALLOCATOR_RETAINED,        ///< A reference count of one, in the list of retained memory blocks
+    FUSE_ALLOCATOR_HELD,            ///< A zero reference count, in the list of retained memory blocks until it is first released
+} fuse_allocator_link_t;
+
+/** @brief The reference count of a memory block which is never freed by a drain
+ */
+#define FUSE_ALLOCATOR_IMMORTAL UINT16_MAX
+
+/** @brief Flags for how a memory block was allocated
+ */
+#define FUSE_ALLOCATOR_FLAG_PREFIX 0x01 ///< The memory block header is preceded by a fuse_allocator_prefix
+#define FUSE_ALLOCATOR_FLAG_MMAP 0x02   ///< The memory block was mapped with mmap
+#define FUSE_ALLOCATOR_FLAG_RESERVE 0x04 ///< The memory block is accounted at its capacity rather than its size
+
+/** @brief The smallest capacity reserved for a memory block which grows, in bytes,
+ *         which is the smallest slab size class so that a capacity is always a size class
+ */
+#define FUSE_ALLOCATOR_CAPACITY_MIN 8
+
+/** @brief The natural alignment of memory blocks, in bytes
+ */
+#define FUSE_ALLOCATOR_ALIGN 8
+
+/** @brief The size of a transparent hugepage, which mappings advised to use
+ *         hugepages are aligned to
+ */
+#define FUSE_ALLOCATOR_HUGEPAGE (2 * 1024 * 1024)
+
+/** @brief Represents the system memory which contains a memory block, when the memory
+ *         block is aligned or mapped
+ */
+struct fuse_allocator_prefix
+{
+    void *base;    ///< The start of the system memory
+    size_t length; ///< The length of the system memory, in bytes
+};
+
+/** @brief Return the memory block header for a pointer to a memory block
+ */
+#define FUSE_ALLOCATOR_HEADER(p) \
+    ((struct fuse_allocator_header *)((void *)(p) - sizeof(struct fuse_allocator_header)))
+
+/** @brief Return the pointer to the memory block for a memory block header
+ */
+#define FUSE_ALLOCATOR_PTR(block) \
+    ((void *)(block) + sizeof(struct fuse_allocator_header))
+
+/** @brief Check that a memory block header is for an allocated memory block, and
+ *         mark a memory block header as free
+ */
+#ifdef FUSE_COMPACT
+#define FUSE_ALLOCATOR_VALID(block) ((block)->magic != UINT16_MAX)
+#define FUSE_ALLOCATOR_INVALIDATE(block) ((block)->magic = UINT16_MAX)
+#else
+#define FUSE_ALLOCATOR_VALID(block) ((block)->ptr == FUSE_ALLOCATOR_PTR(block))
+#define FUSE_ALLOCATOR_INVALIDATE(block) ((block)->ptr = NULL)
+#endif
+
+/** @brief Represents allocation statistics for a value type or allocation site
+ */
+struct fuse_allocator_stats
+{
+    _Atomic size_t cur;    ///< The number of bytes allocated, including headers
+    _Atomic size_t max;    ///< The maximum number of bytes allocated
+    _Atomic size_t allocs; ///< The number of memory blocks which have been allocated
+    _Atomic size_t frees;  ///< The number of memory blocks which have been freed
+};
+
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+/** @brief Represents allocation statistics for an allocation site
+ *
+ * A site is claimed under the allocator lock by setting the file last, so that
+ * it can be found without the lock.
+ */
+struct fuse_allocator_site
+{
+    const char *_Atomic file;          ///< The file where the allocations were made, or NULL if the site is unused
+    int line;                          ///< The line of the file where the allocations were made
+    uint16_t magic;                    ///< The magic number of the first allocation
+    struct fuse_allocator_stats stats; ///< The statistics for the site
+};
+#endif
+
+/** @brief Represents the lists of memory blocks for a shard
+ *
+ * A memory block is linked into the lists of the shard for the thread or core which
+ * allocated it, and stays in that shard until it is freed. Each shard has its own
+ * lock, so threads which allocate and release their own memory blocks rarely contend.
+ */
+struct fuse_allocator_shard
+{
+    struct fuse_allocator_header *head;  ///< The head of the list of retained memory blocks
+    struct fuse_allocator_header *tail;  ///< The tail of the list of retained memory blocks
+    struct fuse_allocator_header *zhead; ///< The head of the list of memory blocks with a zero reference count
+    struct fuse_allocator_header *ztail; ///< The tail of the list of memory blocks with a zero reference count
+    fuse_lock_t lock;                    ///< The lock for the lists
+};
+
 /** @brief Represents an allocator implementation
  */
 struct fuse_allocator
 {
-    void *(*malloc)(struct fuse_allocator *ctx, size_t size, uint16_t magic, const char *file, int line); ///< Memory allocator
-    void (*free)(struct fuse_allocator *ctx, void *ptr);                                                  ///< Free function
+    void *(*malloc)(struct fuse_allocator *ctx, size_t size, size_t align, uint16_t magic, const char *file, int line); ///< Memory allocator, which sets the header but does not link the memory block
+    bool (*malloc_batch)(struct fuse_allocator *ctx, size_t size, uint16_t magic, size_t n, void **ptrs, const char *file, int line); ///< Allocate several memory blocks with one acquisition of each lock, or NULL to call malloc for each
+    void (*free)(struct fuse_allocator *ctx, void *ptr);                                                  ///< Free function, called after the memory block is unlinked
     void (*destroy)(struct fuse_allocator *ctx);                                                          ///< Destroy function
     uint16_t (*magic)(struct fuse_allocator *ctx, void *ptr);                                             ///< Magic function
     size_t (*size)(struct fuse_allocator *ctx, void *ptr);                                                ///< Size function
     void (*retain)(struct fuse_allocator *ctx, void *ptr);                                                ///< Retain function
     bool (*release)(struct fuse_allocator *ctx, void *ptr);                                               ///< Release function
+    bool (*valid)(struct fuse_allocator *ctx, void *ptr);                                                 ///< Valid function, which accepts any pointer
+    bool (*resize)(struct fuse_allocator *ctx, void *ptr, size_t size);                                   ///< Resize function, which sets the size if the memory block does not need to move
     void **(*headptr)(void *ptr);                                                                         ///< Pointer to the head pointer
     void **(*tailptr)(void *ptr);                                                                         ///< Pointer to the tail pointer
 
-    struct fuse_allocator_header *head; ///< The head of the list of memory blocks
-    struct fuse_allocator_header *tail; ///< The tail of the list of memory blocks
-    size_t cur;                       ///< The total number of bytes allocated
-    size_t max;                       ///< The max number of bytes allocated
+    struct fuse_allocator_shard shard[FUSE_ALLOCATOR_SHARDS]; ///< The lists of memory blocks for each shard
+    _Atomic uint8_t zshard;              ///< The shard which last had memory blocks to be drained
+    _Atomic size_t cur;                  ///< The total number of bytes allocated, including headers
+    _Atomic size_t count;                ///< The number of memory blocks allocated
+    struct fuse_allocator_stats stats[FUSE_MAGIC_COUNT]; ///< The statistics for each magic number
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+    struct fuse_allocator_site sites[FUSE_ALLOCATOR_SITES]; ///< The statistics for each allocation site
+#endif
+    _Atomic size_t max;                  ///< The max number of bytes allocated
+    _Atomic size_t budget;               ///< The maximum number of bytes allocated, or 0 for no limit
+    _Atomic size_t watermark;            ///< The high watermark in bytes, or 0 for no watermark
+    _Atomic size_t rejected;             ///< The number of allocations rejected by the budget
+    size_t mmap_threshold;               ///< The size at which memory blocks are mapped with mmap, or 0 to never use mmap
+    uint8_t mmap_flags;                  ///< Flags for memory blocks mapped with mmap
+    bool teardown;                       ///< The allocator is about to be destroyed, so memory can be released wholesale
+    fuse_lock_t lock;                    ///< The lock for the settings and for claiming allocation sites
 };
 
-/** @brief Allocate memory from the allocator
+/** @brief Initialise the locks of an allocator
  *
- *  @param self The allocator object
- *  @param size The size of the memory block to allocate
- *  @param magic The magic number to use for the memory block
- *  @param file The file where the allocation was made
- *  @param line The line where the allocation was made
- *  @returns A pointer to the allocated memory block, or NULL if no memory could be allocated
+ * @param self The allocator object
  */
-void *fuse_allocator_malloc(struct fuse_allocator *self, size_t size, uint16_t magic, const char *file, int line);
+void fuse_allocator_init(struct fuse_allocator *self);
 
-/** @brief Free a memory block in the memory pool
+/** @brief Release the locks of an allocator
  *
- *  @param self The allocator object
- *  @param ptr A pointer to the memory block
+ * @param self The allocator object
  */
-void fuse_allocator_free(struct fuse_allocator *self, void *ptr);
+void fuse_allocator_deinit(struct fuse_allocator *self);
 
 /** @brief Retrieve the magic number for a memory block
  *
  *  @param self The allocator object
- *  @param ptr A pointer to the memory block
- *  @returns The magic number for the memory block
+ *  @param ptr A pointer to the memory block, or an immediate value
+ *  @returns The magic number for the memory block or immediate value
  */
 uint16_t fuse_allocator_magic(struct fuse_allocator *self, void *ptr);
 
@@ -95,11 +254,42 @@ void fuse_allocator_retain(struct fuse_allocator *self, void *ptr);
  */
 bool fuse_allocator_release(struct fuse_allocator *self, void *ptr);
 
-/** @brief Release all memory in the pool and destroy the allocator
+/** @brief Change the size of a memory block without moving it
  *
- *  @param self The allocator object
+ * The size of a memory block can be changed if the implementation reserved
+ * enough memory when the block was allocated, for example when the size is
+ * within the same size class. Any new bytes are not initialised. The memory
+ * statistics are updated, and growth is checked against the budget.
+ *
+ * @param self The allocator object
+ * @param ptr A pointer to the memory block
+ * @param size The new size of the memory block
+ * @returns True if the memory block was resized, false if it would need to move
+ */
+bool fuse_allocator_resize(struct fuse_allocator *self, void *ptr, size_t size);
+
+/** @brief Return the capacity to reserve for a memory block which grows
+ *
+ * The capacity is the size rounded up to the next power of two, so that repeated
+ * growth only moves the memory block O(log n) times.
+ *
+ * @param size The size of the memory block
+ * @returns The capacity in bytes, which is at least the size
+ */
+size_t fuse_allocator_capacity(size_t size);
+
+/** @brief Set the size of a memory block which was allocated at its capacity
+ *
+ * The memory block continues to be accounted at its capacity in the memory
+ * statistics, and is only resized in place while the capacity of the new size is
+ * the same, so the statistics report the memory which is reserved rather than the
+ * memory which is used.
+ *
+ * @param self The allocator object
+ * @param ptr A pointer to the memory block, which has the capacity for the size
+ * @param size The size of the memory block
  */
-void fuse_allocator_destroy(struct fuse_allocator *self);
+void fuse_allocator_reserve(struct fuse_allocator *self, void *ptr, size_t size);
 
 /** @brief Retrieve the head pointer for a memory block
  *
@@ -121,4 +311,160 @@ void **fuse_allocator_headptr(struct fuse_allocator *self, void *ptr);
  */
 void **fuse_allocator_tailptr(struct fuse_allocator *self, void *ptr);
 
+/** @brief Allocate memory from the allocator with a reference count of one
+ *
+ * The memory block is linked into the list of retained memory blocks, so it
+ * cannot be drained by another thread before the caller has finished with it.
+ *
+ *  @param self The allocator object
+ *  @param size The size of the memory block to allocate
+ *  @param magic The magic number to use for the memory block
+ *  @param file The file where the allocation was made
+ *  @param line The line where the allocation was made
+ *  @returns A pointer to the allocated memory block, or NULL if no memory could be allocated
+ */
+void *fuse_allocator_malloc_retained(struct fuse_allocator *self, size_t size, uint16_t magic, const char *file, int line);
+
+/** @brief Allocate aligned memory from the allocator, which is retained if required
+ *
+ * A memory block which is held has a zero reference count, but is not drained
+ * until it has been retained and released. This is used for memory blocks which
+ * are allocated on a thread that does not drain, since a drain on another thread
+ * could otherwise free the memory block before the caller can retain it.
+ *
+ *  @param self The allocator object
+ *  @param size The size of the memory block to allocate
+ *  @param align The alignment of the memory block, which is a power of two, or 0 for the natural alignment
+ *  @param magic The magic number to use for the memory block
+ *  @param link How the memory block is linked into the lists of memory blocks
+ *  @param file The file where the allocation was made
+ *  @param line The line where the allocation was made
+ *  @returns A pointer to the allocated memory block, or NULL if no memory could be allocated
+ */
+void *fuse_allocator_malloc_aligned_ex(struct fuse_allocator *self, size_t size, size_t align, uint16_t magic, fuse_allocator_link_t link, const char *file, int line);
+
+/** @brief Allocate several memory blocks of the same size from the allocator
+ *
+ * The implementation carves the memory blocks together when it has a batch entry
+ * point, and they are linked into the lists of memory blocks with a single
+ * acquisition of the shard lock. If any memory block cannot be allocated,
+ * then no memory blocks are allocated.
+ *
+ *  @param self The allocator object
+ *  @param size The size of each memory block
+ *  @param magic The magic number to use for the memory blocks
+ *  @param link How the memory blocks are linked into the lists of memory blocks
+ *  @param n The number of memory blocks to allocate
+ *  @param ptrs The array which is filled with pointers to the memory blocks
+ *  @param file The file where the allocation was made
+ *  @param line The line where the allocation was made
+ *  @returns True if all the memory blocks were allocated
+ */
+bool fuse_allocator_malloc_batch(struct fuse_allocator *self, size_t size, uint16_t magic, fuse_allocator_link_t link, size_t n, void **ptrs, const char *file, int line);
+
+/** @brief Release several memory blocks
+ *
+ * The reference counts are decremented without a lock, and the memory blocks
+ * whose reference count reaches zero are moved to the list of memory blocks to be
+ * drained with one acquisition of each shard lock for every
+ * FUSE_ALLOCATOR_BATCH memory blocks. NULL pointers and immortal memory blocks are
+ * skipped.
+ *
+ * @param self The allocator object
+ * @param n The number of memory blocks
+ * @param ptrs The pointers to the memory blocks
+ */
+void fuse_allocator_release_batch(struct fuse_allocator *self, size_t n, void **ptrs);
+
+/** @brief Mark a retained memory block as a member of a list value
+ *
+ * When FUSE_COMPACT is defined, the memory block is removed from the list of
+ * retained memory blocks, so the head and tail pointers can be used by the list.
+ * Otherwise this method does nothing.
+ *
+ * @param self The allocator object
+ * @param ptr A pointer to the memory block
+ */
+void fuse_allocator_attach(struct fuse_allocator *self, void *ptr);
+
+/** @brief Mark a retained memory block as no longer a member of a list value
+ *
+ * When FUSE_COMPACT is defined, the memory block is returned to the list of
+ * retained memory blocks. The head and tail pointers are cleared by the list
+ * before this method is called. Otherwise this method does nothing.
+ *
+ * @param self The allocator object
+ * @param ptr A pointer to the memory block
+ */
+void fuse_allocator_detach(struct fuse_allocator *self, void *ptr);
+
+/** @brief Return true if the number of bytes allocated is above the high watermark
+ *
+ * @param self The allocator object
+ * @returns True if there is memory pressure
+ */
+bool fuse_allocator_pressure(struct fuse_allocator *self);
+
+/** @brief Mark a retained memory block as immortal
+ *
+ * The reference count of an immortal memory block is not changed by retain
+ * and release, so it is never moved to the list of memory blocks to be drained.
+ * It remains in the list of retained memory blocks until it is freed.
+ *
+ * @param self The allocator object
+ * @param ptr A pointer to the memory block
+ */
+void fuse_allocator_immortal(struct fuse_allocator *self, void *ptr);
+
+/** @brief Return true if a memory block is immortal
+ *
+ * @param self The allocator object
+ * @param ptr A pointer to the memory block
+ * @returns True if the memory block is immortal
+ */
+bool fuse_allocator_is_immortal(struct fuse_allocator *self, void *ptr);
+
+/** @brief Put the allocator into teardown mode before it is destroyed
+ *
+ * In teardown mode, memory blocks are still unlinked when freed, so that the
+ * lists only contain leaked memory blocks, but an implementation which releases
+ * its memory wholesale when destroyed does not need to return each memory block
+ * to its free lists.
+ *
+ * @param self The allocator object
+ */
+void fuse_allocator_teardown(struct fuse_allocator *self);
+
+/** @brief Return the first memory block with a zero reference count
+ *
+ * The shards are searched starting with the shard which last had memory blocks to
+ * be drained.
+ *
+ * @param self The allocator object
+ * @returns A pointer to the memory block, or NULL if there are no memory blocks to be drained
+ */
+void *fuse_allocator_zombie(struct fuse_allocator *self);
+
+/** @brief Move a memory block header into the list of retained memory blocks
+ *
+ * This method is used by allocator implementations when the reference count
+ * of a memory block has been incremented from zero. It acquires the lock of the
+ * shard which contains the memory block, and only moves the memory block if the reference count is still non-zero.
+ *
+ * @param self The allocator object
+ * @param block The memory block header
+ */
+void fuse_allocator_retained(struct fuse_allocator *self, struct fuse_allocator_header *block);
+
+/** @brief Move a memory block header into the list of memory blocks to be drained
+ *
+ * This method is used by allocator implementations when the reference count
+ * of a memory block has been decremented to zero. It acquires the lock of the
+ * shard which contains the memory block, and only moves the memory block if the reference count is still zero.
+ *
+ * @param self The allocator object
+ * @param block The memory block header
+ */
+void fuse_allocator_released(struct fuse_allocator *self, struct fuse_allocator_header *block);
+
 #endif
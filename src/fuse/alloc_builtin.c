@@ -2,21 +2,52 @@
 #include <string.h>
 #include <fuse/fuse.h>
 #include "alloc.h"
+#include "alloc_builtin.h"
+#include "alloc_index.h"
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// DEFINITIONS
+
+/** @brief Represents a part of the index of memory blocks, with its own lock
+ */
+struct fuse_allocator_builtin_shard
+{
+    struct fuse_allocator_index index; ///< The headers of the allocated memory blocks in the shard
+    fuse_lock_t lock;                  ///< The lock for the index
+};
+
+/** @brief Represents a builtin allocator
+ *
+ * The index of memory blocks is split into shards by the address of the header, so
+ * that allocating, freeing and checking memory blocks does not take a single lock.
+ */
+struct fuse_allocator_builtin
+{
+    struct fuse_allocator allocator;                                 ///< The allocator implementation, which needs to be the first member
+    struct fuse_allocator_builtin_shard shard[FUSE_ALLOCATOR_SHARDS]; ///< The index of memory blocks, in shards
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 // FORWARD DECLARATIONS
 
 void free(void *ptr);
 void *malloc(size_t size);
-void *fuse_allocator_builtin_malloc(struct fuse_allocator *ctx, size_t size, uint16_t magic, const char *file, int line);
+#if defined(__APPLE__)
+size_t malloc_size(const void *ptr);
+#elif defined(__GLIBC__) || defined(TARGET_PICO)
+size_t malloc_usable_size(void *ptr);
+#endif
+void *fuse_allocator_builtin_malloc(struct fuse_allocator *ctx, size_t size, size_t align, uint16_t magic, const char *file, int line);
+static bool fuse_allocator_builtin_malloc_batch(struct fuse_allocator *ctx, size_t size, uint16_t magic, size_t n, void **ptrs, const char *file, int line);
 void fuse_allocator_builtin_free(struct fuse_allocator *ctx, void *ptr);
 void fuse_allocator_builtin_destroy(struct fuse_allocator *ctx);
-uint16_t fuse_allocator_builtin_magic(struct fuse_allocator *ctx, void *ptr);
-size_t fuse_allocator_builtin_size(struct fuse_allocator *ctx, void *ptr);
-void fuse_allocator_builtin_retain(struct fuse_allocator *ctx, void *ptr);
-bool fuse_allocator_builtin_release(struct fuse_allocator *ctx, void *ptr);
-void **fuse_allocator_builtin_headptr(void *ptr);
-void **fuse_allocator_builtin_tailptr(void *ptr);
+static bool fuse_allocator_builtin_valid(struct fuse_allocator *ctx, void *ptr);
+static bool fuse_allocator_builtin_resize(struct fuse_allocator *ctx, void *ptr, size_t size);
+static struct fuse_allocator_builtin_shard *fuse_allocator_builtin_shard(struct fuse_allocator_builtin *builtin, const void *block);
 
 ///////////////////////////////////////////////////////////////////////////////
 // LIFECYCLE
@@ -24,17 +55,19 @@ void **fuse_allocator_builtin_tailptr(void *ptr);
 struct fuse_allocator *fuse_allocator_builtin_new()
 {
     // Allocate memory for the allocator
-    struct fuse_allocator *allocator = malloc(sizeof(struct fuse_allocator));
-    if (allocator == NULL)
+    struct fuse_allocator_builtin *builtin = malloc(sizeof(struct fuse_allocator_builtin));
+    if (builtin == NULL)
     {
         return NULL;
     }
 
     // Zero all data structures
-    memset(allocator, 0, sizeof(struct fuse_allocator));
+    memset(builtin, 0, sizeof(struct fuse_allocator_builtin));
+    struct fuse_allocator *allocator = &builtin->allocator;
 
     // Set the allocator properties
     allocator->malloc = fuse_allocator_builtin_malloc;
+    allocator->malloc_batch = fuse_allocator_builtin_malloc_batch;
     allocator->free = fuse_allocator_builtin_free;
     allocator->destroy = fuse_allocator_builtin_destroy;
     allocator->magic = fuse_allocator_builtin_magic;
@@ -43,8 +76,16 @@ struct fuse_allocator *fuse_allocator_builtin_new()
     allocator->release = fuse_allocator_builtin_release;
     allocator->headptr = fuse_allocator_builtin_headptr;
     allocator->tailptr = fuse_allocator_builtin_tailptr;
-    allocator->cur = sizeof(struct fuse_allocator);
+    allocator->valid = fuse_allocator_builtin_valid;
+    allocator->resize = fuse_allocator_builtin_resize;
+    allocator->mmap_threshold = FUSE_ALLOCATOR_MMAP_THRESHOLD;
+    allocator->cur = sizeof(struct fuse_allocator_builtin);
     allocator->max = allocator->cur;
+    fuse_allocator_init(allocator);
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SHARDS; i++)
+    {
+        fuse_lock_init(&builtin->shard[i].lock);
+    }
 
     // Return the allocator
     return allocator;
@@ -53,48 +94,106 @@ struct fuse_allocator *fuse_allocator_builtin_new()
 ///////////////////////////////////////////////////////////////////////////////
 // PRIVATE METHODS
 
-void *fuse_allocator_builtin_malloc(struct fuse_allocator *ctx, size_t size, uint16_t magic, const char *file, int line)
+void *fuse_allocator_builtin_malloc(struct fuse_allocator *ctx, size_t size, size_t align, uint16_t magic, const char *file, int line)
 {
     assert(ctx);
 
     // Create a header
-    struct fuse_allocator_header *block = malloc(sizeof(struct fuse_allocator_header) + size);
+    uint8_t flags;
+    struct fuse_allocator_header *block = fuse_allocator_builtin_sysmalloc(ctx, size, align, &flags);
     if (block == NULL)
     {
         return NULL;
     }
-
-    // Set stats
-    ctx->cur += size;
-    if (ctx->cur > ctx->max)
+    fuse_allocator_builtin_header(block, size, magic, flags, file, line);
+
+    // Add to the index
+    struct fuse_allocator_builtin_shard *shard = fuse_allocator_builtin_shard((struct fuse_allocator_builtin *)ctx, block);
+    fuse_lock_acquire(&shard->lock);
+    bool success = fuse_allocator_index_add(&shard->index, &shard->lock, block);
+    fuse_lock_release(&shard->lock);
+    if (!success)
     {
-        ctx->max = ctx->cur;
+        fuse_allocator_builtin_sysfree(block);
+        return NULL;
     }
 
-    // Zero all data structures
-    memset(block, 0, sizeof(struct fuse_allocator_header));
-    block->ptr = (void *)block + sizeof(struct fuse_allocator_header);
-    block->size = size;
-    block->magic = magic;
-#ifdef DEBUG
-    block->file = file;
-    block->line = line;
-#endif
+    // Return pointer to the memory block
+    return FUSE_ALLOCATOR_PTR(block);
+}
+
+/** @brief Allocate several memory blocks, and add them to the index with one
+ *         acquisition of the lock for each shard
+ */
+static bool fuse_allocator_builtin_malloc_batch(struct fuse_allocator *ctx, size_t size, uint16_t magic, size_t n, void **ptrs, const char *file, int line)
+{
+    assert(ctx);
+    assert(ptrs || n == 0);
+    struct fuse_allocator_builtin *builtin = (struct fuse_allocator_builtin *)ctx;
 
-    // Link into the list
-    if (ctx->head == NULL)
+    // Allocate the memory blocks without holding a lock
+    for (size_t i = 0; i < n; i++)
     {
-        ctx->head = block;
+        uint8_t flags;
+        struct fuse_allocator_header *block = fuse_allocator_builtin_sysmalloc(ctx, size, 0, &flags);
+        if (block == NULL)
+        {
+            while (i > 0)
+            {
+                fuse_allocator_builtin_sysfree(FUSE_ALLOCATOR_HEADER(ptrs[--i]));
+            }
+            return false;
+        }
+        fuse_allocator_builtin_header(block, size, magic, flags, file, line);
+        ptrs[i] = FUSE_ALLOCATOR_PTR(block);
     }
-    if (ctx->tail != NULL)
+
+    // Add the memory blocks for each shard of the index
+    size_t added = 0;
+    bool success = true;
+    for (size_t s = 0; s < FUSE_ALLOCATOR_SHARDS && success; s++)
     {
-        ctx->tail->next = block;
+        struct fuse_allocator_builtin_shard *shard = &builtin->shard[s];
+        fuse_lock_acquire(&shard->lock);
+        for (size_t i = 0; i < n; i++)
+        {
+            struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptrs[i]);
+            if (fuse_allocator_builtin_shard(builtin, block) != shard)
+            {
+                continue;
+            }
+            if (!fuse_allocator_index_add(&shard->index, &shard->lock, block))
+            {
+                success = false;
+                break;
+            }
+            added++;
+        }
+        fuse_lock_release(&shard->lock);
     }
-    block->prev = ctx->tail;
-    ctx->tail = block;
 
-    // Return pointer to the memory block
-    return block->ptr;
+    // If the index could not grow, remove the memory blocks which were added and free
+    // them all
+    if (!success)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptrs[i]);
+            struct fuse_allocator_builtin_shard *shard = fuse_allocator_builtin_shard(builtin, block);
+            fuse_lock_acquire(&shard->lock);
+            if (added > 0 && fuse_allocator_index_contains(&shard->index, block))
+            {
+                fuse_allocator_index_remove(&shard->index, block);
+                added--;
+            }
+            fuse_lock_release(&shard->lock);
+            fuse_allocator_builtin_sysfree(block);
+        }
+        return false;
+    }
+
+    // Return success
+    return true;
 }
 
 void fuse_allocator_builtin_free(struct fuse_allocator *ctx, void *ptr)
@@ -103,47 +202,258 @@ void fuse_allocator_builtin_free(struct fuse_allocator *ctx, void *ptr)
     assert(ptr);
 
     // Get the header
-    struct fuse_allocator_header *block = ptr - sizeof(struct fuse_allocator_header);
-    assert(block->ptr == ptr);
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
 
-    // Unlink from the list
-    if (block->prev != NULL)
+    // Remove from the index
+    struct fuse_allocator_builtin_shard *shard = fuse_allocator_builtin_shard((struct fuse_allocator_builtin *)ctx, block);
+    fuse_lock_acquire(&shard->lock);
+    fuse_allocator_index_remove(&shard->index, block);
+    fuse_lock_release(&shard->lock);
+
+    // Free the memory block
+    fuse_allocator_builtin_sysfree(block);
+}
+
+void fuse_allocator_builtin_destroy(struct fuse_allocator *ctx)
+{
+    assert(ctx);
+
+    // Free retained blocks and blocks with a zero reference count in each shard
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SHARDS; i++)
     {
-        block->prev->next = block->next;
+        struct fuse_allocator_header *block = ctx->shard[i].head;
+        while (block != NULL)
+        {
+            struct fuse_allocator_header *next = block->next;
+            fuse_allocator_builtin_sysfree(block);
+            block = next;
+        }
+        block = ctx->shard[i].zhead;
+        while (block != NULL)
+        {
+            struct fuse_allocator_header *next = block->next;
+            fuse_allocator_builtin_sysfree(block);
+            block = next;
+        }
     }
-    else
-    { // Update head if this block was at the head
-        ctx->head = block->next;
+
+    // Free the allocator
+    struct fuse_allocator_builtin *builtin = (struct fuse_allocator_builtin *)ctx;
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SHARDS; i++)
+    {
+        fuse_allocator_index_destroy(&builtin->shard[i].index);
+        fuse_lock_destroy(&builtin->shard[i].lock);
     }
-    if (block->next != NULL)
+    fuse_allocator_deinit(ctx);
+    free(ctx);
+}
+
+/** @brief Check for an allocated memory block using the index
+ */
+static bool fuse_allocator_builtin_valid(struct fuse_allocator *ctx, void *ptr)
+{
+    assert(ctx);
+    void *block = (void *)ptr - sizeof(struct fuse_allocator_header);
+    struct fuse_allocator_builtin_shard *shard = fuse_allocator_builtin_shard((struct fuse_allocator_builtin *)ctx, block);
+
+    fuse_lock_acquire(&shard->lock);
+    bool valid = fuse_allocator_index_contains(&shard->index, block);
+    fuse_lock_release(&shard->lock);
+    return valid;
+}
+
+/** @brief Return the shard of the index for a memory block header, using the high
+ *         bits of the hash so that the shards are independent of the slots
+ */
+static inline struct fuse_allocator_builtin_shard *fuse_allocator_builtin_shard(struct fuse_allocator_builtin *builtin, const void *block)
+{
+    assert(builtin);
+    uint32_t hash = (uint32_t)(((uintptr_t)block >> 3) * (uintptr_t)2654435761u);
+    return &builtin->shard[(hash >> 24) % FUSE_ALLOCATOR_SHARDS];
+}
+
+/** @brief Resize a memory block within the memory reserved by the system malloc
+ */
+static bool fuse_allocator_builtin_resize(struct fuse_allocator *ctx, void *ptr, size_t size)
+{
+    assert(ctx);
+    assert(ptr);
+
+    // Get the header
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+
+    // Set the size if the memory block does not need to move
+    if (size > fuse_allocator_builtin_capacity(block))
     {
-        block->next->prev = block->prev;
-    } // Update tail if this block was at the tail
+        return false;
+    }
+    block->size = size;
+    return true;
+}
+
+struct fuse_allocator_header *fuse_allocator_builtin_sysmalloc(struct fuse_allocator *ctx, size_t size, size_t align, uint8_t *flags)
+{
+    assert(ctx);
+    assert(flags);
+    assert((align & (align - 1)) == 0);
+
+    // Use the system malloc when the natural alignment is sufficient
+    size_t hdr = sizeof(struct fuse_allocator_header);
+    bool mapped = ctx->mmap_threshold != 0 && size >= ctx->mmap_threshold;
+    if (!mapped && align <= FUSE_ALLOCATOR_ALIGN)
+    {
+        *flags = 0;
+        return malloc(hdr + size);
+    }
+
+    // Reserve space for the prefix and header, and for the memory block to be aligned
+    if (align < FUSE_ALLOCATOR_ALIGN)
+    {
+        align = FUSE_ALLOCATOR_ALIGN;
+    }
+    size_t length = sizeof(struct fuse_allocator_prefix) + hdr + (align - 1) + size;
+    void *base = NULL;
+#if defined(__linux__)
+    if (mapped)
+    {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        length = (length + page - 1) & ~(page - 1);
+
+        // Hugepages are only used for aligned ranges, so a mapping advised to use
+        // hugepages is a whole number of hugepages, from a larger mapping which is
+        // trimmed to the alignment
+        size_t extra = 0;
+#ifdef MADV_HUGEPAGE
+        if (ctx->mmap_flags & FUSE_ALLOCATOR_MMAP_HUGEPAGE)
+        {
+            length = (length + FUSE_ALLOCATOR_HUGEPAGE - 1) & ~(size_t)(FUSE_ALLOCATOR_HUGEPAGE - 1);
+            extra = FUSE_ALLOCATOR_HUGEPAGE - page;
+        }
+#endif
+        int mflags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+        if ((ctx->mmap_flags & FUSE_ALLOCATOR_MMAP_POPULATE) && !(ctx->mmap_flags & FUSE_ALLOCATOR_MMAP_HUGEPAGE))
+        {
+            mflags |= MAP_POPULATE;
+        }
+#endif
+        base = mmap(NULL, length + extra, PROT_READ | PROT_WRITE, mflags, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (ctx->mmap_flags & FUSE_ALLOCATOR_MMAP_HUGEPAGE)
+        {
+            // Unmap the memory before and after the aligned range
+            uintptr_t aligned = ((uintptr_t)base + FUSE_ALLOCATOR_HUGEPAGE - 1) & ~(uintptr_t)(FUSE_ALLOCATOR_HUGEPAGE - 1);
+            size_t before = aligned - (uintptr_t)base;
+            if (before > 0)
+            {
+                munmap(base, before);
+            }
+            if (extra > before)
+            {
+                munmap((uint8_t *)aligned + length, extra - before);
+            }
+            base = (void *)aligned;
+            madvise(base, length, MADV_HUGEPAGE);
+
+            // Fault in the pages after the advice, so that hugepages are used
+            if (ctx->mmap_flags & FUSE_ALLOCATOR_MMAP_POPULATE)
+            {
+                for (size_t i = 0; i < length; i += page)
+                {
+                    ((volatile uint8_t *)base)[i] = 0;
+                }
+            }
+        }
+#endif
+        *flags = FUSE_ALLOCATOR_FLAG_PREFIX | FUSE_ALLOCATOR_FLAG_MMAP;
+    }
     else
+#endif
     {
-        ctx->tail = block->prev;
+        base = malloc(length);
+        if (base == NULL)
+        {
+            return NULL;
+        }
+        *flags = FUSE_ALLOCATOR_FLAG_PREFIX;
     }
 
-    // Set stats
-    ctx->cur -= block->size;
+    // Place the header so that the memory block is aligned, with the prefix before it
+    uintptr_t ptr = ((uintptr_t)base + sizeof(struct fuse_allocator_prefix) + hdr + align - 1) & ~(uintptr_t)(align - 1);
+    struct fuse_allocator_header *block = (struct fuse_allocator_header *)(ptr - hdr);
+    struct fuse_allocator_prefix *prefix = (struct fuse_allocator_prefix *)block - 1;
+    prefix->base = base;
+    prefix->length = length;
 
-    // Free the memory block
-    free(block);
+    // Return the header
+    return block;
 }
 
-void fuse_allocator_builtin_destroy(struct fuse_allocator *ctx)
+void fuse_allocator_builtin_sysfree(struct fuse_allocator_header *block)
 {
-    assert(ctx);
-    struct fuse_allocator_header *block = ctx->head;
-    while (block != NULL)
+    assert(block);
+    if (!(block->flags & FUSE_ALLOCATOR_FLAG_PREFIX))
     {
-        struct fuse_allocator_header *next = block->next;
         free(block);
-        block = next;
+        return;
+    }
+    struct fuse_allocator_prefix *prefix = (struct fuse_allocator_prefix *)block - 1;
+#if defined(__linux__)
+    if (block->flags & FUSE_ALLOCATOR_FLAG_MMAP)
+    {
+        munmap(prefix->base, prefix->length);
+        return;
     }
+#endif
+    free(prefix->base);
+}
 
-    // Free the allocator
-    free(ctx);
+void *fuse_allocator_builtin_header(struct fuse_allocator_header *block, size_t size, uint16_t magic, uint8_t flags, const char *file, int line)
+{
+    assert(block);
+
+    // Zero all data structures
+    memset(block, 0, sizeof(struct fuse_allocator_header));
+#ifndef FUSE_COMPACT
+    block->ptr = FUSE_ALLOCATOR_PTR(block);
+#endif
+    block->size = size;
+    block->magic = magic;
+    block->flags = flags;
+#ifdef DEBUG
+    block->file = file;
+    block->line = line;
+#endif
+
+    // Return pointer to the memory block
+    return FUSE_ALLOCATOR_PTR(block);
+}
+
+size_t fuse_allocator_builtin_capacity(struct fuse_allocator_header *block)
+{
+    assert(block);
+
+    // The prefix records the length of the system memory
+    if (block->flags & FUSE_ALLOCATOR_FLAG_PREFIX)
+    {
+        struct fuse_allocator_prefix *prefix = (struct fuse_allocator_prefix *)block - 1;
+        return prefix->length - ((uintptr_t)FUSE_ALLOCATOR_PTR(block) - (uintptr_t)prefix->base);
+    }
+#if defined(__APPLE__)
+    size_t capacity = malloc_size(block);
+#elif defined(__GLIBC__) || defined(TARGET_PICO)
+    size_t capacity = malloc_usable_size(block);
+#else
+    size_t capacity = 0;
+#endif
+    capacity = (capacity > sizeof(struct fuse_allocator_header)) ? capacity - sizeof(struct fuse_allocator_header) : 0;
+    return capacity > block->size ? capacity : block->size;
 }
 
 uint16_t fuse_allocator_builtin_magic(struct fuse_allocator *ctx, void *ptr)
@@ -152,8 +462,8 @@ uint16_t fuse_allocator_builtin_magic(struct fuse_allocator *ctx, void *ptr)
     assert(ptr);
 
     // Get the header
-    struct fuse_allocator_header *block = ptr - sizeof(struct fuse_allocator_header);
-    assert(block->ptr == ptr);
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
 
     // Return the magic number
     return block->magic;
@@ -165,8 +475,8 @@ size_t fuse_allocator_builtin_size(struct fuse_allocator *ctx, void *ptr)
     assert(ptr);
 
     // Get the header
-    struct fuse_allocator_header *block = ptr - sizeof(struct fuse_allocator_header);
-    assert(block->ptr == ptr);
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
 
     // Return the size
     return block->size;
@@ -178,13 +488,22 @@ void fuse_allocator_builtin_retain(struct fuse_allocator *ctx, void *ptr)
     assert(ptr);
 
     // Get the header
-    struct fuse_allocator_header *block = ptr - sizeof(struct fuse_allocator_header);
-    assert(block->ptr == ptr);
-    assert(block->ref < UINT16_MAX);
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+
+    // Immortal blocks are not reference counted
+    if (atomic_load(&block->ref) == FUSE_ALLOCATOR_IMMORTAL)
+    {
+        return;
+    }
 
-    // Increment the reference count
-    // TODO: Do this atomically
-    block->ref++;
+    // Increment the reference count, and move to the list of retained blocks
+    uint16_t ref = atomic_fetch_add(&block->ref, 1);
+    assert(ref < FUSE_ALLOCATOR_IMMORTAL - 1);
+    if (ref == 0)
+    {
+        fuse_allocator_retained(ctx, block);
+    }
 }
 
 bool fuse_allocator_builtin_release(struct fuse_allocator *ctx, void *ptr)
@@ -193,13 +512,24 @@ bool fuse_allocator_builtin_release(struct fuse_allocator *ctx, void *ptr)
     assert(ptr);
 
     // Get the header
-    struct fuse_allocator_header *block = ptr - sizeof(struct fuse_allocator_header);
-    assert(block->ptr == ptr);
-    assert(block->ref > 0);
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
 
-    // Decrement the reference count
-    // TODO: Do this atomically
-    return (--block->ref == 0);
+    // Immortal blocks are not reference counted
+    if (atomic_load(&block->ref) == FUSE_ALLOCATOR_IMMORTAL)
+    {
+        return false;
+    }
+
+    // Decrement the reference count, and move to the list of blocks to be drained
+    uint16_t ref = atomic_fetch_sub(&block->ref, 1);
+    assert(ref > 0);
+    if (ref == 1)
+    {
+        fuse_allocator_released(ctx, block);
+        return true;
+    }
+    return false;
 }
 
 void **fuse_allocator_builtin_headptr(void *ptr)
@@ -207,8 +537,8 @@ void **fuse_allocator_builtin_headptr(void *ptr)
     assert(ptr);
 
     // Get the header
-    struct fuse_allocator_header *block = ptr - sizeof(struct fuse_allocator_header);
-    assert(block->ptr == ptr);
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
 
     // Return the head pointer
     return &block->head;
@@ -219,8 +549,8 @@ void **fuse_allocator_builtin_tailptr(void *ptr)
     assert(ptr);
 
     // Get the header
-    struct fuse_allocator_header *block = ptr - sizeof(struct fuse_allocator_header);
-    assert(block->ptr == ptr);
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
 
     // Return the tail pointer
     return &block->tail;
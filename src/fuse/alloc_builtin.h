@@ -1,16 +1,67 @@
 /** @file alloc_builtin.h
  *  @brief Private function prototypes and structure definitions for allocators
+ *
+ * The builtin allocator places a fuse_allocator_header immediately before each
+ * memory block. Other allocators which use the same memory layout can use these
+ * methods in their implementation.
  */
 #ifndef FUSE_PRIVATE_ALLOC_BUILTIN_H
 #define FUSE_PRIVATE_ALLOC_BUILTIN_H
 
-/* @brief Create a new allocator 
- * 
- * Create a new allocator which uses the system malloc and free functions to create
- * and destroy memory blocks.
- * 
- * @returns A pointer to the new allocator
+#include "alloc.h"
+
+/** @brief Return the magic number from the header of a memory block
+ */
+uint16_t fuse_allocator_builtin_magic(struct fuse_allocator *ctx, void *ptr);
+
+/** @brief Return the size from the header of a memory block
+ */
+size_t fuse_allocator_builtin_size(struct fuse_allocator *ctx, void *ptr);
+
+/** @brief Increment the reference count in the header of a memory block
+ */
+void fuse_allocator_builtin_retain(struct fuse_allocator *ctx, void *ptr);
+
+/** @brief Decrement the reference count in the header of a memory block
+ */
+bool fuse_allocator_builtin_release(struct fuse_allocator *ctx, void *ptr);
+
+/** @brief Allocate system memory for a memory block and header
+ *
+ * The memory is mapped with mmap if the size is at least the mmap threshold of the
+ * allocator, otherwise the system malloc is used. When the memory is mapped or the
+ * alignment is larger than FUSE_ALLOCATOR_ALIGN, a fuse_allocator_prefix is placed
+ * before the header. The header is not initialised.
+ *
+ * @param ctx The allocator
+ * @param size The size of the memory block, in bytes
+ * @param align The alignment of the memory block, or 0 for the natural alignment
+ * @param flags Set to the flags which need to be set in the header
+ * @returns The memory block header, or NULL if memory could not be allocated
+ */
+struct fuse_allocator_header *fuse_allocator_builtin_sysmalloc(struct fuse_allocator *ctx, size_t size, size_t align, uint8_t *flags);
+
+/** @brief Free the system memory for a memory block header allocated with
+ *         fuse_allocator_builtin_sysmalloc
+ */
+void fuse_allocator_builtin_sysfree(struct fuse_allocator_header *block);
+
+/** @brief Set the header for a new memory block, and return the pointer to the
+ *         memory block
+ */
+void *fuse_allocator_builtin_header(struct fuse_allocator_header *block, size_t size, uint16_t magic, uint8_t flags, const char *file, int line);
+
+/** @brief Return the number of bytes after the header of a memory block allocated with
+ *         fuse_allocator_builtin_sysmalloc, which is at least the size of the memory block
+ */
+size_t fuse_allocator_builtin_capacity(struct fuse_allocator_header *block);
+
+/** @brief Return the head pointer from the header of a memory block
+ */
+void **fuse_allocator_builtin_headptr(void *ptr);
+
+/** @brief Return the tail pointer from the header of a memory block
  */
-struct fuse_allocator *fuse_allocator_builtin_new();
+void **fuse_allocator_builtin_tailptr(void *ptr);
 
 #endif
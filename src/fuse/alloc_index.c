@@ -0,0 +1,188 @@
+#include <stdbool.h>
+#include <string.h>
+#include <fuse/fuse.h>
+#include "alloc_index.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// DEFINITIONS
+
+#define FUSE_ALLOCATOR_INDEX_EMPTY 0   ///< An empty slot
+#define FUSE_ALLOCATOR_INDEX_DELETED 1 ///< A slot which has been deleted, addresses are never odd
+#define FUSE_ALLOCATOR_INDEX_MIN 16    ///< The minimum number of slots
+
+void free(void *ptr);
+void *malloc(size_t size);
+static size_t fuse_allocator_index_find(struct fuse_allocator_index *index, uintptr_t key);
+static uintptr_t *fuse_allocator_index_rehash(struct fuse_allocator_index *index, uintptr_t *slots, size_t size);
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+void fuse_allocator_index_destroy(struct fuse_allocator_index *index)
+{
+    assert(index);
+    free(index->slots);
+    memset(index, 0, sizeof(struct fuse_allocator_index));
+}
+
+bool fuse_allocator_index_add(struct fuse_allocator_index *index, fuse_lock_t *lock, const void *ptr)
+{
+    assert(index);
+    assert(lock);
+    assert(ptr);
+    uintptr_t key = (uintptr_t)ptr;
+    assert(key != FUSE_ALLOCATOR_INDEX_DELETED);
+
+    // Grow the index when it would become more than half full. The lock is released
+    // while the slots are allocated and freed, so another thread may have changed the
+    // index in the meantime, and the size is checked again
+    uintptr_t *spare = NULL;
+    size_t sparesize = 0;
+    while ((index->used + 1) * 2 > index->size)
+    {
+        size_t size = FUSE_ALLOCATOR_INDEX_MIN;
+        while (size < (index->count + 1) * 4)
+        {
+            size <<= 1;
+        }
+        uintptr_t *old = spare;
+        bool grown = false;
+        if (spare != NULL && sparesize >= size)
+        {
+            old = fuse_allocator_index_rehash(index, spare, sparesize);
+            grown = true;
+        }
+        spare = NULL;
+        fuse_lock_release(lock);
+        free(old);
+        if (!grown)
+        {
+            spare = malloc(size * sizeof(uintptr_t));
+            sparesize = size;
+        }
+        fuse_lock_acquire(lock);
+        if (!grown && spare == NULL)
+        {
+            return false;
+        }
+    }
+    // Insert into the first empty or deleted slot
+    size_t mask = index->size - 1;
+    size_t i = fuse_allocator_index_find(index, key);
+    while (index->slots[i] != FUSE_ALLOCATOR_INDEX_EMPTY && index->slots[i] != FUSE_ALLOCATOR_INDEX_DELETED)
+    {
+        assert(index->slots[i] != key);
+        i = (i + 1) & mask;
+    }
+    if (index->slots[i] == FUSE_ALLOCATOR_INDEX_EMPTY)
+    {
+        index->used++;
+    }
+    index->slots[i] = key;
+    index->count++;
+
+    // Free the slots which were allocated by this thread but not used
+    if (spare != NULL)
+    {
+        fuse_lock_release(lock);
+        free(spare);
+        fuse_lock_acquire(lock);
+    }
+
+    // Return success
+    return true;
+}
+
+void fuse_allocator_index_remove(struct fuse_allocator_index *index, const void *ptr)
+{
+    assert(index);
+    assert(ptr);
+    uintptr_t key = (uintptr_t)ptr;
+
+    size_t mask = index->size - 1;
+    size_t i = fuse_allocator_index_find(index, key);
+    while (index->size > 0 && index->slots[i] != FUSE_ALLOCATOR_INDEX_EMPTY)
+    {
+        if (index->slots[i] == key)
+        {
+            index->slots[i] = FUSE_ALLOCATOR_INDEX_DELETED;
+            index->count--;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    assert(false);
+}
+
+bool fuse_allocator_index_contains(struct fuse_allocator_index *index, const void *ptr)
+{
+    assert(index);
+    uintptr_t key = (uintptr_t)ptr;
+    if (index->size == 0 || key == FUSE_ALLOCATOR_INDEX_EMPTY || key == FUSE_ALLOCATOR_INDEX_DELETED)
+    {
+        return false;
+    }
+
+    size_t mask = index->size - 1;
+    size_t i = fuse_allocator_index_find(index, key);
+    while (index->slots[i] != FUSE_ALLOCATOR_INDEX_EMPTY)
+    {
+        if (index->slots[i] == key)
+        {
+            return true;
+        }
+        i = (i + 1) & mask;
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PRIVATE METHODS
+
+/** @brief Return the first slot to probe for an address
+ */
+static inline size_t fuse_allocator_index_find(struct fuse_allocator_index *index, uintptr_t key)
+{
+    assert(index);
+
+    // Addresses are aligned, so discard the low bits and multiply by a large odd number
+    return index->size == 0 ? 0 : (size_t)((key >> 3) * (uintptr_t)2654435761u) & (index->size - 1);
+}
+
+/** @brief Rehash the index into new slots, discarding deleted slots, and return the old
+ *         slots which are freed by the caller
+ */
+static uintptr_t *fuse_allocator_index_rehash(struct fuse_allocator_index *index, uintptr_t *slots, size_t size)
+{
+    assert(index);
+    assert(slots);
+    assert(size > index->count);
+
+    // Swap the slots
+    memset(slots, 0, size * sizeof(uintptr_t));
+    uintptr_t *old = index->slots;
+    size_t oldsize = index->size;
+    index->slots = slots;
+    index->size = size;
+    index->count = 0;
+    index->used = 0;
+
+    // Reinsert the addresses
+    for (size_t i = 0; i < oldsize; i++)
+    {
+        if (old[i] != FUSE_ALLOCATOR_INDEX_EMPTY && old[i] != FUSE_ALLOCATOR_INDEX_DELETED)
+        {
+            size_t j = fuse_allocator_index_find(index, old[i]);
+            while (slots[j] != FUSE_ALLOCATOR_INDEX_EMPTY)
+            {
+                j = (j + 1) & (size - 1);
+            }
+            slots[j] = old[i];
+            index->count++;
+            index->used++;
+        }
+    }
+
+    // Return the old slots
+    return old;
+}
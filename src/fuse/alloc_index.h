@@ -0,0 +1,50 @@
+/** @file alloc_index.h
+ *  @brief Private function prototypes and structure definitions for the allocator index
+ *
+ * The allocator index is a hash set of addresses, which is used by allocators to
+ * check in constant time whether an arbitrary pointer refers to memory which they
+ * own. It uses open addressing, and grows using the system malloc when it is half
+ * full. The index is not thread-safe, so callers need to hold a lock. The lock is
+ * released while the system malloc is called, since on the Pico the lock is a
+ * critical section.
+ */
+#ifndef FUSE_PRIVATE_ALLOC_INDEX_H
+#define FUSE_PRIVATE_ALLOC_INDEX_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "lock.h"
+
+/** @brief Represents a hash set of addresses
+ */
+struct fuse_allocator_index
+{
+    uintptr_t *slots; ///< The slots, which are empty, deleted or contain an address
+    size_t size;      ///< The number of slots, which is zero or a power of two
+    size_t count;     ///< The number of addresses in the index
+    size_t used;      ///< The number of slots which are not empty, including deleted slots
+};
+
+/** @brief Release the memory used by the index
+ */
+void fuse_allocator_index_destroy(struct fuse_allocator_index *index);
+
+/** @brief Add an address to the index
+ *
+ * @param index The index
+ * @param lock The lock held by the caller, which is released while the index grows
+ * @param ptr The address
+ * @returns False if the index could not be grown to add the address
+ */
+bool fuse_allocator_index_add(struct fuse_allocator_index *index, fuse_lock_t *lock, const void *ptr);
+
+/** @brief Remove an address from the index
+ */
+void fuse_allocator_index_remove(struct fuse_allocator_index *index, const void *ptr);
+
+/** @brief Return true if the index contains an address
+ */
+bool fuse_allocator_index_contains(struct fuse_allocator_index *index, const void *ptr);
+
+#endif
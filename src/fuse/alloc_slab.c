@@ -0,0 +1,560 @@
+// Declare aligned_alloc from the C11 library, even when the compiler is not in C11 mode
+#ifndef _ISOC11_SOURCE
+#define _ISOC11_SOURCE
+#endif
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fuse/fuse.h>
+#include "alloc.h"
+#include "alloc_builtin.h"
+#include "alloc_slab.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// FORWARD DECLARATIONS
+
+static void fuse_allocator_slab_destroy(struct fuse_allocator *ctx);
+static bool fuse_allocator_slab_refill(struct fuse_allocator_slab *slab, uint8_t c);
+static bool fuse_allocator_slab_load(struct fuse_allocator_slab *slab, struct fuse_allocator_slab_magazine *mag, uint8_t c);
+static void fuse_allocator_slab_unload(struct fuse_allocator_slab *slab, struct fuse_allocator_slab_magazine *mag, uint8_t c);
+static struct fuse_allocator_header *fuse_allocator_slab_steal(struct fuse_allocator_slab *slab, struct fuse_allocator_slab_magazine *mag, uint8_t c);
+
+///////////////////////////////////////////////////////////////////////////////
+// LIFECYCLE
+
+struct fuse_allocator *fuse_allocator_slab_new()
+{
+    // Allocate memory for the allocator
+    struct fuse_allocator_slab *slab = malloc(sizeof(struct fuse_allocator_slab));
+    if (slab == NULL)
+    {
+        return NULL;
+    }
+
+    // Zero all data structures
+    memset(slab, 0, sizeof(struct fuse_allocator_slab));
+
+    // Set the slab properties
+    slab->classes = FUSE_ALLOCATOR_SLAB_PAGE_CLASSES;
+    slab->large = true;
+    slab->refill = fuse_allocator_slab_refill;
+
+    // Set the allocator properties
+    struct fuse_allocator *allocator = &slab->allocator;
+    allocator->malloc = fuse_allocator_slab_malloc;
+    allocator->malloc_batch = fuse_allocator_slab_malloc_batch;
+    allocator->free = fuse_allocator_slab_free;
+    allocator->destroy = fuse_allocator_slab_destroy;
+    allocator->magic = fuse_allocator_builtin_magic;
+    allocator->size = fuse_allocator_builtin_size;
+    allocator->retain = fuse_allocator_builtin_retain;
+    allocator->release = fuse_allocator_builtin_release;
+    allocator->headptr = fuse_allocator_builtin_headptr;
+    allocator->tailptr = fuse_allocator_builtin_tailptr;
+    allocator->valid = fuse_allocator_slab_valid;
+    allocator->resize = fuse_allocator_slab_resize;
+    allocator->mmap_threshold = FUSE_ALLOCATOR_MMAP_THRESHOLD;
+    allocator->cur = sizeof(struct fuse_allocator_slab);
+    allocator->max = allocator->cur;
+    fuse_allocator_init(allocator);
+    fuse_allocator_slab_init(slab);
+
+    // Return the allocator
+    return allocator;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+inline uint8_t fuse_allocator_slab_class(struct fuse_allocator_slab *slab, size_t size)
+{
+    assert(slab);
+    assert(slab->classes <= FUSE_ALLOCATOR_SLAB_CLASSES);
+
+    uint8_t c = 0;
+    size_t csize = FUSE_ALLOCATOR_SLAB_MIN;
+    while (c < slab->classes && csize < size)
+    {
+        csize <<= 1;
+        c++;
+    }
+    return c;
+}
+
+inline bool fuse_allocator_slab_large(struct fuse_allocator_slab *slab, struct fuse_allocator_header *block)
+{
+    assert(slab);
+    assert(block);
+    return (block->flags & FUSE_ALLOCATOR_FLAG_PREFIX) || fuse_allocator_slab_class(slab, block->size) == slab->classes;
+}
+
+inline size_t fuse_allocator_slab_stride(uint8_t c)
+{
+    assert(c < FUSE_ALLOCATOR_SLAB_CLASSES);
+    return FUSE_ALLOCATOR_SLAB_ROUND(sizeof(struct fuse_allocator_header) + (FUSE_ALLOCATOR_SLAB_MIN << c));
+}
+
+void fuse_allocator_slab_init(struct fuse_allocator_slab *slab)
+{
+    assert(slab);
+    fuse_lock_init(&slab->depot);
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SLAB_MAGAZINES; i++)
+    {
+        fuse_lock_init(&slab->magazine[i].lock);
+    }
+}
+
+void fuse_allocator_slab_deinit(struct fuse_allocator_slab *slab)
+{
+    assert(slab);
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SLAB_MAGAZINES; i++)
+    {
+        fuse_lock_destroy(&slab->magazine[i].lock);
+    }
+    fuse_lock_destroy(&slab->depot);
+}
+
+bool fuse_allocator_slab_valid(struct fuse_allocator *ctx, void *ptr)
+{
+    assert(ctx);
+    struct fuse_allocator_slab *slab = (struct fuse_allocator_slab *)ctx;
+    uintptr_t block = (uintptr_t)ptr - sizeof(struct fuse_allocator_header);
+
+    // Check that the header is at the start of a memory block, using the bitmap for a
+    // fixed region, or the page which contains the header
+    bool valid = false;
+    fuse_lock_acquire(&slab->depot);
+    if (slab->bitmap != NULL)
+    {
+        if (block >= (uintptr_t)slab->base && block < (uintptr_t)slab->brk && block % FUSE_ALLOCATOR_SLAB_ALIGN == 0)
+        {
+            size_t bit = (block - (uintptr_t)slab->base) / FUSE_ALLOCATOR_SLAB_ALIGN;
+            valid = slab->bitmap[bit >> 3] & (1 << (bit & 7));
+        }
+    }
+    else
+    {
+        struct fuse_allocator_slab_page *page = (struct fuse_allocator_slab_page *)(block & ~(uintptr_t)(FUSE_ALLOCATOR_SLAB_PAGE - 1));
+        if (fuse_allocator_index_contains(&slab->page_index, page))
+        {
+            size_t stride = fuse_allocator_slab_stride(page->c);
+            uintptr_t first = (uintptr_t)page + FUSE_ALLOCATOR_SLAB_ROUND(sizeof(struct fuse_allocator_slab_page));
+            valid = block >= first && (block - first) % stride == 0 && block + stride <= (uintptr_t)page + FUSE_ALLOCATOR_SLAB_PAGE;
+        }
+        else
+        {
+            valid = fuse_allocator_index_contains(&slab->large_index, (void *)block);
+        }
+    }
+    fuse_lock_release(&slab->depot);
+
+    // Check the memory block has not been freed
+    return valid && FUSE_ALLOCATOR_VALID((struct fuse_allocator_header *)block);
+}
+
+void *fuse_allocator_slab_malloc(struct fuse_allocator *ctx, size_t size, size_t align, uint16_t magic, const char *file, int line)
+{
+    assert(ctx);
+    struct fuse_allocator_slab *slab = (struct fuse_allocator_slab *)ctx;
+
+    // Take a block from the magazine for the size class, or use the system malloc
+    // for large blocks and blocks which need more than the natural alignment
+    struct fuse_allocator_header *block;
+    uint8_t flags = 0;
+    uint8_t c = fuse_allocator_slab_class(slab, size);
+    if (c == slab->classes || align > FUSE_ALLOCATOR_SLAB_ALIGN)
+    {
+        block = slab->large ? fuse_allocator_builtin_sysmalloc(ctx, size, align, &flags) : NULL;
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        fuse_lock_acquire(&slab->depot);
+        bool success = fuse_allocator_index_add(&slab->large_index, &slab->depot, block);
+        fuse_lock_release(&slab->depot);
+        if (!success)
+        {
+            fuse_allocator_builtin_sysfree(block);
+            return NULL;
+        }
+    }
+    else
+    {
+        // When the depot is exhausted, free memory blocks may still be held in the
+        // magazines for other threads or cores, so take one from those instead
+        struct fuse_allocator_slab_magazine *mag = &slab->magazine[fuse_lock_shard() % FUSE_ALLOCATOR_SLAB_MAGAZINES];
+        fuse_lock_acquire(&mag->lock);
+        if (mag->free[c] == NULL && !fuse_allocator_slab_load(slab, mag, c))
+        {
+            fuse_lock_release(&mag->lock);
+            block = fuse_allocator_slab_steal(slab, mag, c);
+            if (block == NULL)
+            {
+                return NULL;
+            }
+        }
+        else
+        {
+            block = mag->free[c];
+            mag->free[c] = block->next;
+            mag->count[c]--;
+            fuse_lock_release(&mag->lock);
+        }
+    }
+
+    // Set the header, and return pointer to the memory block
+    return fuse_allocator_builtin_header(block, size, magic, flags, file, line);
+}
+
+bool fuse_allocator_slab_malloc_batch(struct fuse_allocator *ctx, size_t size, uint16_t magic, size_t n, void **ptrs, const char *file, int line)
+{
+    assert(ctx);
+    assert(ptrs || n == 0);
+    struct fuse_allocator_slab *slab = (struct fuse_allocator_slab *)ctx;
+
+    // Large blocks are allocated one at a time
+    uint8_t c = fuse_allocator_slab_class(slab, size);
+    if (c == slab->classes)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            ptrs[i] = fuse_allocator_slab_malloc(ctx, size, 0, magic, file, line);
+            if (ptrs[i] == NULL)
+            {
+                while (i > 0)
+                {
+                    fuse_allocator_slab_free(ctx, ptrs[--i]);
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Take the free memory blocks in the magazine, and then the rest from the depot with
+    // one acquisition of the depot lock, carving new memory blocks when it is empty
+    size_t k = 0;
+    struct fuse_allocator_slab_magazine *mag = &slab->magazine[fuse_lock_shard() % FUSE_ALLOCATOR_SLAB_MAGAZINES];
+    fuse_lock_acquire(&mag->lock);
+    while (k < n && mag->free[c] != NULL)
+    {
+        struct fuse_allocator_header *block = mag->free[c];
+        mag->free[c] = block->next;
+        mag->count[c]--;
+        ptrs[k++] = block;
+    }
+    fuse_lock_release(&mag->lock);
+    if (k < n)
+    {
+        fuse_lock_acquire(&slab->depot);
+        while (k < n)
+        {
+            // The refill may release the depot lock, so check the free list again after it
+            if (slab->free[c] == NULL && !slab->refill(slab, c))
+            {
+                break;
+            }
+            if (slab->free[c] != NULL)
+            {
+                struct fuse_allocator_header *block = slab->free[c];
+                slab->free[c] = block->next;
+                ptrs[k++] = block;
+            }
+        }
+        fuse_lock_release(&slab->depot);
+    }
+
+    // Take the rest from the magazines for other threads or cores, or else return the
+    // memory blocks to the depot
+    while (k < n)
+    {
+        struct fuse_allocator_header *block = fuse_allocator_slab_steal(slab, mag, c);
+        if (block == NULL)
+        {
+            fuse_lock_acquire(&slab->depot);
+            while (k > 0)
+            {
+                block = ptrs[--k];
+                block->next = slab->free[c];
+                slab->free[c] = block;
+            }
+            fuse_lock_release(&slab->depot);
+            return false;
+        }
+        ptrs[k++] = block;
+    }
+
+    // Set the headers
+    for (size_t i = 0; i < n; i++)
+    {
+        ptrs[i] = fuse_allocator_builtin_header(ptrs[i], size, magic, 0, file, line);
+    }
+
+    // Return success
+    return true;
+}
+
+bool fuse_allocator_slab_resize(struct fuse_allocator *ctx, void *ptr, size_t size)
+{
+    assert(ctx);
+    assert(ptr);
+    struct fuse_allocator_slab *slab = (struct fuse_allocator_slab *)ctx;
+
+    // Get the header
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+
+    // The size class is determined by the size, so the new size needs to be in the
+    // same size class. Large blocks can use the memory reserved by the system malloc
+    if (fuse_allocator_slab_large(slab, block))
+    {
+        if (size > fuse_allocator_builtin_capacity(block) || (!(block->flags & FUSE_ALLOCATOR_FLAG_PREFIX) && fuse_allocator_slab_class(slab, size) != slab->classes))
+        {
+            return false;
+        }
+    }
+    else if (fuse_allocator_slab_class(slab, size) != fuse_allocator_slab_class(slab, block->size))
+    {
+        return false;
+    }
+    block->size = size;
+    return true;
+}
+
+void fuse_allocator_slab_free(struct fuse_allocator *ctx, void *ptr)
+{
+    assert(ctx);
+    assert(ptr);
+    struct fuse_allocator_slab *slab = (struct fuse_allocator_slab *)ctx;
+
+    // Get the header
+    struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(ptr);
+    assert(FUSE_ALLOCATOR_VALID(block));
+
+    // Return the block to the magazine for the size class, and return half the
+    // magazine to the depot when it is full
+    uint8_t c = fuse_allocator_slab_class(slab, block->size);
+    if (fuse_allocator_slab_large(slab, block))
+    {
+        assert(slab->large);
+        fuse_lock_acquire(&slab->depot);
+        fuse_allocator_index_remove(&slab->large_index, block);
+        fuse_lock_release(&slab->depot);
+        fuse_allocator_builtin_sysfree(block);
+    }
+    else if (ctx->teardown)
+    {
+        // The pages or region are released wholesale when the allocator is
+        // destroyed, so only mark the block as freed
+        FUSE_ALLOCATOR_INVALIDATE(block);
+    }
+    else
+    {
+        struct fuse_allocator_slab_magazine *mag = &slab->magazine[fuse_lock_shard() % FUSE_ALLOCATOR_SLAB_MAGAZINES];
+        fuse_lock_acquire(&mag->lock);
+        FUSE_ALLOCATOR_INVALIDATE(block);
+        block->next = mag->free[c];
+        mag->free[c] = block;
+        if (++mag->count[c] > FUSE_ALLOCATOR_SLAB_ROUNDS)
+        {
+            fuse_allocator_slab_unload(slab, mag, c);
+        }
+        fuse_lock_release(&mag->lock);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PRIVATE METHODS
+
+static void fuse_allocator_slab_destroy(struct fuse_allocator *ctx)
+{
+    assert(ctx);
+    struct fuse_allocator_slab *slab = (struct fuse_allocator_slab *)ctx;
+
+    // Free any large blocks which are still allocated, either retained or with a
+    // zero reference count, in each shard
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SHARDS; i++)
+    {
+        struct fuse_allocator_header *block = ctx->shard[i].head;
+        while (block != NULL)
+        {
+            struct fuse_allocator_header *next = block->next;
+            if (fuse_allocator_slab_large(slab, block))
+            {
+                fuse_allocator_builtin_sysfree(block);
+            }
+            block = next;
+        }
+        block = ctx->shard[i].zhead;
+        while (block != NULL)
+        {
+            struct fuse_allocator_header *next = block->next;
+            if (fuse_allocator_slab_large(slab, block))
+            {
+                fuse_allocator_builtin_sysfree(block);
+            }
+            block = next;
+        }
+    }
+
+    // Free the pages, which releases all other blocks
+    struct fuse_allocator_slab_page *page = slab->pages;
+    while (page != NULL)
+    {
+        struct fuse_allocator_slab_page *next = page->next;
+        free(page);
+        page = next;
+    }
+
+    // Free the allocator
+    fuse_allocator_index_destroy(&slab->page_index);
+    fuse_allocator_index_destroy(&slab->large_index);
+    fuse_allocator_slab_deinit(slab);
+    fuse_allocator_deinit(ctx);
+    free(slab);
+}
+
+/** @brief Allocate a new page and add the blocks to the free list for a size class. Called
+ *         with the depot lock held, which is released while the page is allocated
+ */
+static bool fuse_allocator_slab_refill(struct fuse_allocator_slab *slab, uint8_t c)
+{
+    assert(slab);
+    assert(c < slab->classes);
+
+    // Allocate a new page, aligned so that the page for any pointer can be found. On the
+    // Pico the depot lock is a critical section, so the system malloc is not called
+    // while it is held
+    fuse_lock_release(&slab->depot);
+    struct fuse_allocator_slab_page *page = aligned_alloc(FUSE_ALLOCATOR_SLAB_PAGE, FUSE_ALLOCATOR_SLAB_PAGE);
+    fuse_lock_acquire(&slab->depot);
+    if (page == NULL)
+    {
+        return false;
+    }
+    if (!fuse_allocator_index_add(&slab->page_index, &slab->depot, page))
+    {
+        fuse_lock_release(&slab->depot);
+        free(page);
+        fuse_lock_acquire(&slab->depot);
+        return false;
+    }
+    page->next = slab->pages;
+    page->c = c;
+    slab->pages = page;
+
+    // Carve the page into blocks, and add them to the free list
+    size_t stride = fuse_allocator_slab_stride(c);
+    void *ptr = (void *)page + FUSE_ALLOCATOR_SLAB_ROUND(sizeof(struct fuse_allocator_slab_page));
+    void *end = (void *)page + FUSE_ALLOCATOR_SLAB_PAGE;
+    while (ptr + stride <= end)
+    {
+        struct fuse_allocator_header *block = ptr;
+        FUSE_ALLOCATOR_INVALIDATE(block);
+        block->next = slab->free[c];
+        slab->free[c] = block;
+        ptr += stride;
+    }
+
+    // Return success
+    return true;
+}
+
+/** @brief Move a batch of free memory blocks from the depot to a magazine, refilling the
+ *         depot when it is empty. Called with the magazine lock held.
+ */
+static bool fuse_allocator_slab_load(struct fuse_allocator_slab *slab, struct fuse_allocator_slab_magazine *mag, uint8_t c)
+{
+    assert(slab);
+    assert(mag);
+    assert(c < slab->classes);
+
+    // A fixed region cannot return memory to other size classes, so carve at most a
+    // page of new memory blocks for a size class at a time
+    size_t carve = FUSE_ALLOCATOR_SLAB_ROUNDS / 2;
+    if (slab->bitmap != NULL)
+    {
+        carve = FUSE_ALLOCATOR_SLAB_PAGE / fuse_allocator_slab_stride(c);
+        carve = carve == 0 ? 1 : carve;
+    }
+
+    fuse_lock_acquire(&slab->depot);
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SLAB_ROUNDS / 2;)
+    {
+        // The refill may release the depot lock, so check the free list again after it
+        if (slab->free[c] == NULL)
+        {
+            if (carve == 0 || !slab->refill(slab, c))
+            {
+                break;
+            }
+            carve--;
+            continue;
+        }
+        i++;
+        struct fuse_allocator_header *block = slab->free[c];
+        slab->free[c] = block->next;
+        block->next = mag->free[c];
+        mag->free[c] = block;
+        mag->count[c]++;
+    }
+    fuse_lock_release(&slab->depot);
+
+    // Return true if there is at least one free memory block
+    return mag->free[c] != NULL;
+}
+
+/** @brief Move a batch of free memory blocks from a magazine to the depot. Called with
+ *         the magazine lock held.
+ */
+static void fuse_allocator_slab_unload(struct fuse_allocator_slab *slab, struct fuse_allocator_slab_magazine *mag, uint8_t c)
+{
+    assert(slab);
+    assert(mag);
+    assert(c < slab->classes);
+
+    fuse_lock_acquire(&slab->depot);
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SLAB_ROUNDS / 2; i++)
+    {
+        struct fuse_allocator_header *block = mag->free[c];
+        assert(block);
+        mag->free[c] = block->next;
+        mag->count[c]--;
+        block->next = slab->free[c];
+        slab->free[c] = block;
+    }
+    fuse_lock_release(&slab->depot);
+}
+
+/** @brief Take a free memory block for a size class from the magazine for another thread
+ *         or core, when the depot is exhausted. Called without any lock held, and returns
+ *         NULL if no magazine has a free memory block for the size class.
+ */
+static struct fuse_allocator_header *fuse_allocator_slab_steal(struct fuse_allocator_slab *slab, struct fuse_allocator_slab_magazine *mag, uint8_t c)
+{
+    assert(slab);
+    assert(mag);
+    assert(c < slab->classes);
+
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SLAB_MAGAZINES; i++)
+    {
+        struct fuse_allocator_slab_magazine *other = &slab->magazine[i];
+        if (other == mag)
+        {
+            continue;
+        }
+        fuse_lock_acquire(&other->lock);
+        struct fuse_allocator_header *block = other->free[c];
+        if (block != NULL)
+        {
+            other->free[c] = block->next;
+            other->count[c]--;
+        }
+        fuse_lock_release(&other->lock);
+        if (block != NULL)
+        {
+            return block;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,142 @@
+/** @file alloc_slab.h
+ *  @brief Private function prototypes and structure definitions for the slab allocator
+ *
+ * The slab allocator carves memory blocks from pages, with a free list for each
+ * size class. Each memory block has a fuse_allocator_header immediately before it,
+ * so the builtin allocator methods are used to retrieve the magic number, size
+ * and reference count. The static allocator uses the same free lists, but carves
+ * memory blocks from a fixed region of memory instead of pages.
+ *
+ * Each thread (or core on the Pico) allocates and frees memory blocks through
+ * a magazine, which caches a small number of free memory blocks for each size
+ * class. Memory blocks move between a magazine and the free lists of the
+ * allocator (the depot) in batches, so the depot lock is only acquired once per
+ * batch.
+ *
+ * Pages are aligned to the page size, so that any pointer can be checked in
+ * constant time by looking up the page which contains it in an index of pages,
+ * and checking it is at the start of a memory block. Large memory blocks are kept
+ * in a separate index. The static allocator marks the start of each memory block
+ * it carves in a bitmap instead, with one bit for each FUSE_ALLOCATOR_SLAB_ALIGN
+ * bytes of the region.
+ */
+#ifndef FUSE_PRIVATE_ALLOC_SLAB_H
+#define FUSE_PRIVATE_ALLOC_SLAB_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "alloc.h"
+#include "alloc_index.h"
+
+// Define the size classes
+#define FUSE_ALLOCATOR_SLAB_CLASSES 11     ///< The maximum number of size classes (8 to 8192 bytes)
+#define FUSE_ALLOCATOR_SLAB_PAGE_CLASSES 7 ///< The number of size classes carved from pages (8 to 512 bytes)
+#define FUSE_ALLOCATOR_SLAB_MIN 8          ///< The size of the smallest size class, in bytes
+#define FUSE_ALLOCATOR_SLAB_PAGE 4096      ///< The size of a page, in bytes
+#define FUSE_ALLOCATOR_SLAB_ALIGN 8        ///< The alignment of memory blocks, in bytes
+
+// Define the magazines
+#if defined(TARGET_PICO)
+#define FUSE_ALLOCATOR_SLAB_MAGAZINES 2 ///< The number of magazines, one for each core
+#else
+#define FUSE_ALLOCATOR_SLAB_MAGAZINES 8 ///< The number of magazines, shared between threads
+#endif
+#define FUSE_ALLOCATOR_SLAB_ROUNDS 16 ///< The maximum number of free memory blocks for a size class in a magazine
+
+/** @brief Round a size up to the memory block alignment
+ */
+#define FUSE_ALLOCATOR_SLAB_ROUND(sz) \
+    (((sz) + FUSE_ALLOCATOR_SLAB_ALIGN - 1) & ~(size_t)(FUSE_ALLOCATOR_SLAB_ALIGN - 1))
+
+/** @brief Represents a page of memory blocks
+ */
+struct fuse_allocator_slab_page
+{
+    struct fuse_allocator_slab_page *next; ///< The next page, or NULL if this is the last page
+    uint8_t c;                             ///< The size class of the memory blocks in the page
+};
+
+/** @brief Represents a cache of free memory blocks for a thread or core
+ */
+struct fuse_allocator_slab_magazine
+{
+    fuse_lock_t lock;                                                ///< The lock for the magazine, which is rarely contended
+    uint8_t count[FUSE_ALLOCATOR_SLAB_CLASSES];                      ///< The number of free memory blocks for each size class
+    struct fuse_allocator_header *free[FUSE_ALLOCATOR_SLAB_CLASSES]; ///< The free memory blocks for each size class
+};
+
+/** @brief Represents a slab allocator
+ */
+struct fuse_allocator_slab
+{
+    struct fuse_allocator allocator;                                       ///< The allocator implementation, which needs to be the first member
+    uint8_t classes;                                                       ///< The number of size classes in use
+    bool large;                                                            ///< Use the system malloc for blocks larger than the largest size class
+    bool (*refill)(struct fuse_allocator_slab *slab, uint8_t c);           ///< Add free memory blocks for a size class, called with the depot lock held
+    struct fuse_allocator_slab_page *pages;                                ///< The pages which have been allocated
+    struct fuse_allocator_index page_index;                                ///< The pages which have been allocated
+    struct fuse_allocator_index large_index;                               ///< The large memory blocks which have been allocated
+    void *base;                                                            ///< The start of memory blocks in a fixed region
+    uint8_t *bitmap;                                                       ///< The start of each memory block in a fixed region
+    void *brk;                                                             ///< The start of unused memory in a fixed region
+    void *end;                                                             ///< The end of a fixed region
+    struct fuse_allocator_header *free[FUSE_ALLOCATOR_SLAB_CLASSES];       ///< The free memory blocks for each size class (the depot)
+    fuse_lock_t depot;                                                     ///< The lock for the depot, pages and fixed region
+    struct fuse_allocator_slab_magazine magazine[FUSE_ALLOCATOR_SLAB_MAGAZINES]; ///< The magazines for each thread or core
+};
+
+/** @brief Return the size class for a memory block size
+ *
+ * @param slab The slab allocator
+ * @param size The size of the memory block, in bytes
+ * @returns The size class, or the number of size classes in use if the size is larger than the largest size class
+ */
+uint8_t fuse_allocator_slab_class(struct fuse_allocator_slab *slab, size_t size);
+
+/** @brief Return true if a memory block was allocated with the system malloc or mmap
+ *         rather than from a size class
+ *
+ * @param slab The slab allocator
+ * @param block The memory block header
+ * @returns True if the memory block is a large or aligned memory block
+ */
+bool fuse_allocator_slab_large(struct fuse_allocator_slab *slab, struct fuse_allocator_header *block);
+
+/** @brief Return the size of a memory block and header for a size class
+ *
+ * @param c The size class
+ * @returns The number of bytes used by a memory block in the size class, including the header
+ */
+size_t fuse_allocator_slab_stride(uint8_t c);
+
+/** @brief Initialise the depot and magazine locks
+ */
+void fuse_allocator_slab_init(struct fuse_allocator_slab *slab);
+
+/** @brief Release the depot and magazine locks
+ */
+void fuse_allocator_slab_deinit(struct fuse_allocator_slab *slab);
+
+/** @brief Check that any pointer refers to an allocated memory block
+ */
+bool fuse_allocator_slab_valid(struct fuse_allocator *ctx, void *ptr);
+
+/** @brief Allocate a memory block from the magazine for a size class
+ */
+void *fuse_allocator_slab_malloc(struct fuse_allocator *ctx, size_t size, size_t align, uint16_t magic, const char *file, int line);
+
+/** @brief Allocate several memory blocks for a size class, taking them from the depot
+ *         with one acquisition of the depot lock
+ */
+bool fuse_allocator_slab_malloc_batch(struct fuse_allocator *ctx, size_t size, uint16_t magic, size_t n, void **ptrs, const char *file, int line);
+
+/** @brief Resize a memory block within its size class
+ */
+bool fuse_allocator_slab_resize(struct fuse_allocator *ctx, void *ptr, size_t size);
+
+/** @brief Return a memory block to the magazine for a size class
+ */
+void fuse_allocator_slab_free(struct fuse_allocator *ctx, void *ptr);
+
+#endif
@@ -0,0 +1,116 @@
+#include <stdbool.h>
+#include <string.h>
+#include <fuse/fuse.h>
+#include "alloc.h"
+#include "alloc_builtin.h"
+#include "alloc_slab.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// FORWARD DECLARATIONS
+
+static void fuse_allocator_static_destroy(struct fuse_allocator *ctx);
+static bool fuse_allocator_static_refill(struct fuse_allocator_slab *slab, uint8_t c);
+
+///////////////////////////////////////////////////////////////////////////////
+// LIFECYCLE
+
+struct fuse_allocator *fuse_allocator_static_new(void *buf, size_t sz)
+{
+    assert(buf);
+
+    // Align the start of the region, and place the allocator at the start
+    void *brk = (void *)FUSE_ALLOCATOR_SLAB_ROUND((uintptr_t)buf);
+    void *end = buf + sz;
+    if (brk + FUSE_ALLOCATOR_SLAB_ROUND(sizeof(struct fuse_allocator_slab)) >= end)
+    {
+        return NULL;
+    }
+    struct fuse_allocator_slab *slab = brk;
+    brk += FUSE_ALLOCATOR_SLAB_ROUND(sizeof(struct fuse_allocator_slab));
+
+    // Place the bitmap after the allocator, with one bit for each aligned unit of the
+    // remaining memory
+    size_t bitmap = FUSE_ALLOCATOR_SLAB_ROUND((end - brk) / (FUSE_ALLOCATOR_SLAB_ALIGN * 8 + 1) + 1);
+    if (brk + bitmap > end)
+    {
+        return NULL;
+    }
+
+    // Zero all data structures
+    memset(slab, 0, sizeof(struct fuse_allocator_slab));
+
+    // Set the slab properties
+    slab->classes = FUSE_ALLOCATOR_SLAB_CLASSES;
+    slab->large = false;
+    slab->refill = fuse_allocator_static_refill;
+    slab->bitmap = brk;
+    slab->base = brk + bitmap;
+    slab->brk = slab->base;
+    slab->end = end;
+    memset(slab->bitmap, 0, bitmap);
+
+    // Set the allocator properties
+    struct fuse_allocator *allocator = &slab->allocator;
+    allocator->malloc = fuse_allocator_slab_malloc;
+    allocator->malloc_batch = fuse_allocator_slab_malloc_batch;
+    allocator->free = fuse_allocator_slab_free;
+    allocator->destroy = fuse_allocator_static_destroy;
+    allocator->magic = fuse_allocator_builtin_magic;
+    allocator->size = fuse_allocator_builtin_size;
+    allocator->retain = fuse_allocator_builtin_retain;
+    allocator->release = fuse_allocator_builtin_release;
+    allocator->headptr = fuse_allocator_builtin_headptr;
+    allocator->tailptr = fuse_allocator_builtin_tailptr;
+    allocator->valid = fuse_allocator_slab_valid;
+    allocator->resize = fuse_allocator_slab_resize;
+    allocator->cur = slab->base - (void *)slab;
+    allocator->max = allocator->cur;
+    fuse_allocator_init(allocator);
+    fuse_allocator_slab_init(slab);
+
+    // Return the allocator
+    return allocator;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PRIVATE METHODS
+
+static void fuse_allocator_static_destroy(struct fuse_allocator *ctx)
+{
+    assert(ctx);
+
+    // The region is owned by the caller, so there is nothing to free. Clear the
+    // allocator so that any use after destroy is caught
+    fuse_allocator_slab_deinit((struct fuse_allocator_slab *)ctx);
+    fuse_allocator_deinit(ctx);
+    memset(ctx, 0, sizeof(struct fuse_allocator_slab));
+}
+
+/** @brief Carve a single memory block for a size class from the unused memory in the region
+ */
+static bool fuse_allocator_static_refill(struct fuse_allocator_slab *slab, uint8_t c)
+{
+    assert(slab);
+    assert(c < slab->classes);
+
+    // Check for space in the region
+    size_t stride = fuse_allocator_slab_stride(c);
+    if (slab->brk + stride > slab->end)
+    {
+        return false;
+    }
+
+    // Mark the start of the block in the bitmap
+    size_t bit = (slab->brk - slab->base) / FUSE_ALLOCATOR_SLAB_ALIGN;
+    slab->bitmap[bit >> 3] |= (1 << (bit & 7));
+
+    // Add the block to the free list
+    struct fuse_allocator_header *block = slab->brk;
+    FUSE_ALLOCATOR_INVALIDATE(block);
+    block->next = slab->free[c];
+    slab->free[c] = block;
+    slab->brk += stride;
+
+    // Return success
+    return true;
+}
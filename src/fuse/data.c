@@ -29,6 +29,75 @@ void fuse_register_value_data(fuse_t *self)
     fuse_register_value_type(self, FUSE_MAGIC_DATA, fuse_data_type);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+/** @brief Create a new autoreleased data value with aligned memory
+ */
+fuse_value_t *fuse_new_data_aligned_ex(fuse_t *self, size_t size, size_t align, const char *file, const int line)
+{
+    assert(self);
+    assert(align > 0 && (align & (align - 1)) == 0);
+
+    // Allocate memory for the value - retain count is zero
+    return fuse_alloc_aligned_ex(self, FUSE_MAGIC_DATA, (void *)size, align, file, line);
+}
+
+/** @brief Change the size of a data value
+ */
+fuse_value_t *fuse_data_resize_ex(fuse_t *self, fuse_value_t *data, size_t newsz, const char *file, const int line)
+{
+    assert(self);
+    assert(data);
+    assert(fuse_allocator_magic(self->allocator, data) == FUSE_MAGIC_DATA);
+
+    // Resize in place if the allocator reserved enough memory
+    size_t size = fuse_allocator_size(self->allocator, data);
+    if (fuse_allocator_resize(self->allocator, data, newsz))
+    {
+        if (newsz > size)
+        {
+            memset((uint8_t *)data + size, 0, newsz - size);
+        }
+        return data;
+    }
+
+    // Reserve memory up to the next power of two, or the exact size if that cannot
+    // be allocated
+    size_t capacity = fuse_allocator_capacity(newsz);
+    // Keep the alignment of data which was allocated with an alignment, up to the
+    // largest alignment used for vector code
+    size_t align = 0;
+    if (FUSE_ALLOCATOR_HEADER(data)->flags & FUSE_ALLOCATOR_FLAG_PREFIX)
+    {
+        align = (uintptr_t)data & -(uintptr_t)data;
+        align = align > FUSE_DATA_ALIGN_MAX ? FUSE_DATA_ALIGN_MAX : align;
+    }
+    fuse_value_t *copy = fuse_alloc_aligned_ex(self, FUSE_MAGIC_DATA, (void *)capacity, align, file, line);
+    if (copy != NULL)
+    {
+        // Set the size, which is within the capacity so does not move, and keep
+        // accounting for the capacity
+        fuse_allocator_reserve(self->allocator, copy, newsz);
+    }
+    else if (capacity != newsz)
+    {
+        copy = fuse_alloc_aligned_ex(self, FUSE_MAGIC_DATA, (void *)newsz, align, file, line);
+    }
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    // Copy the data and zero any new bytes
+    size_t n = size < newsz ? size : newsz;
+    memcpy(copy, data, n);
+    memset((uint8_t *)copy + n, 0, newsz - n);
+
+    // Return the new value
+    return copy;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // PRIVATE METHODS
 
@@ -4,6 +4,8 @@
 #ifndef FUSE_PRIVATE_DATA_H
 #define FUSE_PRIVATE_DATA_H
 
+#define FUSE_DATA_ALIGN_MAX 64 ///< The largest alignment which is kept when a data value is moved by a resize
+
 /** @brief Register type for data values
  */
 void fuse_register_value_data(fuse_t *self);
@@ -0,0 +1,71 @@
+#include <fuse/fuse.h>
+#include "deque.h"
+
+_Static_assert((FUSE_DEQUE_SIZE & (FUSE_DEQUE_SIZE - 1)) == 0, "FUSE_DEQUE_SIZE needs to be a power of two");
+
+///////////////////////////////////////////////////////////////////////////////
+// LIFECYCLE
+
+void fuse_deque_init(struct fuse_deque *deque)
+{
+    assert(deque);
+
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    for (size_t i = 0; i < FUSE_DEQUE_SIZE; i++)
+    {
+        atomic_init(&deque->slot[i], NULL);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+bool fuse_deque_push(struct fuse_deque *deque, void *ptr)
+{
+    assert(deque);
+    assert(ptr);
+
+    size_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    size_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top >= FUSE_DEQUE_SIZE)
+    {
+        return false;
+    }
+
+    // Fill the slot, then publish it to thieves
+    atomic_store_explicit(&deque->slot[bottom & (FUSE_DEQUE_SIZE - 1)], ptr, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+    return true;
+}
+
+void *fuse_deque_steal(struct fuse_deque *deque)
+{
+    assert(deque);
+
+    size_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    while (true)
+    {
+        size_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+        if (top >= bottom)
+        {
+            return NULL;
+        }
+
+        // Read the slot, then claim it unless another thread claims it first. The owner
+        // cannot reuse the slot until it is claimed
+        void *ptr = atomic_load_explicit(&deque->slot[top & (FUSE_DEQUE_SIZE - 1)], memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&deque->top, &top, top + 1, memory_order_acq_rel, memory_order_acquire))
+        {
+            return ptr;
+        }
+    }
+}
+
+size_t fuse_deque_count(struct fuse_deque *deque)
+{
+    assert(deque);
+    size_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    size_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    return bottom > top ? bottom - top : 0;
+}
@@ -0,0 +1,55 @@
+/** @file deque.h
+ *  @brief Private function prototypes and structure definitions for work-stealing deques
+ *
+ * A deque is a bounded lock-free queue of pointers for work stealing, with one
+ * owner and any number of thieves. The owner pushes pointers at the bottom, and
+ * the owner and thieves steal pointers from the top, oldest first, so pointers
+ * are taken in the order they were pushed. Pushing and stealing take constant
+ * time and never allocate memory.
+ */
+#ifndef FUSE_PRIVATE_DEQUE_H
+#define FUSE_PRIVATE_DEQUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Define the deque size, which needs to be a power of two
+#define FUSE_DEQUE_SIZE 64 ///< The number of slots in a deque
+
+/** @brief Represents a deque
+ */
+struct fuse_deque
+{
+    _Atomic size_t top;                    ///< The position of the next steal
+    _Atomic size_t bottom;                 ///< The position of the next push
+    _Atomic(void *) slot[FUSE_DEQUE_SIZE]; ///< The slots
+};
+
+/** @brief Initialise an empty deque
+ */
+void fuse_deque_init(struct fuse_deque *deque);
+
+/** @brief Push a pointer onto the bottom of the deque, only called by the owner
+ *
+ * @param deque The deque
+ * @param ptr The pointer, which cannot be NULL
+ * @returns False if the deque is full
+ */
+bool fuse_deque_push(struct fuse_deque *deque, void *ptr);
+
+/** @brief Steal the oldest pointer from the top of the deque, called by the owner or any thread
+ *
+ * @param deque The deque
+ * @returns The pointer, or NULL if the deque is empty
+ */
+void *fuse_deque_steal(struct fuse_deque *deque);
+
+/** @brief Return the number of pointers in the deque
+ *
+ * The count is a snapshot, which may be out of date if other threads are stealing
+ * at the same time.
+ */
+size_t fuse_deque_count(struct fuse_deque *deque);
+
+#endif
@@ -1,4 +1,5 @@
 #include <fuse/fuse.h>
+#include <string.h>
 #include "alloc.h"
 #include "event.h"
 #include "fuse.h"
@@ -7,14 +8,79 @@
 ///////////////////////////////////////////////////////////////////////////////
 // DECLARATIONS
 
-/** @brief Return array of callbacks for an event type and core
+/** @brief Return the registered callbacks for a core
  */
-static struct event_callbacks *fuse_get_callbacks(fuse_t *self, uint8_t type, uint8_t q);
+static struct event_registry *fuse_get_callbacks(fuse_t *self, uint8_t q);
+
+/** @brief Return the list of callbacks for an event type and source
+ */
+static struct event_handler **fuse_get_handlers(struct event_registry *registry, uint8_t type, fuse_value_t *source);
+
+/** @brief Count a dropped event and return NULL
+ */
+static fuse_event_t *fuse_drop_event(fuse_t *self, uint8_t type);
+
+/** @brief Retain an event and push it onto an event queue
+ */
+static bool fuse_push_event(fuse_t *self, struct fuse_ring *queue, fuse_event_t *evt);
+
+/** @brief Return the event queues which an event from a source is routed to
+ */
+static uint8_t fuse_route_event(fuse_t *self, fuse_value_t *source, uint8_t type);
+
+/** @brief Create an event, or update the pending event for a coalescing source
+ */
+static fuse_event_t *fuse_post_event_queues(fuse_t *self, uint8_t queues, fuse_value_t *source, uint8_t type, fuse_event_priority_t priority, void *user_data, size_t size, const char *file, const int line);
+
+/** @brief Create an event and place it on the event queues
+ */
+static fuse_event_t *fuse_queue_event(fuse_t *self, uint8_t queues, fuse_value_t *source, uint8_t type, fuse_event_priority_t priority, void *user_data, size_t size, bool coalesce, const char *file, const int line);
+
+/** @brief Update the pending event for a coalescing source, or create a new event
+ */
+static fuse_event_t *fuse_coalesce_event(fuse_t *self, uint8_t queues, fuse_value_t *source, uint8_t type, fuse_event_priority_t priority, void *user_data, size_t size, const char *file, const int line);
+
+/** @brief Set the user data of an event, or copy the payload into the event when the size is not zero
+ */
+static void fuse_set_event_data(fuse_event_t *evt, void *user_data, size_t size);
+
+/** @brief Retain an event
+ */
+static void fuse_retain_event(fuse_t *self, fuse_event_t *evt);
+
+/** @brief Initialise a pool of preallocated events
+ */
+static bool fuse_init_pool(fuse_t *self, fuse_value_t *value, const void *user_data);
+
+/** @brief Release the events in a pool
+ */
+static void fuse_destroy_pool(fuse_t *self, fuse_value_t *value);
+
+/** @brief Take an event from the pool of an event queue, with a reference count of one,
+ *         or return NULL if there is no queue or its pool is empty
+ */
+static fuse_event_t *fuse_pool_event(fuse_t *self, struct event_queue *queue);
+
+/** @brief Mark an event as taken from an event queue, so that it is no longer coalesced
+ */
+static void fuse_take_event(fuse_t *self, fuse_event_t *evt);
+
+/** @brief Pop up to max events from the highest priority class of an event queue
+ */
+static size_t fuse_pop_events(struct event_queue *queue, fuse_event_t **evt, size_t max);
 
 /** @brief Append a quoted string representation of an event
  */
 static size_t fuse_str_event(fuse_t *self, char *buf, size_t sz, size_t i, fuse_value_t *v, bool json);
 
+/** @brief Initialise an empty event queue
+ */
+static bool fuse_init_queue(fuse_t *self, fuse_value_t *value, const void *user_data);
+
+/** @brief Release any events remaining on an event queue
+ */
+static void fuse_destroy_queue(fuse_t *self, fuse_value_t *value);
+
 ///////////////////////////////////////////////////////////////////////////////
 // LIFECYCLE
 
@@ -32,11 +98,59 @@ void fuse_register_value_event(fuse_t *self)
     };
     fuse_register_value_type(self, FUSE_MAGIC_EVENT, fuse_event_type);
 
+    // Register event queue type
+    fuse_value_desc_t fuse_queue_type = {
+        .size = sizeof(struct event_queue),
+        .name = "QUEUE",
+        .init = fuse_init_queue,
+        .destroy = fuse_destroy_queue,
+    };
+    fuse_register_value_type(self, FUSE_MAGIC_QUEUE, fuse_queue_type);
+
+    // Register event callback type
+    fuse_value_desc_t fuse_handler_type = {
+        .size = sizeof(struct event_handler),
+        .name = "HANDLER",
+    };
+    fuse_register_value_type(self, FUSE_MAGIC_HANDLER, fuse_handler_type);
+
+    // Register event pool type
+    fuse_value_desc_t fuse_pool_type = {
+        .size = sizeof(struct event_pool),
+        .name = "EVENTPOOL",
+        .init = fuse_init_pool,
+        .destroy = fuse_destroy_pool,
+    };
+    fuse_register_value_type(self, FUSE_MAGIC_EVENTPOOL, fuse_pool_type);
+
+    self->callbacks[0] = (struct event_registry){0};
+    self->callbacks[1] = (struct event_registry){0};
+    fuse_lock_init(&self->callbacks[0].lock);
+    fuse_lock_init(&self->callbacks[1].lock);
     for (size_t i = 0; i < FUSE_EVENT_COUNT; i++)
     {
-        self->callbacks0[i] = (struct event_callbacks){0};
-        self->callbacks1[i] = (struct event_callbacks){0};
+        atomic_init(&self->event_drops[i], 0);
+        self->event_priority[i] = FUSE_EVENT_PRIORITY_NORMAL;
+        atomic_init(&self->event_route[i], FUSE_EVENT_ROUTE_ALL);
+    }
+    for (size_t i = 0; i < FUSE_EVENT_COALESCE_COUNT; i++)
+    {
+        self->coalesce[i] = (struct event_coalesce){0};
     }
+    atomic_init(&self->coalesce_types, 0);
+    fuse_lock_init(&self->coalesce_lock);
+    for (size_t i = 0; i < FUSE_EVENT_ROUTE_COUNT; i++)
+    {
+        self->route[i] = (struct event_route){0};
+    }
+    atomic_init(&self->route_types, 0);
+    fuse_lock_init(&self->route_lock);
+    self->event_policy = FUSE_EVENT_POLICY_ACCEPT;
+    self->event_low = 0;
+    self->batch[0] = (struct event_batch){0};
+    self->batch[1] = (struct event_batch){0};
+    self->dispatch_events = FUSE_DISPATCH_EVENTS;
+    self->dispatch_us = 0;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -45,150 +159,1113 @@ void fuse_register_value_event(fuse_t *self)
 /** @brief Place a new event on the event queues
  */
 fuse_event_t *fuse_new_event_ex(fuse_t *self, fuse_value_t *source, uint8_t type, void *user_data, const char *file, const int line)
+{
+    assert(self);
+    assert(type < FUSE_EVENT_COUNT);
+    return fuse_new_event_priority_ex(self, source, type, self->event_priority[type], user_data, file, line);
+}
+
+/** @brief Place a new event on the event queues with a priority
+ */
+fuse_event_t *fuse_new_event_priority_ex(fuse_t *self, fuse_value_t *source, uint8_t type, fuse_event_priority_t priority, void *user_data, const char *file, const int line)
 {
     assert(self);
     assert(source);
     assert(type < FUSE_EVENT_COUNT);
+    assert(priority < FUSE_EVENT_PRIORITY_COUNT);
+    return fuse_post_event_queues(self, fuse_route_event(self, source, type), source, type, priority, user_data, 0, file, line);
+}
 
-    // Create a new event
-    fuse_event_t *evt = (fuse_event_t *)fuse_new_value_ex(self, FUSE_MAGIC_EVENT, 0, file, line);
-    if (evt == NULL)
+/** @brief Place a new event on the event queues with a copy of a payload
+ */
+fuse_event_t *fuse_new_event_payload_ex(fuse_t *self, fuse_value_t *source, uint8_t type, const void *payload, size_t size, const char *file, const int line)
+{
+    assert(self);
+    assert(source);
+    assert(type < FUSE_EVENT_COUNT);
+    assert(payload);
+    assert(size > 0 && size <= FUSE_EVENT_PAYLOAD_SIZE);
+
+    return fuse_post_event_queues(self, fuse_route_event(self, source, type), source, type, self->event_priority[type], (void *)payload, size, file, line);
+}
+
+/** @brief Place a new event on one event queue
+ */
+fuse_event_t *fuse_post_event_ex(fuse_t *self, uint8_t q, fuse_value_t *source, uint8_t type, void *user_data, const char *file, const int line)
+{
+    assert(self);
+    assert(q < 2);
+    assert(source);
+    assert(type < FUSE_EVENT_COUNT);
+    return fuse_post_event_queues(self, (uint8_t)1 << q, source, type, self->event_priority[type], user_data, 0, file, line);
+}
+
+/** @brief Return the payload of an event
+ */
+const void *fuse_event_payload(fuse_t *self, fuse_event_t *evt, size_t *size)
+{
+    assert(self);
+    assert(evt);
+    assert(fuse_allocator_magic(self->allocator, evt) == FUSE_MAGIC_EVENT);
+
+    if (size != NULL)
     {
-        return NULL;
+        *size = evt->size;
     }
+    return evt->size ? evt->payload : NULL;
+}
 
-    // Set the event properties
-    evt->type = type;
-    evt->source = source;
-    evt->user_data = user_data;
+/** @brief Set the policy for creating events when there is memory pressure
+ */
+void fuse_set_event_policy(fuse_t *self, fuse_event_policy_t policy, uint32_t low)
+{
+    assert(self);
+    self->event_policy = policy;
+    self->event_low = low;
+}
+
+/** @brief Set the priority class for an event type
+ */
+void fuse_set_event_priority(fuse_t *self, uint8_t type, fuse_event_priority_t priority)
+{
+    assert(self);
+    assert(type < FUSE_EVENT_COUNT);
+    assert(priority < FUSE_EVENT_PRIORITY_COUNT);
+    self->event_priority[type] = priority;
+}
+
+/** @brief Set the dispatch budget for the run loop
+ */
+void fuse_set_dispatch(fuse_t *self, size_t events, uint32_t us)
+{
+    assert(self);
+    assert(events > 0 && events <= FUSE_EVENT_DISPATCH_MAX);
+    self->dispatch_events = events;
+    self->dispatch_us = us;
+}
+
+/** @brief Set whether events from a source are coalesced
+ */
+bool fuse_set_event_coalesce(fuse_t *self, fuse_value_t *source, uint8_t type, bool coalesce)
+{
+    assert(self);
+    assert(source);
+    assert(type < FUSE_EVENT_COUNT);
+
+    fuse_lock_acquire(&self->coalesce_lock);
 
-    // Place the event on the event queues
-    if (self->core0 != NULL)
+    // Find the source, or an unused entry
+    struct event_coalesce *entry = NULL;
+    struct event_coalesce *unused = NULL;
+    for (size_t i = 0; i < FUSE_EVENT_COALESCE_COUNT; i++)
     {
-        if (fuse_list_push(self, self->core0, (fuse_value_t *)evt) == NULL)
+        if (self->coalesce[i].source == source && self->coalesce[i].type == type)
         {
-            return NULL;
+            entry = &self->coalesce[i];
+        }
+        else if (self->coalesce[i].source == NULL && unused == NULL)
+        {
+            unused = &self->coalesce[i];
         }
     }
-    if (self->core1 != NULL)
+
+    // Add or remove the entry. Any pending event remains on the queue. The entry
+    // retains the source, so that the source is not freed and its address reused
+    // while it coalesces events
+    bool success = true;
+    fuse_value_t *removed = NULL;
+    if (coalesce && entry == NULL)
     {
-        if (fuse_list_push(self, self->core1, (fuse_value_t *)evt) == NULL)
+        if (unused != NULL)
         {
-            return NULL;
+            *unused = (struct event_coalesce){.source = fuse_retain(self, source), .type = type, .evt = NULL};
+        }
+        success = (unused != NULL);
+    }
+    else if (!coalesce && entry != NULL)
+    {
+        removed = entry->source;
+        *entry = (struct event_coalesce){0};
+    }
+
+    // Update the event types which have a coalescing source
+    uint32_t types = 0;
+    for (size_t i = 0; i < FUSE_EVENT_COALESCE_COUNT; i++)
+    {
+        if (self->coalesce[i].source != NULL)
+        {
+            types |= (uint32_t)1 << self->coalesce[i].type;
         }
     }
+    atomic_store(&self->coalesce_types, types);
 
-    // Return the event
-    return evt;
+    fuse_lock_release(&self->coalesce_lock);
+
+    // Release the source of a removed entry
+    if (removed != NULL)
+    {
+        fuse_release(self, removed);
+    }
+
+    // Return success
+    return success;
 }
 
-/** @brief Retrieve an event from the event queue
+/** @brief Remove all coalescing sources, releasing the sources
  */
-fuse_event_t *fuse_next_event(fuse_t *self, uint8_t q)
+void fuse_clear_event_coalesce(fuse_t *self)
 {
     assert(self);
-    assert(q < 2);
 
-    // Get the event queue
-    fuse_list_t *queue = (q == 0) ? self->core0 : self->core1;
-    if (queue == NULL)
+    fuse_lock_acquire(&self->coalesce_lock);
+    fuse_value_t *removed[FUSE_EVENT_COALESCE_COUNT];
+    size_t count = 0;
+    for (size_t i = 0; i < FUSE_EVENT_COALESCE_COUNT; i++)
     {
-        return NULL;
+        if (self->coalesce[i].source != NULL)
+        {
+            removed[count++] = self->coalesce[i].source;
+            self->coalesce[i] = (struct event_coalesce){0};
+        }
     }
+    atomic_store(&self->coalesce_types, 0);
+    fuse_lock_release(&self->coalesce_lock);
 
-    // Pop the event from the queue
-    return (fuse_event_t *)fuse_list_pop(self, queue);
+    // Release the sources
+    for (size_t i = 0; i < count; i++)
+    {
+        fuse_release(self, removed[i]);
+    }
 }
 
-/** @brief Register a callback for an event
+/** @brief Set the event queues which events are placed on
  */
-bool fuse_register_callback(fuse_t *self, uint8_t type, uint8_t q, fuse_callback_t callback)
+bool fuse_set_event_route(fuse_t *self, uint8_t type, fuse_value_t *source, uint8_t queues)
 {
     assert(self);
     assert(type < FUSE_EVENT_COUNT);
-    assert(q < 2);
-    assert(callback);
+    assert(queues == FUSE_EVENT_ROUTE_DEFAULT || (queues & ~FUSE_EVENT_ROUTE_ALL) == 0);
 
-    // Get the event callbacks
-    struct event_callbacks *callbacks = fuse_get_callbacks(self, type, q);
-    if (callbacks == NULL)
+    // Set the route for the event type, which is read without the lock
+    if (source == NULL)
     {
-        return false;
+        atomic_store(&self->event_route[type], (queues == FUSE_EVENT_ROUTE_DEFAULT) ? FUSE_EVENT_ROUTE_ALL : queues);
+        return true;
     }
 
-    // Find slot for callback and register it
-    for (size_t i = 0; i < FUSE_EVENT_CALLBACK_COUNT; i++)
+    fuse_lock_acquire(&self->route_lock);
+
+    // Find the source, or an unused entry
+    struct event_route *entry = NULL;
+    struct event_route *unused = NULL;
+    for (size_t i = 0; i < FUSE_EVENT_ROUTE_COUNT; i++)
     {
-        if (callbacks->callback[i] == NULL)
+        if (self->route[i].source == source && self->route[i].type == type)
+        {
+            entry = &self->route[i];
+        }
+        else if (self->route[i].source == NULL && unused == NULL)
         {
-            callbacks->callback[i] = callback;
-            return true;
+            unused = &self->route[i];
         }
     }
 
-    // Return error - no slot available
-    return false;
+    // Add, update or remove the entry. The entry retains the source, so that the
+    // source is not freed and its address reused while the route exists
+    bool success = true;
+    fuse_value_t *removed = NULL;
+    if (queues == FUSE_EVENT_ROUTE_DEFAULT)
+    {
+        if (entry != NULL)
+        {
+            removed = entry->source;
+            *entry = (struct event_route){0};
+        }
+    }
+    else if (entry != NULL)
+    {
+        entry->queues = queues;
+    }
+    else if (unused != NULL)
+    {
+        *unused = (struct event_route){.source = fuse_retain(self, source), .type = type, .queues = queues};
+    }
+    else
+    {
+        success = false;
+    }
+
+    // Update the event types which have a source with its own route
+    uint32_t types = 0;
+    for (size_t i = 0; i < FUSE_EVENT_ROUTE_COUNT; i++)
+    {
+        if (self->route[i].source != NULL)
+        {
+            types |= (uint32_t)1 << self->route[i].type;
+        }
+    }
+    atomic_store(&self->route_types, types);
+
+    fuse_lock_release(&self->route_lock);
+
+    // Release the source of a removed entry
+    if (removed != NULL)
+    {
+        fuse_release(self, removed);
+    }
+
+    // Return success
+    return success;
 }
 
-/** @brief Execute callbacks for an event
+/** @brief Remove the routes for all sources, releasing the sources
  */
-void fuse_exec_event(fuse_t *self, uint8_t q, fuse_event_t *evt)
+void fuse_clear_event_routes(fuse_t *self)
+{
+    assert(self);
+
+    fuse_lock_acquire(&self->route_lock);
+    fuse_value_t *removed[FUSE_EVENT_ROUTE_COUNT];
+    size_t count = 0;
+    for (size_t i = 0; i < FUSE_EVENT_ROUTE_COUNT; i++)
+    {
+        if (self->route[i].source != NULL)
+        {
+            removed[count++] = self->route[i].source;
+            self->route[i] = (struct event_route){0};
+        }
+    }
+    atomic_store(&self->route_types, 0);
+    fuse_lock_release(&self->route_lock);
+
+    // Release the sources
+    for (size_t i = 0; i < count; i++)
+    {
+        fuse_release(self, removed[i]);
+    }
+}
+
+/** @brief Return the number of times an event was placed on the event queues
+ */
+uint32_t fuse_event_count(fuse_t *self, fuse_event_t *evt)
 {
     assert(self);
-    assert(q < 2);
     assert(evt);
+    assert(fuse_allocator_magic(self->allocator, evt) == FUSE_MAGIC_EVENT);
+    return evt->count;
+}
 
-    // Get the event callbacks
-    struct event_callbacks *callbacks = fuse_get_callbacks(self, evt->type, q);
-    if (callbacks == NULL)
+/** @brief Return the number of dropped events for an event type
+ */
+size_t fuse_event_drops(fuse_t *self, uint8_t type)
+{
+    assert(self);
+    assert(type < FUSE_EVENT_COUNT);
+    return atomic_load(&self->event_drops[type]);
+}
+
+/** @brief Retrieve an event from the event queue
+ */
+fuse_event_t *fuse_next_event(fuse_t *self, uint8_t q)
+{
+    assert(self);
+    assert(q < 2);
+
+    // Get the event queue
+    // Release the event returned by the previous call
+    struct event_batch *batch = &self->batch[q];
+    if (batch->last != NULL)
     {
-        return;
+        fuse_release_event(self, batch->last);
+        batch->last = NULL;
+    }
+
+    // Take the event from the current batch, or pop it from the queue. It is released
+    // on the next call, so that an event from a pool is not reused while the caller
+    // executes it
+    fuse_event_t *evt = NULL;
+    if (batch->next < batch->count)
+    {
+        evt = batch->evt[batch->next++];
     }
+    else if (fuse_take_events(self, q, &evt, 1) == 0)
+    {
+        evt = NULL;
+    }
+    batch->last = evt;
+
+    // Return the event
+    return evt;
+}
+
+/** @brief Return the next event to execute for a queue
+ */
+fuse_event_t *fuse_next_event_batch(fuse_t *self, uint8_t q)
+{
+    assert(self);
+    assert(q < 2);
 
-    // Run each callback in turn, until there are no more
-    for (size_t i = 0; i < FUSE_EVENT_CALLBACK_COUNT; i++)
+    // Take a new batch of events from the queue when the current batch is empty
+    struct event_batch *batch = &self->batch[q];
+    if (batch->next == batch->count)
     {
-        fuse_callback_t callback = callbacks->callback[i];
-        if (callback)
+        batch->next = 0;
+        batch->count = fuse_take_events(self, q, batch->evt, self->dispatch_events);
+        if (batch->count == 0)
         {
-            callback(self, evt, evt->user_data);
+            return NULL;
         }
-        else
+    }
+
+    // Return the next event in the batch
+    return batch->evt[batch->next++];
+}
+
+/** @brief Unregister all callbacks for all cores
+ */
+void fuse_unregister_callbacks(fuse_t *self)
+{
+    assert(self);
+
+    for (uint8_t q = 0; q < 2; q++)
+    {
+        struct event_registry *registry = &self->callbacks[q];
+        fuse_lock_acquire(&registry->lock);
+        for (size_t i = 0; i < FUSE_EVENT_COUNT + FUSE_EVENT_HANDLER_BUCKETS; i++)
         {
-            break;
+            struct event_handler **list = (i < FUSE_EVENT_COUNT) ? &registry->any[i] : &registry->source[i - FUSE_EVENT_COUNT];
+            while (*list != NULL)
+            {
+                struct event_handler *handler = *list;
+                *list = handler->next;
+                fuse_release(self, (fuse_value_t *)handler);
+            }
         }
+        fuse_lock_release(&registry->lock);
     }
 }
 
-//////////////////////////////////////////////////////////////////////////////
-// PRIVATE METHODS
+/** @brief Take up to max events from an event queue
+ */
+size_t fuse_take_events(fuse_t *self, uint8_t q, fuse_event_t **evt, size_t max)
+{
+    assert(self);
+    assert(q < 2);
+    assert(evt);
+
+    // Get the event queue
+    struct event_queue *queue = (q == 0) ? self->core0 : self->core1;
+    if (queue == NULL)
+    {
+        return 0;
+    }
+
+    // Pop the events, which are no longer pending for coalescing
+    size_t count = fuse_pop_events(queue, evt, max);
+    for (size_t i = 0; i < count; i++)
+    {
+        fuse_take_event(self, evt[i]);
+    }
+    return count;
+}
+
+/** @brief Register a callback for an event
+ */
+bool fuse_register_callback(fuse_t *self, uint8_t type, uint8_t q, fuse_callback_t callback)
+{
+    return fuse_register_source_callback(self, type, q, NULL, callback, NULL);
+}
 
-/** @brief Return callbacks for an event type and core
+/** @brief Register a callback for events from one source
  */
-static struct event_callbacks *fuse_get_callbacks(fuse_t *self, uint8_t type, uint8_t q)
+bool fuse_register_source_callback(fuse_t *self, uint8_t type, uint8_t q, fuse_value_t *source, fuse_callback_t callback, void *user_data)
 {
     assert(self);
     assert(type < FUSE_EVENT_COUNT);
     assert(q < 2);
+    assert(callback);
 
     // Get the event callbacks
-    switch (q)
+    struct event_registry *registry = fuse_get_callbacks(self, q);
+    if (registry == NULL)
     {
-    case 0:
-        if (self->core0 == NULL)
-        {
-            return NULL;
-        }
-        return &self->callbacks0[type];
-    case 1:
-        if (self->core1 == NULL)
-        {
-            return NULL;
-        }
-        return &self->callbacks1[type];
-    default:
-        return NULL;
+        return false;
+    }
+
+    // Create the callback, which is retained until it is unregistered
+    struct event_handler *handler = (struct event_handler *)fuse_alloc_retained_ex(self, FUSE_MAGIC_HANDLER, 0, __FILE__, __LINE__);
+    if (handler == NULL)
+    {
+        return false;
     }
+    handler->next = NULL;
+    handler->type = type;
+    handler->source = source;
+    handler->callback = callback;
+    handler->user_data = user_data;
+    handler->threadsafe = false;
+
+    // Append the callback to the list, so that callbacks are called in the order
+    // they were registered
+    fuse_lock_acquire(&registry->lock);
+    struct event_handler **list = fuse_get_handlers(registry, type, source);
+    while (*list != NULL)
+    {
+        list = &(*list)->next;
+    }
+    *list = handler;
+    fuse_lock_release(&registry->lock);
+
+    // Return success
+    return true;
+}
+
+/** @brief Unregister a callback
+ */
+bool fuse_unregister_callback(fuse_t *self, uint8_t type, uint8_t q, fuse_value_t *source, fuse_callback_t callback)
+{
+    assert(self);
+    assert(type < FUSE_EVENT_COUNT);
+    assert(q < 2);
+    assert(callback);
+
+    // Get the event callbacks
+    struct event_registry *registry = fuse_get_callbacks(self, q);
+    if (registry == NULL)
+    {
+        return false;
+    }
+
+    // Find the callback, and unlink and release it. The callback is not freed until
+    // the next drain, so it can be unregistered while the event is executing
+    struct event_handler *found = NULL;
+    fuse_lock_acquire(&registry->lock);
+    struct event_handler **list = fuse_get_handlers(registry, type, source);
+    for (; *list != NULL; list = &(*list)->next)
+    {
+        struct event_handler *handler = *list;
+        if (handler->type == type && handler->source == source && handler->callback == callback)
+        {
+            *list = handler->next;
+            found = handler;
+            break;
+        }
+    }
+    fuse_lock_release(&registry->lock);
+
+    // Return error if not registered
+    if (found == NULL)
+    {
+        return false;
+    }
+    fuse_release(self, (fuse_value_t *)found);
+    return true;
+}
+
+/** @brief Set whether a callback can be called on any worker thread
+ */
+bool fuse_set_callback_threadsafe(fuse_t *self, uint8_t type, uint8_t q, fuse_value_t *source, fuse_callback_t callback, bool threadsafe)
+{
+    assert(self);
+    assert(type < FUSE_EVENT_COUNT);
+    assert(q < 2);
+    assert(callback);
+
+    // Get the event callbacks
+    struct event_registry *registry = fuse_get_callbacks(self, q);
+    if (registry == NULL)
+    {
+        return false;
+    }
+
+    // Find the callback and set the flag
+    bool found = false;
+    fuse_lock_acquire(&registry->lock);
+    for (struct event_handler *handler = *fuse_get_handlers(registry, type, source); handler != NULL; handler = handler->next)
+    {
+        if (handler->type == type && handler->source == source && handler->callback == callback)
+        {
+            handler->threadsafe = threadsafe;
+            found = true;
+            break;
+        }
+    }
+    fuse_lock_release(&registry->lock);
+
+    // Return false if not registered
+    return found;
+}
+
+/** @brief Return true if all the callbacks for an event can be called on any worker thread
+ */
+bool fuse_event_threadsafe(fuse_t *self, uint8_t q, fuse_event_t *evt)
+{
+    assert(self);
+    assert(q < 2);
+    assert(evt);
+
+    // Get the event callbacks
+    struct event_registry *registry = fuse_get_callbacks(self, q);
+    if (registry == NULL)
+    {
+        return true;
+    }
+
+    // Check the callbacks for the source of the event, then the callbacks for any source
+    bool threadsafe = true;
+    fuse_lock_acquire(&registry->lock);
+    struct event_handler *handler = evt->source ? *fuse_get_handlers(registry, evt->type, evt->source) : NULL;
+    for (int pass = 0; pass < 2 && threadsafe; pass++)
+    {
+        for (; handler != NULL; handler = handler->next)
+        {
+            if (handler->type == evt->type && handler->source == (pass == 0 ? evt->source : NULL) && !handler->threadsafe)
+            {
+                threadsafe = false;
+                break;
+            }
+        }
+        handler = registry->any[evt->type];
+    }
+    fuse_lock_release(&registry->lock);
+    return threadsafe;
+}
+
+/** @brief Execute callbacks for an event
+ */
+void fuse_exec_event(fuse_t *self, uint8_t q, fuse_event_t *evt)
+{
+    assert(self);
+    assert(q < 2);
+    assert(evt);
+
+    // Get the event callbacks
+    struct event_registry *registry = fuse_get_callbacks(self, q);
+    if (registry == NULL)
+    {
+        return;
+    }
+
+    // Run the callbacks for the source of the event, then the callbacks for any source.
+    // The lock is released while each callback runs. An unregistered callback is not
+    // freed until the next drain, so the next callback can be taken before it runs
+    struct event_context *ctx = (struct event_context *)evt;
+    fuse_lock_acquire(&registry->lock);
+    struct event_handler *handler = ctx->source ? *fuse_get_handlers(registry, ctx->type, ctx->source) : NULL;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        while (handler != NULL)
+        {
+            struct event_handler *next = handler->next;
+            if (handler->type == ctx->type && handler->source == (pass == 0 ? ctx->source : NULL))
+            {
+                fuse_callback_t callback = handler->callback;
+                void *user_data = handler->user_data ? handler->user_data : ctx->user_data;
+                fuse_lock_release(&registry->lock);
+                callback(self, evt, user_data);
+                fuse_lock_acquire(&registry->lock);
+            }
+            handler = next;
+        }
+        handler = registry->any[ctx->type];
+    }
+    fuse_lock_release(&registry->lock);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// PRIVATE METHODS
+
+/** @brief Count a dropped event and return NULL
+ */
+static fuse_event_t *fuse_drop_event(fuse_t *self, uint8_t type)
+{
+    assert(self);
+    assert(type < FUSE_EVENT_COUNT);
+    atomic_fetch_add(&self->event_drops[type], 1);
+    return NULL;
+}
+
+/** @brief Initialise an empty event queue
+ */
+static bool fuse_init_queue(fuse_t *self, fuse_value_t *value, const void *user_data)
+{
+    assert(self);
+    assert(value);
+    struct event_queue *queue = (struct event_queue *)value;
+    for (size_t p = 0; p < FUSE_EVENT_PRIORITY_COUNT; p++)
+    {
+        fuse_ring_init(&queue->ring[p]);
+        queue->served[p] = 0;
+    }
+
+    // Create the pool of events for the queue. Without a pool, each event is allocated
+    queue->pool = (struct event_pool *)fuse_alloc_retained_ex(self, FUSE_MAGIC_EVENTPOOL, NULL, __FILE__, __LINE__);
+    return true;
+}
+
+/** @brief Release any events remaining on an event queue
+ */
+static void fuse_destroy_queue(fuse_t *self, fuse_value_t *value)
+{
+    assert(self);
+    assert(value);
+
+    struct event_queue *queue = (struct event_queue *)value;
+    for (size_t p = 0; p < FUSE_EVENT_PRIORITY_COUNT; p++)
+    {
+        fuse_event_t *evt;
+        while ((evt = fuse_ring_pop(&queue->ring[p])) != NULL)
+        {
+            fuse_release_event(self, evt);
+        }
+    }
+
+    // Release the pool of events
+    if (queue->pool != NULL)
+    {
+        fuse_release(self, (fuse_value_t *)queue->pool);
+    }
+}
+
+/** @brief Retain an event and push it onto an event queue
+ */
+static bool fuse_push_event(fuse_t *self, struct fuse_ring *queue, fuse_event_t *evt)
+{
+    assert(self);
+    assert(queue);
+    assert(evt);
+
+    // The event is already retained by the caller, so retaining it again does not
+    // move it between allocator lists
+    fuse_retain_event(self, evt);
+    if (fuse_ring_push(queue, evt))
+    {
+        return true;
+    }
+
+    // The queue is full
+    fuse_release_event(self, evt);
+    return false;
+}
+
+/** @brief Set the user data of an event, or copy the payload into the event when the size is not zero
+ */
+static void fuse_set_event_data(fuse_event_t *evt, void *user_data, size_t size)
+{
+    assert(evt);
+    assert(size <= FUSE_EVENT_PAYLOAD_SIZE);
+
+    evt->size = size;
+    if (size > 0)
+    {
+        memcpy(evt->payload, user_data, size);
+        evt->user_data = evt->payload;
+    }
+    else
+    {
+        evt->user_data = user_data;
+    }
+}
+
+/** @brief Retain an event
+ */
+static void fuse_retain_event(fuse_t *self, fuse_event_t *evt)
+{
+    assert(self);
+    assert(evt);
+
+    if (evt->pool != NULL)
+    {
+        atomic_fetch_add(&evt->refs, 1);
+    }
+    else
+    {
+        fuse_retain(self, (fuse_value_t *)evt);
+    }
+}
+
+/** @brief Take an event from the pool of an event queue, with a reference count of one,
+ *         or return NULL if there is no queue or its pool is empty
+ */
+static fuse_event_t *fuse_pool_event(fuse_t *self, struct event_queue *queue)
+{
+    assert(self);
+    if (queue == NULL || queue->pool == NULL)
+    {
+        return NULL;
+    }
+    fuse_event_t *evt = fuse_ring_pop(&queue->pool->free);
+    if (evt == NULL)
+    {
+        return NULL;
+    }
+
+    // The pool is retained while the event is in use
+    fuse_retain(self, (fuse_value_t *)queue->pool);
+    atomic_store(&evt->refs, 1);
+    return evt;
+}
+
+/** @brief Release an event taken from an event queue
+ */
+void fuse_release_event(fuse_t *self, fuse_event_t *evt)
+{
+    assert(self);
+    assert(evt);
+
+    if (evt->pool == NULL)
+    {
+        fuse_release(self, (fuse_value_t *)evt);
+    }
+    else if (atomic_fetch_sub(&evt->refs, 1) == 1)
+    {
+        // The pool has a slot for each of its events, so this cannot fail. The pool
+        // was retained while the event was in use, so that it is not destroyed
+        // before all its events are returned
+        struct event_pool *pool = evt->pool;
+        bool success = fuse_ring_push(&pool->free, evt);
+        assert(success);
+        (void)success;
+        fuse_release(self, (fuse_value_t *)pool);
+    }
+}
+
+/** @brief Initialise a pool of preallocated events
+ */
+static bool fuse_init_pool(fuse_t *self, fuse_value_t *value, const void *user_data)
+{
+    assert(self);
+    assert(value);
+    struct event_pool *pool = (struct event_pool *)value;
+    fuse_ring_init(&pool->free);
+
+    // Allocate the events together, retained for the lifetime of the pool
+    fuse_event_t *evt[FUSE_EVENT_POOL_SIZE];
+    if (!fuse_alloc_batch_retained_ex(self, FUSE_MAGIC_EVENT, FUSE_EVENT_POOL_SIZE, (void **)evt, __FILE__, __LINE__))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < FUSE_EVENT_POOL_SIZE; i++)
+    {
+        evt[i]->pool = pool;
+        atomic_init(&evt[i]->refs, 0);
+        fuse_ring_push(&pool->free, evt[i]);
+    }
+    return true;
+}
+
+/** @brief Release the events in a pool
+ */
+static void fuse_destroy_pool(fuse_t *self, fuse_value_t *value)
+{
+    assert(self);
+    assert(value);
+
+    // Events in use retain the pool, so all the events have been returned to it
+    size_t count = 0;
+    fuse_event_t *evt;
+    while ((evt = fuse_ring_pop(&((struct event_pool *)value)->free)) != NULL)
+    {
+        fuse_release(self, (fuse_value_t *)evt);
+        count++;
+    }
+    assert(count == FUSE_EVENT_POOL_SIZE);
+    (void)count;
+}
+
+/** @brief Return the event queues which an event from a source is routed to
+ */
+static uint8_t fuse_route_event(fuse_t *self, fuse_value_t *source, uint8_t type)
+{
+    assert(self);
+    assert(type < FUSE_EVENT_COUNT);
+
+    // Only take the routing lock when a source of the type has its own route
+    uint8_t queues = atomic_load(&self->event_route[type]);
+    if (atomic_load(&self->route_types) & ((uint32_t)1 << type))
+    {
+        fuse_lock_acquire(&self->route_lock);
+        for (size_t i = 0; i < FUSE_EVENT_ROUTE_COUNT; i++)
+        {
+            if (self->route[i].source == source && self->route[i].type == type)
+            {
+                queues = self->route[i].queues;
+                break;
+            }
+        }
+        fuse_lock_release(&self->route_lock);
+    }
+
+    // Return the event queues
+    return queues;
+}
+
+/** @brief Create an event, or update the pending event for a coalescing source
+ */
+static fuse_event_t *fuse_post_event_queues(fuse_t *self, uint8_t queues, fuse_value_t *source, uint8_t type, fuse_event_priority_t priority, void *user_data, size_t size, const char *file, const int line)
+{
+    assert(self);
+    assert(source);
+    assert(type < FUSE_EVENT_COUNT);
+
+    // Only take the coalescing lock when a source coalesces events of the type
+    if (atomic_load(&self->coalesce_types) & ((uint32_t)1 << type))
+    {
+        return fuse_coalesce_event(self, queues, source, type, priority, user_data, size, file, line);
+    }
+    return fuse_queue_event(self, queues, source, type, priority, user_data, size, false, file, line);
+}
+
+/** @brief Create an event and place it on the event queues
+ *
+ * The event is only placed on the queues in the route which exist, so that an
+ * event is never retained by a queue which does not consume it.
+ */
+static fuse_event_t *fuse_queue_event(fuse_t *self, uint8_t queues, fuse_value_t *source, uint8_t type, fuse_event_priority_t priority, void *user_data, size_t size, bool coalesce, const char *file, const int line)
+{
+    assert(self);
+    assert(source);
+    assert(type < FUSE_EVENT_COUNT);
+    assert(priority < FUSE_EVENT_PRIORITY_COUNT);
+
+    // Apply the event policy when there is memory pressure
+    if (fuse_allocator_pressure(self->allocator))
+    {
+        switch (self->event_policy)
+        {
+        case FUSE_EVENT_POLICY_REJECT:
+            return fuse_drop_event(self, type);
+        case FUSE_EVENT_POLICY_SHED:
+            if (self->event_low & ((uint32_t)1 << type))
+            {
+                return fuse_drop_event(self, type);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Drop the event without allocating it when it is routed to no queue, or when
+    // the ring for the priority class is full on every queue in the route
+    struct event_queue *core0 = (queues & FUSE_EVENT_ROUTE_CORE0) ? self->core0 : NULL;
+    struct event_queue *core1 = (queues & FUSE_EVENT_ROUTE_CORE1) ? self->core1 : NULL;
+    bool full0 = core0 == NULL || fuse_ring_count(&core0->ring[priority]) >= FUSE_RING_SIZE;
+    bool full1 = core1 == NULL || fuse_ring_count(&core1->ring[priority]) >= FUSE_RING_SIZE;
+    if (full0 && full1)
+    {
+        return fuse_drop_event(self, type);
+    }
+
+    // Take an event from the pool of a queue in the route, or allocate a new event
+    // when the pools are empty. The event is retained until it has been placed on the
+    // event queues, so that it cannot be drained or reused by another thread
+    fuse_event_t *evt = fuse_pool_event(self, core0);
+    if (evt == NULL)
+    {
+        evt = fuse_pool_event(self, core1);
+    }
+    if (evt == NULL)
+    {
+        evt = (fuse_event_t *)fuse_alloc_retained_ex(self, FUSE_MAGIC_EVENT, 0, file, line);
+        if (evt == NULL)
+        {
+            return fuse_drop_event(self, type);
+        }
+        evt->pool = NULL;
+    }
+
+    // Set the event properties
+    evt->type = type;
+    evt->source = source;
+    evt->count = 1;
+    evt->coalesce = coalesce;
+    fuse_set_event_data(evt, user_data, size);
+
+    // Place the event on the event queues, which each retain the event
+    bool accepted0 = core0 != NULL && fuse_push_event(self, &core0->ring[priority], evt);
+    bool accepted1 = core1 != NULL && fuse_push_event(self, &core1->ring[priority], evt);
+
+    // Release the event, which is now retained by the event queues which accepted
+    // it, before waking the run loops. A run loop which executes the event and exits
+    // then cannot reach fuse_destroy while this thread still holds the event and its
+    // pool
+    fuse_release_event(self, evt);
+    if (accepted0)
+    {
+        fuse_wake_signal(&self->wake[0]);
+    }
+    if (accepted1)
+    {
+        fuse_wake_signal(&self->wake[1]);
+    }
+
+    // The event is only dropped when no queue accepted it
+    return (accepted0 || accepted1) ? evt : fuse_drop_event(self, type);
+}
+
+/** @brief Update the pending event for a coalescing source, or create a new event
+ */
+static fuse_event_t *fuse_coalesce_event(fuse_t *self, uint8_t queues, fuse_value_t *source, uint8_t type, fuse_event_priority_t priority, void *user_data, size_t size, const char *file, const int line)
+{
+    assert(self);
+    assert(source);
+    assert(type < FUSE_EVENT_COUNT);
+
+    // Find the source. The lock is held while the event is placed on the queues, so
+    // that the consumer cannot take the event before it is pending
+    fuse_lock_acquire(&self->coalesce_lock);
+    struct event_coalesce *entry = NULL;
+    for (size_t i = 0; i < FUSE_EVENT_COALESCE_COUNT && entry == NULL; i++)
+    {
+        if (self->coalesce[i].source == source && self->coalesce[i].type == type)
+        {
+            entry = &self->coalesce[i];
+        }
+    }
+
+    fuse_event_t *evt;
+    if (entry != NULL && entry->evt != NULL)
+    {
+        // Update the pending event in place
+        evt = entry->evt;
+        fuse_set_event_data(evt, user_data, size);
+        evt->count++;
+    }
+    else
+    {
+        // Create a new event, which is pending until it is taken from the queue
+        evt = fuse_queue_event(self, queues, source, type, priority, user_data, size, entry != NULL, file, line);
+        if (entry != NULL)
+        {
+            entry->evt = evt;
+        }
+    }
+    fuse_lock_release(&self->coalesce_lock);
+
+    // Return the event
+    return evt;
+}
+
+/** @brief Mark an event as taken from an event queue, so that it is no longer coalesced
+ */
+static void fuse_take_event(fuse_t *self, fuse_event_t *evt)
+{
+    assert(self);
+    assert(evt);
+
+    if (evt->coalesce == false)
+    {
+        return;
+    }
+
+    fuse_lock_acquire(&self->coalesce_lock);
+    for (size_t i = 0; i < FUSE_EVENT_COALESCE_COUNT; i++)
+    {
+        if (self->coalesce[i].evt == evt)
+        {
+            self->coalesce[i].evt = NULL;
+        }
+    }
+    fuse_lock_release(&self->coalesce_lock);
+}
+
+/** @brief Pop up to max events from the highest priority class of an event queue
+ *
+ * Events are taken from the highest priority class which is not empty. While a
+ * lower class is waiting, at most FUSE_EVENT_STARVATION events are served from a
+ * class before it yields one batch to the lower classes. Only the consumer of the
+ * queue calls this function, so the served counts do not need to be atomic.
+ */
+static size_t fuse_pop_events(struct event_queue *queue, fuse_event_t **evt, size_t max)
+{
+    assert(queue);
+    assert(evt);
+    assert(max > 0);
+
+    for (size_t p = 0; p < FUSE_EVENT_PRIORITY_COUNT; p++)
+    {
+        if (fuse_ring_count(&queue->ring[p]) == 0)
+        {
+            continue;
+        }
+
+        // Determine if a lower class is waiting
+        bool waiting = false;
+        for (size_t l = p + 1; l < FUSE_EVENT_PRIORITY_COUNT && !waiting; l++)
+        {
+            waiting = fuse_ring_count(&queue->ring[l]) > 0;
+        }
+        if (!waiting)
+        {
+            queue->served[p] = 0;
+            return fuse_ring_pop_batch(&queue->ring[p], (void **)evt, max);
+        }
+
+        // Yield to the lower classes once the starvation limit is reached
+        if (queue->served[p] >= FUSE_EVENT_STARVATION)
+        {
+            queue->served[p] = 0;
+            continue;
+        }
+
+        // Serve events up to the starvation limit
+        size_t limit = FUSE_EVENT_STARVATION - queue->served[p];
+        size_t n = fuse_ring_pop_batch(&queue->ring[p], (void **)evt, max < limit ? max : limit);
+        queue->served[p] += n;
+        return n;
+    }
+
+    // All classes are empty
+    return 0;
+}
+
+/** @brief Return the registered callbacks for a core
+ */
+static struct event_registry *fuse_get_callbacks(fuse_t *self, uint8_t q)
+{
+    assert(self);
+    assert(q < 2);
+
+    // Get the event callbacks
+    switch (q)
+    {
+    case 0:
+        if (self->core0 == NULL)
+        {
+            return NULL;
+        }
+        return &self->callbacks[0];
+    case 1:
+        if (self->core1 == NULL)
+        {
+            return NULL;
+        }
+        return &self->callbacks[1];
+    default:
+        return NULL;
+    }
+}
+
+/** @brief Return the list of callbacks for an event type and source
+ *
+ * Callbacks for any source are in a list for the event type. Callbacks for a
+ * source are in a hash bucket, which can also contain callbacks for other types
+ * and sources.
+ */
+static struct event_handler **fuse_get_handlers(struct event_registry *registry, uint8_t type, fuse_value_t *source)
+{
+    assert(registry);
+    assert(type < FUSE_EVENT_COUNT);
+
+    if (source == NULL)
+    {
+        return &registry->any[type];
+    }
+
+    // Values are aligned, so discard the low bits of the source before mixing in the type
+    uintptr_t hash = ((uintptr_t)source >> 3) * 31 + type;
+    return &registry->source[(hash ^ (hash >> 7)) & (FUSE_EVENT_HANDLER_BUCKETS - 1)];
 }
 
 /** @brief Append a quoted string representation of an event
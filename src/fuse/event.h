@@ -6,6 +6,18 @@
 
 #include <fuse/fuse.h>
 #include <stdint.h>
+#include "lock.h"
+#include "ring.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// DEFINITIONS
+
+#define FUSE_EVENT_HANDLER_BUCKETS 32 ///< The number of hash buckets for callbacks registered for a source, a power of two
+#if defined(TARGET_PICO)
+#define FUSE_EVENT_POOL_SIZE 32 ///< The number of events preallocated for each event queue
+#else
+#define FUSE_EVENT_POOL_SIZE 64 ///< The number of events preallocated for each event queue
+#endif
 
 /** @brief Event data
  */
@@ -14,17 +26,138 @@ struct event_context
     uint8_t type;
     fuse_value_t *source;
     void *user_data;
+    uint32_t count;          ///< The number of events coalesced into this event
+    bool coalesce;           ///< True if the event is pending for a coalescing source
+    struct event_pool *pool; ///< The pool the event is returned to, or NULL if the event was allocated on its own
+    _Atomic uint8_t refs;    ///< The number of references to an event from a pool
+    uint8_t size;            ///< The size of the payload, or zero if there is no payload
+    _Alignas(8) uint8_t payload[FUSE_EVENT_PAYLOAD_SIZE]; ///< The copy of the payload
+};
+
+/** @brief Events which are preallocated for an event queue
+ *
+ * The pool retains its events for the lifetime of the pool. An event taken from the
+ * pool is counted with its own reference count, and returned to the pool when the
+ * count reaches zero, so events from the pool are not allocated or freed. The pool
+ * itself is retained while each of its events is in use, and released when the
+ * event is returned.
+ */
+struct event_pool
+{
+    struct fuse_ring free; ///< The events which are not in use
+};
+
+/** @brief A source which coalesces events, with the event which is pending for it
+ */
+struct event_coalesce
+{
+    fuse_value_t *source; ///< The source, which is retained, or NULL if the entry is unused
+    uint8_t type;         ///< The event type
+    fuse_event_t *evt;    ///< The queued event which has not been taken from the queue, or NULL
 };
 
-/** @brief Array of event callbacks
+/** @brief A source with its own route to the event queues
  */
-struct event_callbacks
+struct event_route
 {
-    fuse_callback_t callback[FUSE_EVENT_CALLBACK_COUNT];
+    fuse_value_t *source; ///< The source, or NULL if the entry is unused
+    uint8_t type;         ///< The event type
+    uint8_t queues;       ///< The event queues, as a combination of FUSE_EVENT_ROUTE_CORE0 and FUSE_EVENT_ROUTE_CORE1
+};
+
+/** @brief A registered event callback
+ */
+struct event_handler
+{
+    struct event_handler *next; ///< The next callback in the list or hash bucket
+    uint8_t type;               ///< The event type
+    fuse_value_t *source;       ///< The source of the events, or NULL for any source
+    fuse_callback_t callback;   ///< The callback
+    void *user_data;            ///< The user data for the callback, or NULL for the user data of the event
+    bool threadsafe;            ///< True if the callback can be called on any worker thread
+};
+
+/** @brief Registered event callbacks for a core
+ *
+ * Callbacks for any source are kept in a list for each event type. Callbacks for
+ * a source are kept in a hash table keyed by the event type and source. The lists
+ * are changed and walked with the lock held, but callbacks are called without it,
+ * so that a callback can register and unregister callbacks.
+ */
+struct event_registry
+{
+    struct event_handler *any[FUSE_EVENT_COUNT];                  ///< Callbacks for any source, for each event type
+    struct event_handler *source[FUSE_EVENT_HANDLER_BUCKETS];     ///< Callbacks for a source, hashed by type and source
+    fuse_lock_t lock;                                             ///< The lock for the lists
+};
+
+/** @brief Event queue, with a ring for each priority class
+ */
+struct event_queue
+{
+    struct fuse_ring ring[FUSE_EVENT_PRIORITY_COUNT]; ///< The events for each priority class
+    struct event_pool *pool;                          ///< The preallocated events, or NULL
+    uint8_t served[FUSE_EVENT_PRIORITY_COUNT];        ///< The number of events served from each class while a lower class was waiting
+};
+
+/** @brief Events taken from an event queue in one batch, which have not been executed
+ */
+struct event_batch
+{
+    size_t next;                                    ///< The index of the next event to execute
+    size_t count;                                   ///< The number of events in the batch
+    fuse_event_t *evt[FUSE_EVENT_DISPATCH_MAX];     ///< The events, which are retained until executed
+    fuse_event_t *last;                             ///< The event returned by fuse_next_event, which is released on the next call
 };
 
 /** @brief Register value type for events
  */
 void fuse_register_value_event(fuse_t *self);
 
+/** @brief Release an event taken from an event queue
+ *
+ * An event from a pool is returned to the pool when the last reference is released.
+ */
+void fuse_release_event(fuse_t *self, fuse_event_t *evt);
+
+/** @brief Take up to max events from an event queue
+ *
+ * The events are no longer pending for coalescing. Only one thread can take events
+ * from a queue at a time.
+ *
+ * @param self The fuse instance
+ * @param q The queue (0 or 1)
+ * @param evt The array which is filled with the events, which are retained and need
+ *            to be released with fuse_release_event after they are executed
+ * @param max The maximum number of events
+ * @returns The number of events, or zero if there are no events
+ */
+size_t fuse_take_events(fuse_t *self, uint8_t q, fuse_event_t **evt, size_t max);
+
+/** @brief Return true if all the callbacks for an event can be called on any worker thread
+ */
+bool fuse_event_threadsafe(fuse_t *self, uint8_t q, fuse_event_t *evt);
+
+/** @brief Unregister all callbacks for all cores
+ */
+void fuse_unregister_callbacks(fuse_t *self);
+
+/** @brief Remove all coalescing sources, releasing the sources
+ */
+void fuse_clear_event_coalesce(fuse_t *self);
+
+/** @brief Remove the routes for all sources, releasing the sources
+ */
+void fuse_clear_event_routes(fuse_t *self);
+
+/** @brief Return the next event to execute for a queue, taking a new batch of events
+ *         from the queue when the current batch is empty
+ *
+ * @param self The fuse instance
+ * @param q The queue (0 or 1)
+ * @returns The event, which is retained and needs to be released after it is executed,
+ *          or NULL if there are no events
+ */
+fuse_event_t *fuse_next_event_batch(fuse_t *self, uint8_t q);
+
 #endif
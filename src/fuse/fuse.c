@@ -2,6 +2,8 @@
 #include <fuse/fuse.h>
 #if defined(TARGET_PICO)
 #include <pico/stdlib.h>
+#else
+#include <time.h>
 #endif
 #include "alloc.h"
 #include "alloc_builtin.h"
@@ -14,21 +16,31 @@
 #include "number.h"
 #include "null.h"
 #include "printf.h"
+#include "profile.h"
 #include "str.h"
 #include "timer.h"
+#include "value.h"
+#include "worker.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // DECLARATIONS
 
 static void fuse_runloop(fuse_t *self, uint8_t q);
+static void *fuse_alloc_internal(fuse_t *self, const uint16_t magic, const void *user_data, size_t align, bool retained, const char *file, const int line);
+static bool fuse_alloc_batch_internal(fuse_t *self, const uint16_t magic, size_t n, void **ptrs, bool retained, const char *file, const int line);
+static fuse_allocator_link_t fuse_alloc_link(fuse_t *self, bool retained);
 
 ///////////////////////////////////////////////////////////////////////////////
 // PUBLIC METHODS
 
 fuse_t *fuse_new()
 {
-    // Create an allocator
-    struct fuse_allocator *allocator = fuse_allocator_builtin_new();
+    return fuse_new_ex(fuse_allocator_builtin_new());
+}
+
+fuse_t *fuse_new_ex(fuse_allocator_t *allocator)
+{
+    // Check the allocator
     if (allocator == NULL)
     {
         return NULL;
@@ -44,7 +56,18 @@ fuse_t *fuse_new()
     else
     {
         fuse->allocator = allocator;
+        fuse->drainer = fuse_lock_thread();
         fuse->exit_code = 0;
+        fuse->workers = 1;
+        fuse->null = NULL;
+        for (size_t i = 0; i < 2; i++)
+        {
+            fuse->bool_[i] = NULL;
+        }
+        for (size_t i = 0; i < FUSE_IMMORTAL_U8; i++)
+        {
+            fuse->u8[i] = NULL;
+        }
     }
 
     // Retain the application so it isn't autoreleased
@@ -74,11 +97,24 @@ fuse_t *fuse_new()
     fuse_register_value_string(fuse);
     fuse_register_value_timer(fuse);
     fuse_register_value_list(fuse);
-
-    // Create the event queue for Core 0
-    fuse->core0 = (struct fuse_list *)fuse_retain(fuse, (fuse_value_t *)fuse_new_list(fuse));
-    if (fuse->core0 == NULL)
+    fuse_register_value_profile(fuse);
+
+    // Create the shared values, the wake-ups and the event queue for Core 0
+    bool immortal = fuse_value_immortal_init(fuse);
+    bool wake0 = fuse_wake_init(&fuse->wake[0]);
+    bool wake1 = fuse_wake_init(&fuse->wake[1]);
+    fuse->core0 = (struct event_queue *)fuse_retain(fuse, fuse_alloc_ex(fuse, FUSE_MAGIC_QUEUE, NULL, __FILE__, __LINE__));
+    if (immortal == false || wake0 == false || wake1 == false || fuse->core0 == NULL)
     {
+        fuse_release(fuse, (fuse_value_t *)fuse->core0);
+        fuse_wake_destroy(&fuse->wake[0]);
+        fuse_wake_destroy(&fuse->wake[1]);
+        fuse_lock_destroy(&fuse->coalesce_lock);
+        fuse_lock_destroy(&fuse->route_lock);
+        fuse_lock_destroy(&fuse->callbacks[0].lock);
+        fuse_lock_destroy(&fuse->callbacks[1].lock);
+        fuse_drain(fuse, 0);
+        fuse_value_immortal_destroy(fuse);
         fuse_allocator_free(allocator, fuse);
         fuse_allocator_destroy(allocator);
         return NULL;
@@ -95,45 +131,70 @@ int fuse_destroy(fuse_t *fuse)
 {
     assert(fuse);
 
-    // Release event queues
+    // Release events which were taken from the queues but not executed, and the
+    // event queues
+    while (fuse_next_event(fuse, 0) != NULL || fuse_next_event(fuse, 1) != NULL)
+    {
+        continue;
+    }
     fuse_release(fuse, (fuse_value_t *)fuse->core0);
     fuse_release(fuse, (fuse_value_t *)fuse->core1);
 
+    // Release the registered callbacks, and the sources which coalesce events or
+    // have their own route
+    fuse_unregister_callbacks(fuse);
+    fuse_clear_event_coalesce(fuse);
+    fuse_clear_event_routes(fuse);
+
     // Store the exit code
     int exit_code = fuse->exit_code;
     struct fuse_allocator *allocator = fuse->allocator;
 
-    // Repeatedly drain the allocator pool until no new memory blocks are freed
-    // It will call fuse_destroy_callback for each memory block that is freed,
-    // releasing resources
-    size_t drained = 0;
-    do
-    {
-        drained = fuse_drain(fuse, 0);
-    } while (drained > 0);
+    // Drain the allocator pool in teardown mode. It will call the destroy callback
+    // for each memory block that is freed, releasing resources, and any memory
+    // blocks released by the callbacks are drained in the same pass. Memory which
+    // the allocator releases wholesale when destroyed is not returned block by block
+    fuse_allocator_teardown(allocator);
+    fuse_drain(fuse, 0);
+
+    // Free the shared values
+    fuse_value_immortal_destroy(fuse);
 
     // Walk through any remaining memory blocks
 #ifdef DEBUG
-    struct fuse_allocator_header *hdr = allocator->head;
     size_t count = 0;
-    while (hdr != NULL)
+    for (size_t i = 0; i < FUSE_ALLOCATOR_SHARDS; i++)
     {
-        // Skip the application
-        if (hdr->magic == FUSE_MAGIC_APP)
+        struct fuse_allocator_header *hdr = allocator->shard[i].head;
+        while (hdr != NULL)
         {
+            // Skip the application
+            if (hdr->magic == FUSE_MAGIC_APP)
+            {
+                hdr = hdr->next;
+                continue;
+            }
+
+            // Print any memory leaks
+            fuse_debugf(fuse, "LEAK: %p %s (%d bytes)", FUSE_ALLOCATOR_PTR(hdr), fuse->desc[hdr->magic].name, hdr->size);
+            if (hdr->file != NULL)
+            {
+                fuse_debugf(fuse, " [allocated at %s:%d]", hdr->file, hdr->line);
+            }
+            fuse_debugf(fuse, "\n");
+            count++;
             hdr = hdr->next;
-            continue;
         }
+    }
 
-        // Print any memory leaks
-        fuse_debugf(fuse, "LEAK: %p %s (%d bytes)", hdr->ptr, fuse->desc[hdr->magic].name, hdr->size);
-        if (hdr->file != NULL)
-        {
-            fuse_debugf(fuse, " [allocated at %s:%d]", hdr->file, hdr->line);
-        }
-        fuse_debugf(fuse, "\n");
-        count++;
-        hdr = hdr->next;
+    // With FUSE_COMPACT, values which are members of a list are not in the list of
+    // retained blocks, so the walk cannot print them. Count them from the number of
+    // memory blocks still allocated, less the application
+    size_t total = atomic_load(&allocator->count) - 1;
+    if (total > count)
+    {
+        fuse_debugf(fuse, "LEAK: %lu values which are members of a list\n", (uint64_t)(total - count));
+        count = total;
     }
 
     // If the count is greater than zero, then there are memory leaks
@@ -152,6 +213,12 @@ int fuse_destroy(fuse_t *fuse)
 #endif
 
     // Free the application and allocator
+    fuse_wake_destroy(&fuse->wake[0]);
+    fuse_wake_destroy(&fuse->wake[1]);
+    fuse_lock_destroy(&fuse->coalesce_lock);
+    fuse_lock_destroy(&fuse->route_lock);
+    fuse_lock_destroy(&fuse->callbacks[0].lock);
+    fuse_lock_destroy(&fuse->callbacks[1].lock);
     fuse_allocator_free(allocator, fuse);
     fuse_allocator_destroy(allocator);
 
@@ -165,78 +232,47 @@ size_t fuse_drain(fuse_t *self, size_t cap)
 {
     assert(self);
 
+    // Free memory blocks with a zero reference count, which are unlinked from the
+    // list when freed. Any memory blocks released when destroying a value are
+    // appended to the list. Values can be released on any thread, but only one
+    // thread drains the list.
     size_t count = 0;
-    struct fuse_allocator_header *hdr = self->allocator->head;
-    while (hdr != NULL && (cap == 0 || count < cap))
+    while (cap == 0 || count < cap)
     {
-        struct fuse_allocator_header *next = hdr->next;
-        if (hdr->ref == 0)
+        void *ptr = fuse_allocator_zombie(self->allocator);
+        if (ptr == NULL)
         {
-            //fuse_debugf(self, "fuse_drain: %p %s (%d bytes)", hdr->ptr, self->desc[hdr->magic].name, hdr->size);
-            //if (hdr->file != NULL)
-            //{
-            //    fuse_debugf(self, " [allocated at %s:%d]", hdr->file, hdr->line);
-            //}
-            fuse_free(self, hdr->ptr);
-            count++;
+            break;
         }
-        hdr = next;
+        fuse_free(self, ptr);
+        count++;
     }
     return count;
 }
 
 void *fuse_alloc_ex(fuse_t *self, const uint16_t magic, const void *user_data, const char *file, const int line)
 {
-    assert(self);
-    assert(magic < FUSE_MAGIC_COUNT);
+    return fuse_alloc_internal(self, magic, user_data, 0, false, file, line);
+}
 
-    // Determine the size of the memory block
-    size_t size = self->desc[magic].size;
-    switch (magic)
-    {
-    case FUSE_MAGIC_DATA:
-        size = (size_t)user_data;
-        break;
-    default:
-        size = self->desc[magic].size;
-        break;
-    }
+void *fuse_alloc_retained_ex(fuse_t *self, const uint16_t magic, const void *user_data, const char *file, const int line)
+{
+    return fuse_alloc_internal(self, magic, user_data, 0, true, file, line);
+}
 
-    // Allocate the memory
-    void *ptr = fuse_allocator_malloc(self->allocator, size, magic, file, line);
-    if (ptr == NULL)
-    {
-#ifdef DEBUG
-        fuse_debugf(self, "fuse_alloc_ex: %s: Could not allocate %lu bytes", self->desc[magic].size);
-        if (file != NULL)
-        {
-            fuse_debugf(self, " [allocated at %s:%d]", file, line);
-        }
-        fuse_debugf(self, "\n");
-#endif
-        return NULL;
-    }
+void *fuse_alloc_aligned_ex(fuse_t *self, const uint16_t magic, const void *user_data, size_t align, const char *file, const int line)
+{
+    return fuse_alloc_internal(self, magic, user_data, align, false, file, line);
+}
 
-    // Initialise the value
-    if (self->desc[magic].init)
-    {
-        if (!self->desc[magic].init((struct fuse_application *)self, ptr, user_data))
-        {
-#ifdef DEBUG
-            fuse_debugf(self, "fuse_alloc_ex: %s: initialise failed", self->desc[magic].name);
-            if (file != NULL)
-            {
-                fuse_debugf(self, " [allocated at %s:%d]", file, line);
-            }
-            fuse_debugf(self, "\n");
-#endif
-            fuse_allocator_free(self->allocator, ptr);
-            return NULL;
-        }
-    }
+bool fuse_alloc_batch_ex(fuse_t *self, const uint16_t magic, size_t n, void **ptrs, const char *file, const int line)
+{
+    return fuse_alloc_batch_internal(self, magic, n, ptrs, false, file, line);
+}
 
-    // Return success
-    return ptr;
+bool fuse_alloc_batch_retained_ex(fuse_t *self, const uint16_t magic, size_t n, void **ptrs, const char *file, const int line)
+{
+    return fuse_alloc_batch_internal(self, magic, n, ptrs, true, file, line);
 }
 
 void fuse_free(fuse_t *self, void *ptr)
@@ -271,6 +307,9 @@ void fuse_run(fuse_t *self, int (*callback)(fuse_t *))
     sleep_ms(1500);
 #endif
 
+    // Values created on this thread are autoreleased, since it drains them
+    atomic_store(&self->drainer, fuse_lock_thread());
+
     // Call the callback, and exit if it returns a non-zero value
     int exit_code = callback(self);
     if (exit_code)
@@ -280,32 +319,216 @@ void fuse_run(fuse_t *self, int (*callback)(fuse_t *))
     }
 
     // Run the loop until exit_code is set
+#if defined(TARGET_LINUX)
+    if (self->workers > 1)
+    {
+        fuse_worker_run(self, self->workers);
+        return;
+    }
+#endif
     fuse_runloop(self, 0);
 }
 
+bool fuse_set_workers(fuse_t *self, size_t workers)
+{
+    assert(self);
+
+    // Worker threads are only supported on Linux
+#if defined(TARGET_LINUX)
+    if (workers < 1 || workers > FUSE_WORKER_MAX)
+    {
+        return false;
+    }
+#else
+    if (workers != 1)
+    {
+        return false;
+    }
+#endif
+    self->workers = workers;
+    return true;
+}
+
 inline void fuse_exit(fuse_t *self, int exit_code)
 {
     assert(self);
     self->exit_code = exit_code ? exit_code : FUSE_EXIT_SUCCESS;
+
+    // Wake the run loop on each core, so that it exits
+    fuse_wake_signal(&self->wake[0]);
+    fuse_wake_signal(&self->wake[1]);
 }
 
 
 /** @brief Return the memory statistics
  */
-void fuse_memstats(fuse_t *self, size_t *cur, size_t* max) {
+void fuse_memstats(fuse_t *self, size_t *cur, size_t *max) {
     assert(self);
 
     if (cur) {
-        *cur = self->allocator->cur;
+        *cur = atomic_load(&self->allocator->cur);
     }
     if (max) {
-        *max = self->allocator->max;
+        *max = atomic_load(&self->allocator->max);
     }
 }
 
+/** @brief Return the number of values currently allocated, for one type or all types
+ */
+size_t fuse_memcount(fuse_t *self, uint16_t magic, size_t *cur) {
+    assert(self);
+    assert(magic == FUSE_MAGIC_ANY || magic < FUSE_MAGIC_COUNT);
+
+    struct fuse_allocator *allocator = self->allocator;
+    if (magic == FUSE_MAGIC_ANY) {
+        if (cur) {
+            *cur = atomic_load(&allocator->cur);
+        }
+        return atomic_load(&allocator->count);
+    }
+
+    // The number of values of a type is the difference between the allocations and
+    // frees, which are counted separately
+    struct fuse_allocator_stats *stats = &allocator->stats[magic];
+    size_t frees = atomic_load(&stats->frees);
+    if (cur) {
+        *cur = atomic_load(&stats->cur);
+    }
+    return atomic_load(&stats->allocs) - frees;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // PRIVATE METHODS
 
+/** @brief Allocate memory for a value and initialise it
+ */
+static void *fuse_alloc_internal(fuse_t *self, const uint16_t magic, const void *user_data, size_t align, bool retained, const char *file, const int line)
+{
+    assert(self);
+    assert(magic < FUSE_MAGIC_COUNT);
+
+    // Determine the size of the memory block
+    size_t size = self->desc[magic].size;
+    switch (magic)
+    {
+    case FUSE_MAGIC_DATA:
+        size = (size_t)user_data;
+        break;
+    default:
+        size = self->desc[magic].size;
+        break;
+    }
+
+    // Allocate the memory. A value which is not retained is only autoreleased on the
+    // thread which drains, otherwise it is held until it is first released, so that
+    // a drain cannot free it before the caller retains it
+    fuse_allocator_link_t link = fuse_alloc_link(self, retained);
+    void *ptr = fuse_allocator_malloc_aligned_ex(self->allocator, size, align, magic, link, file, line);
+    if (ptr == NULL)
+    {
+#ifdef DEBUG
+        fuse_debugf(self, "fuse_alloc_ex: %s: Could not allocate %lu bytes", self->desc[magic].name, size);
+        if (file != NULL)
+        {
+            fuse_debugf(self, " [allocated at %s:%d]", file, line);
+        }
+        fuse_debugf(self, "\n");
+#endif
+        return NULL;
+    }
+
+    // Initialise the value
+    if (self->desc[magic].init)
+    {
+        if (!self->desc[magic].init((struct fuse_application *)self, ptr, user_data))
+        {
+#ifdef DEBUG
+            fuse_debugf(self, "fuse_alloc_ex: %s: initialise failed", self->desc[magic].name);
+            if (file != NULL)
+            {
+                fuse_debugf(self, " [allocated at %s:%d]", file, line);
+            }
+            fuse_debugf(self, "\n");
+#endif
+            fuse_allocator_free(self->allocator, ptr);
+            return NULL;
+        }
+    }
+
+    // Return success
+    return ptr;
+}
+
+/** @brief Allocate memory for several values of the same type and initialise them
+ */
+static bool fuse_alloc_batch_internal(fuse_t *self, const uint16_t magic, size_t n, void **ptrs, bool retained, const char *file, const int line)
+{
+    assert(self);
+    assert(magic < FUSE_MAGIC_COUNT);
+    assert(ptrs || n == 0);
+
+    // Allocate the memory blocks with one allocator lock
+    if (!fuse_allocator_malloc_batch(self->allocator, self->desc[magic].size, magic, fuse_alloc_link(self, retained), n, ptrs, file, line))
+    {
+#ifdef DEBUG
+        fuse_debugf(self, "fuse_alloc_batch_ex: %s: Could not allocate %lu values", self->desc[magic].name, n);
+        if (file != NULL)
+        {
+            fuse_debugf(self, " [allocated at %s:%d]", file, line);
+        }
+        fuse_debugf(self, "\n");
+#endif
+        return false;
+    }
+
+    // Initialise the values
+    if (self->desc[magic].init)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (self->desc[magic].init((struct fuse_application *)self, ptrs[i], NULL))
+            {
+                continue;
+            }
+#ifdef DEBUG
+            fuse_debugf(self, "fuse_alloc_batch_ex: %s: initialise failed", self->desc[magic].name);
+            if (file != NULL)
+            {
+                fuse_debugf(self, " [allocated at %s:%d]", file, line);
+            }
+            fuse_debugf(self, "\n");
+#endif
+            // Destroy the values which were initialised, and free all the memory blocks
+            for (size_t j = 0; j < n; j++)
+            {
+                if (j < i && self->desc[magic].destroy)
+                {
+                    self->desc[magic].destroy((struct fuse_application *)self, ptrs[j]);
+                }
+                fuse_allocator_free(self->allocator, ptrs[j]);
+                ptrs[j] = NULL;
+            }
+            return false;
+        }
+    }
+
+    // Return success
+    return true;
+}
+
+/** @brief Return how a new value is linked, which is autoreleased only on the thread
+ *         which drains released values
+ */
+static inline fuse_allocator_link_t fuse_alloc_link(fuse_t *self, bool retained)
+{
+    assert(self);
+    if (retained)
+    {
+        return FUSE_ALLOCATOR_RETAINED;
+    }
+    return fuse_lock_thread() == atomic_load(&self->drainer) ? FUSE_ALLOCATOR_AUTORELEASE : FUSE_ALLOCATOR_HELD;
+}
+
 static void fuse_runloop(fuse_t *self, uint8_t q)
 {
     assert(self);
@@ -315,34 +538,70 @@ static void fuse_runloop(fuse_t *self, uint8_t q)
     fuse_debugf(self, "fuse_runloop: core %u: start\n", q);
     while (!self->exit_code)
     {
-        // Pop event from the event queue for a specific core
-        fuse_event_t *evt = fuse_next_event(self, q);
-        if (evt)
+        // Execute a batch of events for a specific core, until the batch is empty or
+        // the dispatch budget is reached
+        size_t executed = 0;
+        size_t limit = self->dispatch_events;
+        uint64_t start = self->dispatch_us ? fuse_clock_us() : 0;
+
+        // Only core 0 drains released values, so when there is memory pressure core 1
+        // wakes core 0 and executes one event per batch until core 0 has caught up
+        if (q != 0 && fuse_allocator_pressure(self->allocator))
         {
-            // Call the event callbacks
-            fuse_exec_event(self, q, evt);
-            continue;
+            fuse_wake_signal(&self->wake[0]);
+            limit = 1;
         }
-
-        // Drain up to 10 items on core 0
-        size_t drained = 0;
-        if (q == 0 && self->drain)
+        while (!self->exit_code && executed < limit)
         {
-            // TODO: Only drain occasionally
-            drained = fuse_drain(self, 10);
-            if (drained > 0)
+            if (executed > 0 && self->dispatch_us && fuse_clock_us() - start >= self->dispatch_us)
             {
-                //fuse_debugf(self, "fuse_runloop: drained %u item(s)\n", drained);
+                break;
             }
-            else
+            fuse_event_t *evt = fuse_next_event_batch(self, q);
+            if (evt == NULL)
+            {
+                break;
+            }
+
+            // Drain released values early when there is memory pressure. The event is
+            // retained until it has been executed, so it cannot be drained
+            if (executed == 0 && q == 0 && fuse_allocator_pressure(self->allocator))
             {
-                self->drain = false;
+                fuse_drain(self, FUSE_DRAIN_PRESSURE);
             }
+
+            // Call the event callbacks, then release the event, which returns it to
+            // its pool if it was preallocated
+            fuse_exec_event(self, q, evt);
+            fuse_release_event(self, evt);
+            executed++;
         }
-        if (drained == 0)
+
+        // Drain the values released by the batch, or up to 10 values when idle, on core 0
+        size_t drained = 0;
+        if (q == 0)
+        {
+            drained = fuse_drain(self, executed > 10 ? executed : 10);
+        }
+
+        // Block until an event is queued, or the exit code is set
+        if (executed == 0 && drained == 0)
         {
-            sleep_ms(50);
+            fuse_wake_wait(&self->wake[q], FUSE_RUNLOOP_IDLE);
         }
     }
     fuse_debugf(self, "fuse_runloop: core %u: exited the run loop (exit_code=%d)\n", q, self->exit_code);
 }
+
+/** @brief Return a monotonic clock in microseconds
+ */
+uint64_t fuse_clock_us(void)
+{
+#if defined(TARGET_PICO)
+    return time_us_64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
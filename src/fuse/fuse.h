@@ -12,6 +12,17 @@
 #include "event.h"
 #include "fuse.h"
 #include "list.h"
+#include "lock.h"
+#include "ring.h"
+#include "wake.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// DEFINITIONS
+
+#define FUSE_IMMORTAL_U8 16 ///< The number of shared u8 values, starting from zero
+#define FUSE_DRAIN_PRESSURE 32 ///< The number of values drained before each event when there is memory pressure
+#define FUSE_RUNLOOP_IDLE 1000 ///< The longest time the run loop waits for an event, in milliseconds
+#define FUSE_DISPATCH_EVENTS 16 ///< The default maximum number of events in a batch
 
 ///////////////////////////////////////////////////////////////////////////////
 // TYPES
@@ -21,13 +32,65 @@
 struct fuse_application
 {
     struct fuse_allocator *allocator;              ///< The allocator for the application
+    _Atomic uintptr_t drainer;                     ///< The thread or core which runs the run loop and drains released values
     fuse_value_desc_t desc[FUSE_MAGIC_COUNT]; ///< Value descriptors
-    int exit_code;                                 ///< Exit code of the application
-    struct fuse_list* core0; ///< Core 0 event queue
-    struct event_callbacks callbacks0[FUSE_EVENT_COUNT]; ///< Core 0 callbacks
-    struct fuse_list* core1; ///< Core 1 event queue
-    struct event_callbacks callbacks1[FUSE_EVENT_COUNT]; ///< Core 1 callbacks
-    bool drain;                         ///< Drain the memory pool
+    _Atomic int exit_code;                         ///< Exit code of the application, which is read by each worker
+    struct event_queue* core0; ///< Core 0 event queue, or NULL if there is no queue
+    struct event_queue* core1; ///< Core 1 event queue, or NULL if there is no queue
+    struct event_registry callbacks[2]; ///< Registered callbacks for each core
+    struct fuse_wake wake[2]; ///< Wake-ups for the run loop on each core, signalled when an event is queued
+    struct event_batch batch[2]; ///< Events taken from the queue for each core, which have not been executed
+    size_t dispatch_events; ///< The maximum number of events in a batch
+    uint32_t dispatch_us; ///< The time budget for a batch in microseconds, or 0 for no time budget
+    size_t workers; ///< The number of workers for the run loop on core 0
+    fuse_event_policy_t event_policy; ///< Policy for creating events above the high watermark
+    uint32_t event_low; ///< Bitmask of low-priority event types
+    uint8_t event_priority[FUSE_EVENT_COUNT]; ///< The priority class for each event type
+    _Atomic size_t event_drops[FUSE_EVENT_COUNT]; ///< The number of dropped events for each event type
+    struct event_coalesce coalesce[FUSE_EVENT_COALESCE_COUNT]; ///< Sources which coalesce events
+    _Atomic uint32_t coalesce_types; ///< Bitmask of event types with a source which coalesces events
+    fuse_lock_t coalesce_lock; ///< Lock for the coalescing sources and their pending events
+    _Atomic uint8_t event_route[FUSE_EVENT_COUNT]; ///< The event queues for each event type
+    struct event_route route[FUSE_EVENT_ROUTE_COUNT]; ///< Sources with their own route
+    _Atomic uint32_t route_types; ///< Bitmask of event types with a source which has its own route
+    fuse_lock_t route_lock; ///< Lock for the sources with their own route
+    fuse_value_t *null; ///< The shared NULL value
+    fuse_value_t *bool_[2]; ///< The shared false and true values
+    fuse_value_t *u8[FUSE_IMMORTAL_U8]; ///< The shared small u8 values
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// METHODS
+
+/** @brief Allocate a value which is retained, with a reference count of one
+ *
+ * The value is never on the zero reference count list, so it cannot be freed by a
+ * drain on another thread before the caller has finished with it. The caller must
+ * release the value when it is no longer needed.
+ */
+void *fuse_alloc_retained_ex(fuse_t *self, const uint16_t magic, const void *user_data, const char *file, const int line);
+
+/** @brief Allocate a value with a zero reference count, aligned to a power of two
+ */
+void *fuse_alloc_aligned_ex(fuse_t *self, const uint16_t magic, const void *user_data, size_t align, const char *file, const int line);
+
+/** @brief Allocate several values of the same type, with a zero reference count
+ *
+ * The values are initialised with NULL user data. If any value cannot be allocated
+ * or initialised, then no values are allocated.
+ */
+bool fuse_alloc_batch_ex(fuse_t *self, const uint16_t magic, size_t n, void **ptrs, const char *file, const int line);
+
+/** @brief Allocate several values of the same type, which are retained with a
+ *         reference count of one
+ *
+ * The values are never on the zero reference count list. The caller must release
+ * each value when it is no longer needed.
+ */
+bool fuse_alloc_batch_retained_ex(fuse_t *self, const uint16_t magic, size_t n, void **ptrs, const char *file, const int line);
+
+/** @brief Return a monotonic clock in microseconds
+ */
+uint64_t fuse_clock_us(void);
+
 #endif
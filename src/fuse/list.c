@@ -2,6 +2,7 @@
 #include "fuse.h"
 #include "alloc.h"
 #include "list.h"
+#include "value.h"
 #include "printf.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -10,6 +11,15 @@
 static bool fuse_init_list(fuse_t *self, fuse_value_t *list, const void *user_data);
 static void fuse_destroy_list(fuse_t *self, fuse_value_t *list);
 static size_t fuse_str_list(fuse_t *self, char *buf, size_t sz, size_t i, fuse_value_t *list, bool json);
+static bool fuse_init_node(fuse_t *self, fuse_value_t *node, const void *user_data);
+static inline fuse_value_t *fuse_get_head(fuse_t *self, fuse_value_t *value);
+static inline void fuse_set_head(fuse_t *self, fuse_value_t *value, fuse_value_t *elem);
+static inline fuse_value_t *fuse_get_tail(fuse_t *self, fuse_value_t *value);
+static inline void fuse_set_tail(fuse_t *self, fuse_value_t *value, fuse_value_t *elem);
+static fuse_value_t *fuse_list_link(fuse_t *self, fuse_value_t *elem);
+static void fuse_list_unlink(fuse_t *self, fuse_value_t *link);
+static inline fuse_value_t *fuse_list_value(fuse_t *self, fuse_value_t *link);
+static fuse_value_t *fuse_list_find(fuse_t *self, struct fuse_list *list, fuse_value_t *elem);
 
 ////////////////////////////////////////////////////////////////////////////////
 // LIFECYCLE
@@ -29,6 +39,14 @@ void fuse_register_value_list(fuse_t *self)
     };
 
     fuse_register_value_type(self, FUSE_MAGIC_LIST, fuse_list_type);
+
+    fuse_value_desc_t fuse_node_type = {
+        .size = sizeof(struct fuse_list_node),
+        .name = "NODE",
+        .init = fuse_init_node,
+    };
+
+    fuse_register_value_type(self, FUSE_MAGIC_NODE, fuse_node_type);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -42,8 +60,25 @@ static bool fuse_init_list(fuse_t *self, fuse_value_t *list, const void *user_da
     assert(list);
     assert(self->allocator->magic(self->allocator, list) == FUSE_MAGIC_LIST);
 
-    // Set the count to 0
+    // Set the count to 0, and the list to empty
     ((fuse_list_t* )list)->count = 0;
+    ((fuse_list_t* )list)->head = NULL;
+    ((fuse_list_t* )list)->tail = NULL;
+    ((fuse_list_t* )list)->cursor = NULL;
+
+    // Return success
+    return true;
+}
+
+/* @brief Initialise a list node with an immediate or shared value
+ */
+static bool fuse_init_node(fuse_t *self, fuse_value_t *node, const void *user_data)
+{
+    assert(self);
+    assert(node);
+    assert(user_data);
+
+    ((struct fuse_list_node *)node)->value = (fuse_value_t *)user_data;
 
     // Return success
     return true;
@@ -57,60 +92,68 @@ static void fuse_destroy_list(fuse_t *self, fuse_value_t *list)
     assert(list);
     assert(self->allocator->magic(self->allocator, list) == FUSE_MAGIC_LIST);
 
-    fuse_value_t *elem = fuse_list_next(self, (fuse_list_t* )list, NULL);
-    while (elem != NULL)
+    fuse_value_t *link = ((struct fuse_list *)list)->head;
+    while (link != NULL)
     {
-        // Get the next element
-        fuse_value_t *tmp = fuse_list_next(self, (fuse_list_t* )list, elem);
+        // Get the next linked value
+        fuse_value_t *tmp = fuse_get_tail(self, link);
 
-        // Release the value
-        fuse_release(self, elem);
+        // Unlink and release the value, or the node
+        fuse_list_unlink(self, link);
 
-        // Move to the next element
-        elem = tmp;
+        // Move to the next linked value
+        link = tmp;
     }
 }
 
-static inline fuse_value_t *fuse_get_head(fuse_t *self, fuse_value_t *list)
+/* @brief Return the previous value in the list which a value is a member of
+ */
+static inline fuse_value_t *fuse_get_head(fuse_t *self, fuse_value_t *value)
 {
     assert(self);
-    assert(list);
+    assert(value);
 
     // Return the head
-    fuse_value_t **ptr = (fuse_value_t **)self->allocator->headptr(list);
+    fuse_value_t **ptr = (fuse_value_t **)self->allocator->headptr(value);
     assert(ptr);
     return *ptr;
 }
 
-static inline void fuse_set_head(fuse_t *self, fuse_value_t *list, fuse_value_t *elem)
+/* @brief Set the previous value in the list which a value is a member of
+ */
+static inline void fuse_set_head(fuse_t *self, fuse_value_t *value, fuse_value_t *elem)
 {
     assert(self);
-    assert(list);
+    assert(value);
 
     // Set the head
-    fuse_value_t **ptr = (fuse_value_t **)self->allocator->headptr(list);
+    fuse_value_t **ptr = (fuse_value_t **)self->allocator->headptr(value);
     assert(ptr);
     *ptr = elem;
 }
 
-static inline fuse_value_t *fuse_get_tail(fuse_t *self, fuse_value_t *list)
+/* @brief Return the next value in the list which a value is a member of
+ */
+static inline fuse_value_t *fuse_get_tail(fuse_t *self, fuse_value_t *value)
 {
     assert(self);
-    assert(list);
+    assert(value);
 
     // Return the tail
-    fuse_value_t **ptr = (fuse_value_t **)self->allocator->tailptr(list);
+    fuse_value_t **ptr = (fuse_value_t **)self->allocator->tailptr(value);
     assert(ptr);
     return *ptr;
 }
 
-static inline void fuse_set_tail(fuse_t *self, fuse_value_t *list, fuse_value_t *elem)
+/* @brief Set the next value in the list which a value is a member of
+ */
+static inline void fuse_set_tail(fuse_t *self, fuse_value_t *value, fuse_value_t *elem)
 {
     assert(self);
-    assert(list);
+    assert(value);
 
     // Set the tail
-    fuse_value_t **ptr = (fuse_value_t **)self->allocator->tailptr(list);
+    fuse_value_t **ptr = (fuse_value_t **)self->allocator->tailptr(value);
     assert(ptr);
     *ptr = elem;
 }
@@ -124,17 +167,17 @@ static size_t fuse_str_list(fuse_t *self, char *buf, size_t sz, size_t i, fuse_v
     // Add prefix
     i = chtostr_internal(buf, sz, i, '[');
 
-    fuse_value_t *elem = fuse_list_next(self, (fuse_list_t* )list, NULL);
-    while (elem != NULL)
+    fuse_value_t *link = ((struct fuse_list *)list)->head;
+    while (link != NULL)
     {
         // Append quoted string
-        i = vtostr_internal(self, buf, sz, i, elem, true);
+        i = vtostr_internal(self, buf, sz, i, fuse_list_value(self, link), true);
 
-        // Get the next element
-        elem = fuse_list_next(self, (fuse_list_t* )list, elem);
+        // Get the next linked value
+        link = fuse_get_tail(self, link);
 
         // Add separator
-        if (elem != NULL)
+        if (link != NULL)
         {
             i = chtostr_internal(buf, sz, i, ',');
         }
@@ -147,6 +190,93 @@ static size_t fuse_str_list(fuse_t *self, char *buf, size_t sz, size_t i, fuse_v
     return i;
 }
 
+/** @brief Return the value to link into a list for an element, which is the retained
+ *         element, or a retained node for an immediate or shared value. Returns NULL
+ *         if the node could not be allocated.
+ */
+static fuse_value_t *fuse_list_link(fuse_t *self, fuse_value_t *elem)
+{
+    assert(self);
+    assert(elem);
+
+    // Immediate and shared values are stored in a node
+    fuse_value_t *link;
+    if (fuse_value_is_imm(elem) || fuse_allocator_is_immortal(self->allocator, elem))
+    {
+        link = fuse_alloc_retained_ex(self, FUSE_MAGIC_NODE, elem, __FILE__, __LINE__);
+    }
+    else
+    {
+        link = fuse_retain(self, elem);
+    }
+    if (link == NULL)
+    {
+        return NULL;
+    }
+
+    // Mark the value as a list member, which needs to not be a member of another list
+    fuse_allocator_attach(self->allocator, link);
+    assert(fuse_get_head(self, link) == NULL);
+    assert(fuse_get_tail(self, link) == NULL);
+
+    // Return the linked value
+    return link;
+}
+
+/** @brief Clear the list pointers of a linked value, and release it
+ */
+static void fuse_list_unlink(fuse_t *self, fuse_value_t *link)
+{
+    assert(self);
+    assert(link);
+
+    fuse_set_head(self, link, NULL);
+    fuse_set_tail(self, link, NULL);
+    fuse_allocator_detach(self->allocator, link);
+    fuse_release(self, link);
+}
+
+/** @brief Return the element for a linked value
+ */
+static inline fuse_value_t *fuse_list_value(fuse_t *self, fuse_value_t *link)
+{
+    assert(self);
+    assert(link);
+
+    if (fuse_allocator_magic(self->allocator, link) == FUSE_MAGIC_NODE)
+    {
+        return ((struct fuse_list_node *)link)->value;
+    }
+    return link;
+}
+
+/** @brief Return the linked value for an element of the list. An immediate or shared
+ *         value is found from the cursor when iterating, or else by searching the list.
+ */
+static fuse_value_t *fuse_list_find(fuse_t *self, struct fuse_list *list, fuse_value_t *elem)
+{
+    assert(self);
+    assert(list);
+    assert(elem);
+
+    if (!fuse_value_is_imm(elem) && !fuse_allocator_is_immortal(self->allocator, elem))
+    {
+        return elem;
+    }
+    if (list->cursor != NULL && fuse_list_value(self, list->cursor) == elem)
+    {
+        return list->cursor;
+    }
+    for (fuse_value_t *link = list->head; link != NULL; link = fuse_get_tail(self, link))
+    {
+        if (fuse_list_value(self, link) == elem)
+        {
+            return link;
+        }
+    }
+    return NULL;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // PUBLIC METHODS
 
@@ -157,31 +287,29 @@ fuse_value_t *fuse_list_append(fuse_t *self, fuse_list_t *list, fuse_value_t *el
     assert(self);
     assert(list);
     assert(elem);
-    assert(fuse_get_head(self, elem) == NULL);
-    assert(fuse_get_tail(self, elem) == NULL);
     assert(self->allocator->magic(self->allocator, list) == FUSE_MAGIC_LIST);
 
-    // Retain the element, return NULL if the retain failed
-    elem = fuse_retain(self, elem);
-    if (elem == NULL)
+    // Retain the element, or store it in a node, return NULL if this failed
+    fuse_value_t *link = fuse_list_link(self, elem);
+    if (link == NULL)
     {
         return NULL;
     }
 
     // Link into the list
-    fuse_value_t *head = fuse_get_head(self, (fuse_value_t* )list);
-    fuse_value_t *tail = fuse_get_tail(self, (fuse_value_t* )list);
+    fuse_value_t *head = ((struct fuse_list *)list)->head;
+    fuse_value_t *tail = ((struct fuse_list *)list)->tail;
     if (head == NULL)
     {
-        fuse_set_head(self,  (fuse_value_t* )list, elem);
+        ((struct fuse_list *)list)->head = link;
     }
     if (tail != NULL)
     {
-        fuse_set_tail(self, tail, elem);
+        fuse_set_tail(self, tail, link);
     }
-    fuse_set_tail(self,  (fuse_value_t* )list, elem);
-    fuse_set_head(self, elem, tail);
-    fuse_set_tail(self, elem, NULL);
+    ((struct fuse_list *)list)->tail = link;
+    fuse_set_head(self, link, tail);
+    fuse_set_tail(self, link, NULL);
 
     // Increment the list count
     ((struct fuse_list *)list)->count++;
@@ -209,7 +337,15 @@ inline fuse_value_t *fuse_list_next(fuse_t *self, fuse_list_t *list, fuse_value_
     assert(list);
     assert(self->allocator->magic(self->allocator, list) == FUSE_MAGIC_LIST);
 
-    return (elem == NULL) ? fuse_get_head(self,  (fuse_value_t* )list) : fuse_get_tail(self, elem);
+    // Find the linked value for the current element, and move to the next one
+    struct fuse_list *l = (struct fuse_list *)list;
+    fuse_value_t *link = (elem == NULL) ? l->head : fuse_list_find(self, l, elem);
+    if (link != NULL && elem != NULL)
+    {
+        link = fuse_get_tail(self, link);
+    }
+    l->cursor = link;
+    return (link == NULL) ? NULL : fuse_list_value(self, link);
 }
 
 /** @brief Remove an element from the end of the list and return it
@@ -221,7 +357,7 @@ fuse_value_t *fuse_list_pop(fuse_t *self, fuse_list_t *list)
     assert(self->allocator->magic(self->allocator, list) == FUSE_MAGIC_LIST);
 
     // If tail is NULL, then the list is empty
-    fuse_value_t *tail = fuse_get_tail(self,  (fuse_value_t* )list);
+    fuse_value_t *tail = ((struct fuse_list *)list)->tail;
     if (tail == NULL)
     {
         assert(((struct fuse_list *)list)->count == 0);
@@ -234,27 +370,27 @@ fuse_value_t *fuse_list_pop(fuse_t *self, fuse_list_t *list)
     // Update the tail pointer of the list
     if (prev != NULL)
     {
-        fuse_set_tail(self,  (fuse_value_t* )list, prev);
+        ((struct fuse_list *)list)->tail = prev;
         fuse_set_tail(self, prev, NULL);
     }
     else
     {
         // This was the only element in the list
-        fuse_set_head(self,  (fuse_value_t* )list, NULL);
-        fuse_set_tail(self,  (fuse_value_t* )list, NULL);
+        ((struct fuse_list *)list)->head = NULL;
+        ((struct fuse_list *)list)->tail = NULL;
     }
 
     // Decrement the list count
     ((struct fuse_list *)list)->count--;
+    if (((struct fuse_list *)list)->cursor == tail)
+    {
+        ((struct fuse_list *)list)->cursor = NULL;
+    }
 
-    // Unlink the element and return it
-    fuse_set_head(self, tail, NULL);
-    fuse_set_tail(self, tail, NULL);
-
-    // Release the element
-    fuse_release(self, tail);
-
-    return tail;
+    // Unlink and release the element, and return it
+    fuse_value_t *elem = fuse_list_value(self, tail);
+    fuse_list_unlink(self, tail);
+    return elem;
 }
 
 /** @brief Append an element to the beginning of a list
@@ -264,31 +400,29 @@ fuse_value_t *fuse_list_push(fuse_t *self, fuse_list_t *list, fuse_value_t *elem
     assert(self);
     assert(list);
     assert(elem);
-    assert(fuse_get_head(self, elem) == NULL);
-    assert(fuse_get_tail(self, elem) == NULL);
     assert(self->allocator->magic(self->allocator, list) == FUSE_MAGIC_LIST);
 
-    // Retain the element, return NULL if the retain failed
-    elem = fuse_retain(self, elem);
-    if (elem == NULL)
+    // Retain the element, or store it in a node, return NULL if this failed
+    fuse_value_t *link = fuse_list_link(self, elem);
+    if (link == NULL)
     {
         return NULL;
     }
 
     // Link into the list
-    fuse_value_t *head = fuse_get_head(self,  (fuse_value_t* )list);
+    fuse_value_t *head = ((struct fuse_list *)list)->head;
     if (head != NULL)
     {
-        fuse_set_head(self, head, elem);
+        fuse_set_head(self, head, link);
     }
-    fuse_set_head(self,  (fuse_value_t* )list, elem);
-    fuse_set_tail(self, elem, head);
-    fuse_set_head(self, elem, NULL);
+    ((struct fuse_list *)list)->head = link;
+    fuse_set_tail(self, link, head);
+    fuse_set_head(self, link, NULL);
 
     // If there is no tail, set element as the new tail
-    if (fuse_get_tail(self,  (fuse_value_t* )list) == NULL)
+    if (((struct fuse_list *)list)->tail == NULL)
     {
-        fuse_set_tail(self, (fuse_value_t* ) list, elem);
+        ((struct fuse_list *)list)->tail = link;
     }
 
     // Increment the list count
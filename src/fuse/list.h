@@ -7,10 +7,24 @@
 #include <stddef.h>
 
 /** @brief Represents a linked list
+ *
+ * Allocated values are linked into the list through their own headers. Immediate
+ * and shared values cannot be linked, since they have no header or may be in several
+ * lists at once, so they are stored in a node which is linked instead.
  */
 struct fuse_list
 {
-    size_t count;           ///< The number of elements in the list
+    size_t count;         ///< The number of elements in the list
+    fuse_value_t *head;   ///< The first linked value in the list, or NULL if the list is empty
+    fuse_value_t *tail;   ///< The last linked value in the list, or NULL if the list is empty
+    fuse_value_t *cursor; ///< The linked value last returned by fuse_list_next, or NULL
+};
+
+/** @brief Represents a list node, which holds an immediate or shared value
+ */
+struct fuse_list_node
+{
+    fuse_value_t *value; ///< The immediate or shared value
 };
 
 
@@ -0,0 +1,52 @@
+/** @file lock.h
+ *  @brief Private function prototypes and structure definitions for locks.
+ *
+ * A lock protects short critical sections in the library from concurrent
+ * access. On the Pico it is a critical section, which also disables interrupts
+ * so it can be used from interrupt handlers and either core. Elsewhere it is a
+ * pthread mutex.
+ */
+#ifndef FUSE_PRIVATE_LOCK_H
+#define FUSE_PRIVATE_LOCK_H
+
+#include <stdint.h>
+#if defined(TARGET_PICO)
+#include <pico/critical_section.h>
+typedef critical_section_t fuse_lock_t;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t fuse_lock_t;
+#endif
+
+/** @brief Initialise a lock
+ */
+void fuse_lock_init(fuse_lock_t *lock);
+
+/** @brief Release resources for a lock
+ */
+void fuse_lock_destroy(fuse_lock_t *lock);
+
+/** @brief Block until the lock is acquired
+ */
+void fuse_lock_acquire(fuse_lock_t *lock);
+
+/** @brief Release the lock
+ */
+void fuse_lock_release(fuse_lock_t *lock);
+
+/** @brief Return an index for the calling core or thread
+ *
+ * On the Pico this is the core number. Elsewhere each thread is assigned the next
+ * index the first time it calls this function. The index can be used to select a
+ * shard of a data structure, so that threads rarely contend for the same lock.
+ */
+uint8_t fuse_lock_shard();
+
+/** @brief Return an identifier for the calling core or thread
+ *
+ * On the Pico this is the core number. Elsewhere it is the thread identifier,
+ * which is unique among the threads which are running.
+ */
+uintptr_t fuse_lock_thread(void);
+
+#endif
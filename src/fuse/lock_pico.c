@@ -0,0 +1,54 @@
+#if defined(TARGET_PICO)
+#include <fuse/fuse.h>
+#include <pico/critical_section.h>
+#include <pico/platform.h>
+#include "lock.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+/* @brief Initialise a lock
+ */
+void fuse_lock_init(fuse_lock_t *lock)
+{
+    assert(lock);
+    critical_section_init(lock);
+}
+
+/* @brief Release resources for a lock
+ */
+void fuse_lock_destroy(fuse_lock_t *lock)
+{
+    assert(lock);
+    critical_section_deinit(lock);
+}
+
+/* @brief Block until the lock is acquired
+ */
+inline void fuse_lock_acquire(fuse_lock_t *lock)
+{
+    critical_section_enter_blocking(lock);
+}
+
+/* @brief Release the lock
+ */
+inline void fuse_lock_release(fuse_lock_t *lock)
+{
+    critical_section_exit(lock);
+}
+
+/* @brief Return the index of the calling core
+ */
+inline uint8_t fuse_lock_shard()
+{
+    return (uint8_t)get_core_num();
+}
+
+/* @brief Return an identifier for the calling core
+ */
+inline uintptr_t fuse_lock_thread(void)
+{
+    return (uintptr_t)get_core_num();
+}
+
+#endif
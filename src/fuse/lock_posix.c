@@ -0,0 +1,64 @@
+#if defined(TARGET_DARWIN) || defined(TARGET_LINUX)
+#include <fuse/fuse.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "lock.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// GLOBALS
+
+static atomic_uint fuse_lock_shard_next = 0;
+static _Thread_local int fuse_lock_shard_index = -1;
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+/* @brief Initialise a lock
+ */
+void fuse_lock_init(fuse_lock_t *lock)
+{
+    assert(lock);
+    pthread_mutex_init(lock, NULL);
+}
+
+/* @brief Release resources for a lock
+ */
+void fuse_lock_destroy(fuse_lock_t *lock)
+{
+    assert(lock);
+    pthread_mutex_destroy(lock);
+}
+
+/* @brief Block until the lock is acquired
+ */
+inline void fuse_lock_acquire(fuse_lock_t *lock)
+{
+    pthread_mutex_lock(lock);
+}
+
+/* @brief Release the lock
+ */
+inline void fuse_lock_release(fuse_lock_t *lock)
+{
+    pthread_mutex_unlock(lock);
+}
+
+/* @brief Return an index for the calling thread
+ */
+uint8_t fuse_lock_shard()
+{
+    if (fuse_lock_shard_index < 0)
+    {
+        fuse_lock_shard_index = (uint8_t)atomic_fetch_add(&fuse_lock_shard_next, 1);
+    }
+    return (uint8_t)fuse_lock_shard_index;
+}
+
+/* @brief Return an identifier for the calling thread
+ */
+inline uintptr_t fuse_lock_thread(void)
+{
+    return (uintptr_t)pthread_self();
+}
+
+#endif
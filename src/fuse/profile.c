@@ -0,0 +1,264 @@
+#include <fuse/fuse.h>
+#include "alloc.h"
+#include "fuse.h"
+#include "printf.h"
+#include "profile.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// DECLARATIONS
+
+static bool fuse_init_profile(fuse_t *self, fuse_value_t *value, const void *user_data);
+static size_t fuse_str_profile(fuse_t *self, char *buf, size_t sz, size_t i, fuse_value_t *v, bool json);
+static size_t fuse_str_profile_stats(char *buf, size_t sz, size_t i, struct fuse_allocator_stats *stats, bool json);
+static void fuse_profile_copy(struct fuse_allocator_stats *dst, struct fuse_allocator_stats *src);
+static size_t fuse_str_profile_uint(char *buf, size_t sz, size_t i, const char *key, size_t value, bool json);
+
+///////////////////////////////////////////////////////////////////////////////
+// LIFECYCLE
+
+/** @brief Register value type for allocation profiles
+ */
+void fuse_register_value_profile(fuse_t *self)
+{
+    assert(self);
+
+    fuse_value_desc_t fuse_profile_type = {
+        .size = sizeof(struct fuse_profile),
+        .name = "PROFILE",
+        .init = fuse_init_profile,
+        .str = fuse_str_profile,
+    };
+    fuse_register_value_type(self, FUSE_MAGIC_PROFILE, fuse_profile_type);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PRIVATE METHODS
+
+/** @brief Copy the allocation statistics into the profile
+ */
+static bool fuse_init_profile(fuse_t *self, fuse_value_t *value, const void *user_data)
+{
+    assert(self);
+    assert(value);
+
+    struct fuse_profile *profile = (struct fuse_profile *)value;
+    struct fuse_allocator *allocator = self->allocator;
+
+    // Copy the statistics. Each counter is read atomically, but the counters are
+    // updated without a lock so the snapshot may be a little out of step
+    profile->cur = atomic_load(&allocator->cur);
+    profile->max = atomic_load(&allocator->max);
+    profile->count = atomic_load(&allocator->count);
+    profile->rejected = atomic_load(&allocator->rejected);
+    for (size_t magic = 0; magic < FUSE_MAGIC_COUNT; magic++)
+    {
+        fuse_profile_copy(&profile->stats[magic], &allocator->stats[magic]);
+    }
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+    for (size_t j = 0; j < FUSE_ALLOCATOR_SITES; j++)
+    {
+        struct fuse_allocator_site *site = &allocator->sites[j];
+        const char *file = atomic_load(&site->file);
+        profile->sites[j].line = site->line;
+        profile->sites[j].magic = site->magic;
+        fuse_profile_copy(&profile->sites[j].stats, &site->stats);
+        atomic_store(&profile->sites[j].file, file);
+    }
+#endif
+
+    // Return success
+    return true;
+}
+
+/** @brief Append a representation of an allocation profile, as JSON or as text
+ *         with one line for each value type and allocation site
+ */
+static size_t fuse_str_profile(fuse_t *self, char *buf, size_t sz, size_t i, fuse_value_t *v, bool json)
+{
+    assert(self);
+    assert(buf == NULL || sz > 0);
+    assert(v);
+    assert(fuse_allocator_magic(self->allocator, v) == FUSE_MAGIC_PROFILE);
+
+    struct fuse_profile *profile = (struct fuse_profile *)v;
+
+    // Add totals
+    if (json)
+    {
+        i = chtostr_internal(buf, sz, i, '{');
+    }
+    i = fuse_str_profile_uint(buf, sz, i, "cur", profile->cur, json);
+    i = chtostr_internal(buf, sz, i, json ? ',' : ' ');
+    i = fuse_str_profile_uint(buf, sz, i, "max", profile->max, json);
+    i = chtostr_internal(buf, sz, i, json ? ',' : ' ');
+    i = fuse_str_profile_uint(buf, sz, i, "count", profile->count, json);
+    i = chtostr_internal(buf, sz, i, json ? ',' : ' ');
+    i = fuse_str_profile_uint(buf, sz, i, "rejected", profile->rejected, json);
+
+    // Add statistics for each value type which has been allocated
+    if (json)
+    {
+        i = chtostr_internal(buf, sz, i, ',');
+        i = qstrtostr_internal(buf, sz, i, "types");
+        i = chtostr_internal(buf, sz, i, ':');
+        i = chtostr_internal(buf, sz, i, '{');
+    }
+    bool first = true;
+    for (size_t magic = 0; magic < FUSE_MAGIC_COUNT; magic++)
+    {
+        if (profile->stats[magic].allocs == 0 || self->desc[magic].name == NULL)
+        {
+            continue;
+        }
+        if (json)
+        {
+            if (!first)
+            {
+                i = chtostr_internal(buf, sz, i, ',');
+            }
+            i = qstrtostr_internal(buf, sz, i, self->desc[magic].name);
+            i = chtostr_internal(buf, sz, i, ':');
+            i = chtostr_internal(buf, sz, i, '{');
+        }
+        else
+        {
+            i = chtostr_internal(buf, sz, i, '\n');
+            i = cstrtostr_internal(buf, sz, i, self->desc[magic].name);
+            i = chtostr_internal(buf, sz, i, ' ');
+        }
+        i = fuse_str_profile_stats(buf, sz, i, &profile->stats[magic], json);
+        if (json)
+        {
+            i = chtostr_internal(buf, sz, i, '}');
+        }
+        first = false;
+    }
+    if (json)
+    {
+        i = chtostr_internal(buf, sz, i, '}');
+    }
+
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+    // Add statistics for each allocation site
+    if (json)
+    {
+        i = chtostr_internal(buf, sz, i, ',');
+        i = qstrtostr_internal(buf, sz, i, "sites");
+        i = chtostr_internal(buf, sz, i, ':');
+        i = chtostr_internal(buf, sz, i, '[');
+    }
+    first = true;
+    for (size_t j = 0; j < FUSE_ALLOCATOR_SITES; j++)
+    {
+        struct fuse_allocator_site *site = &profile->sites[j];
+        if (site->file == NULL)
+        {
+            continue;
+        }
+        const char *type = (site->magic < FUSE_MAGIC_COUNT) ? self->desc[site->magic].name : NULL;
+        if (json)
+        {
+            if (!first)
+            {
+                i = chtostr_internal(buf, sz, i, ',');
+            }
+            i = chtostr_internal(buf, sz, i, '{');
+            i = qstrtostr_internal(buf, sz, i, "file");
+            i = chtostr_internal(buf, sz, i, ':');
+            i = qstrtostr_internal(buf, sz, i, site->file);
+            i = chtostr_internal(buf, sz, i, ',');
+            i = fuse_str_profile_uint(buf, sz, i, "line", site->line, json);
+            if (type != NULL)
+            {
+                i = chtostr_internal(buf, sz, i, ',');
+                i = qstrtostr_internal(buf, sz, i, "type");
+                i = chtostr_internal(buf, sz, i, ':');
+                i = qstrtostr_internal(buf, sz, i, type);
+            }
+            i = chtostr_internal(buf, sz, i, ',');
+        }
+        else
+        {
+            i = chtostr_internal(buf, sz, i, '\n');
+            i = cstrtostr_internal(buf, sz, i, site->file);
+            i = chtostr_internal(buf, sz, i, ':');
+            i = utostr_internal(buf, sz, i, site->line, 0);
+            if (type != NULL)
+            {
+                i = chtostr_internal(buf, sz, i, ' ');
+                i = cstrtostr_internal(buf, sz, i, type);
+            }
+            i = chtostr_internal(buf, sz, i, ' ');
+        }
+        i = fuse_str_profile_stats(buf, sz, i, &site->stats, json);
+        if (json)
+        {
+            i = chtostr_internal(buf, sz, i, '}');
+        }
+        first = false;
+    }
+    if (json)
+    {
+        i = chtostr_internal(buf, sz, i, ']');
+    }
+#endif
+
+    // Add suffix
+    if (json)
+    {
+        i = chtostr_internal(buf, sz, i, '}');
+    }
+
+    // Return the index
+    return i;
+}
+
+/** @brief Append the members for allocation statistics
+ */
+static size_t fuse_str_profile_stats(char *buf, size_t sz, size_t i, struct fuse_allocator_stats *stats, bool json)
+{
+    assert(stats);
+
+    i = fuse_str_profile_uint(buf, sz, i, "cur", stats->cur, json);
+    i = chtostr_internal(buf, sz, i, json ? ',' : ' ');
+    i = fuse_str_profile_uint(buf, sz, i, "max", stats->max, json);
+    i = chtostr_internal(buf, sz, i, json ? ',' : ' ');
+    i = fuse_str_profile_uint(buf, sz, i, "allocs", stats->allocs, json);
+    i = chtostr_internal(buf, sz, i, json ? ',' : ' ');
+    i = fuse_str_profile_uint(buf, sz, i, "frees", stats->frees, json);
+    return i;
+}
+
+/** @brief Append a key and unsigned integer value, as "key":value for JSON or
+ *         key=value for text
+ */
+static size_t fuse_str_profile_uint(char *buf, size_t sz, size_t i, const char *key, size_t value, bool json)
+{
+    assert(key);
+
+    if (json)
+    {
+        i = qstrtostr_internal(buf, sz, i, key);
+        i = chtostr_internal(buf, sz, i, ':');
+    }
+    else
+    {
+        i = cstrtostr_internal(buf, sz, i, key);
+        i = chtostr_internal(buf, sz, i, '=');
+    }
+    i = utostr_internal(buf, sz, i, value, 0);
+    return i;
+}
+
+/** @brief Copy allocation statistics, reading each counter atomically
+ */
+static void fuse_profile_copy(struct fuse_allocator_stats *dst, struct fuse_allocator_stats *src)
+{
+    assert(dst);
+    assert(src);
+
+    atomic_store(&dst->cur, atomic_load(&src->cur));
+    atomic_store(&dst->max, atomic_load(&src->max));
+    atomic_store(&dst->allocs, atomic_load(&src->allocs));
+    atomic_store(&dst->frees, atomic_load(&src->frees));
+}
@@ -0,0 +1,28 @@
+/** @file profile.h
+ *  @brief Private function prototypes and structure definitions for allocation profiles
+ */
+#ifndef FUSE_PRIVATE_PROFILE_H
+#define FUSE_PRIVATE_PROFILE_H
+
+#include <fuse/fuse.h>
+#include "alloc.h"
+
+/** @brief Represents a snapshot of the allocation statistics
+ */
+struct fuse_profile
+{
+    size_t cur;                                          ///< The total number of bytes allocated, including headers
+    size_t max;                                          ///< The max number of bytes allocated
+    size_t count;                                        ///< The number of memory blocks allocated
+    size_t rejected;                                     ///< The number of allocations rejected by the budget
+    struct fuse_allocator_stats stats[FUSE_MAGIC_COUNT]; ///< The statistics for each magic number
+#if defined(DEBUG) && defined(FUSE_PROFILE)
+    struct fuse_allocator_site sites[FUSE_ALLOCATOR_SITES]; ///< The statistics for each allocation site
+#endif
+};
+
+/** @brief Register value type for allocation profiles
+ */
+void fuse_register_value_profile(fuse_t *self);
+
+#endif
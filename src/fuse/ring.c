@@ -0,0 +1,145 @@
+#include <fuse/fuse.h>
+#include "ring.h"
+
+_Static_assert((FUSE_RING_SIZE & (FUSE_RING_SIZE - 1)) == 0, "FUSE_RING_SIZE needs to be a power of two");
+
+///////////////////////////////////////////////////////////////////////////////
+// LIFECYCLE
+
+void fuse_ring_init(struct fuse_ring *ring)
+{
+    assert(ring);
+
+    // Each slot can first be pushed at its own position
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    for (size_t i = 0; i < FUSE_RING_SIZE; i++)
+    {
+        atomic_init(&ring->slot[i].seq, i);
+        ring->slot[i].ptr = NULL;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+bool fuse_ring_push(struct fuse_ring *ring, void *ptr)
+{
+    assert(ring);
+    assert(ptr);
+
+    // Claim the slot at the head position, unless another producer claims it first
+    size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    struct fuse_ring_slot *slot;
+    while (true)
+    {
+        slot = &ring->slot[pos & (FUSE_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The slot has not been popped since the last time around, so the ring is full
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    // Fill the slot, then publish it to consumers
+    slot->ptr = ptr;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+void *fuse_ring_pop(struct fuse_ring *ring)
+{
+    assert(ring);
+
+    // Claim the slot at the tail position once it has been filled
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    struct fuse_ring_slot *slot;
+    while (true)
+    {
+        slot = &ring->slot[pos & (FUSE_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The slot has not been filled, so the ring is empty
+            return NULL;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    // Empty the slot, then release it to producers for the next time around
+    void *ptr = slot->ptr;
+    slot->ptr = NULL;
+    atomic_store_explicit(&slot->seq, pos + FUSE_RING_SIZE, memory_order_release);
+    return ptr;
+}
+
+size_t fuse_ring_pop_batch(struct fuse_ring *ring, void **ptrs, size_t n)
+{
+    assert(ring);
+    assert(ptrs || n == 0);
+
+    // Count the filled slots from the tail position, and claim them all at once
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t k;
+    while (true)
+    {
+        for (k = 0; k < n && k < FUSE_RING_SIZE; k++)
+        {
+            struct fuse_ring_slot *slot = &ring->slot[(pos + k) & (FUSE_RING_SIZE - 1)];
+            if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + k + 1)
+            {
+                break;
+            }
+        }
+        if (k == 0)
+        {
+            return 0;
+        }
+        if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + k, memory_order_relaxed, memory_order_relaxed))
+        {
+            break;
+        }
+    }
+
+    // Empty the slots, and release them to producers for the next time around
+    for (size_t i = 0; i < k; i++)
+    {
+        struct fuse_ring_slot *slot = &ring->slot[(pos + i) & (FUSE_RING_SIZE - 1)];
+        ptrs[i] = slot->ptr;
+        slot->ptr = NULL;
+        atomic_store_explicit(&slot->seq, pos + i + FUSE_RING_SIZE, memory_order_release);
+    }
+    return k;
+}
+
+size_t fuse_ring_count(struct fuse_ring *ring)
+{
+    assert(ring);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head > tail ? head - tail : 0;
+}
@@ -0,0 +1,80 @@
+/** @file ring.h
+ *  @brief Private function prototypes and structure definitions for ring buffers
+ *
+ * A ring is a bounded lock-free queue of pointers. Any number of producers can
+ * push onto the ring, from threads on Linux and Darwin or from interrupt handlers
+ * and either core on the Pico, and pointers are popped in the order they were
+ * pushed, by one or more consumers. Each slot has a sequence number which tells a
+ * producer whether the slot is free and a consumer whether the slot is full, so
+ * pushing and popping take constant time and never allocate memory.
+ */
+#ifndef FUSE_PRIVATE_RING_H
+#define FUSE_PRIVATE_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Define the ring size, which needs to be a power of two
+#if defined(TARGET_PICO)
+#define FUSE_RING_SIZE 64 ///< The number of slots in a ring
+#else
+#define FUSE_RING_SIZE 128 ///< The number of slots in a ring
+#endif
+
+/** @brief Represents a slot in a ring
+ *
+ * The sequence number of a slot is equal to a position when the slot can be pushed
+ * at that position, and one more than the position when it can be popped.
+ */
+struct fuse_ring_slot
+{
+    _Atomic size_t seq; ///< The sequence number of the slot
+    void *ptr;          ///< The pointer in the slot
+};
+
+/** @brief Represents a ring
+ */
+struct fuse_ring
+{
+    _Atomic size_t head;                        ///< The position of the next push
+    _Atomic size_t tail;                        ///< The position of the next pop
+    struct fuse_ring_slot slot[FUSE_RING_SIZE]; ///< The slots
+};
+
+/** @brief Initialise an empty ring
+ */
+void fuse_ring_init(struct fuse_ring *ring);
+
+/** @brief Push a pointer onto the ring
+ *
+ * @param ring The ring
+ * @param ptr The pointer, which cannot be NULL
+ * @returns False if the ring is full
+ */
+bool fuse_ring_push(struct fuse_ring *ring, void *ptr);
+
+/** @brief Pop the oldest pointer from the ring
+ *
+ * @param ring The ring
+ * @returns The pointer, or NULL if the ring is empty
+ */
+void *fuse_ring_pop(struct fuse_ring *ring);
+
+/** @brief Pop up to n of the oldest pointers from the ring in one operation
+ *
+ * @param ring The ring
+ * @param ptrs The array which is filled with the pointers, oldest first
+ * @param n The maximum number of pointers to pop
+ * @returns The number of pointers popped, or zero if the ring is empty
+ */
+size_t fuse_ring_pop_batch(struct fuse_ring *ring, void **ptrs, size_t n);
+
+/** @brief Return the number of pointers in the ring
+ *
+ * The count is a snapshot, which may be out of date if other threads are pushing
+ * or popping at the same time.
+ */
+size_t fuse_ring_count(struct fuse_ring *ring);
+
+#endif
@@ -137,8 +137,9 @@ void fuse_timer_cancel(fuse_t *self, fuse_timer_t *timer)
  */
 static void fuse_timer_callback(fuse_timer_t *timer)
 {
-    fuse_event_t* evt = fuse_new_event(timer->self, (fuse_value_t* )timer, FUSE_EVENT_TIMER, (void* )timer->data);
-    assert(evt);
+
+    // The event is dropped and counted if there is memory pressure
+    fuse_new_event(timer->self, (fuse_value_t* )timer, FUSE_EVENT_TIMER, (void* )timer->data);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -123,8 +123,9 @@ static bool fuse_timer_callback(repeating_timer_t *rt)
     struct timer_context *timer = (struct timer_context *)(rt->user_data);
     assert(timer);
     assert(timer->self);
-    fuse_event_t* evt = fuse_new_event(timer->self, (fuse_value_t* )timer, FUSE_EVENT_TIMER, (void* )timer->data);
-    assert(evt);
+
+    // The event is dropped and counted if there is memory pressure
+    fuse_new_event(timer->self, (fuse_value_t* )timer, FUSE_EVENT_TIMER, (void* )timer->data);
     return timer->periodic;
 }
 
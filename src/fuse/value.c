@@ -1,6 +1,7 @@
 #include <fuse/fuse.h>
 #include "alloc.h"
 #include "fuse.h"
+#include "value.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // PUBLIC METHODS
@@ -46,19 +47,79 @@ fuse_value_t *fuse_new_value_ex(fuse_t *self, const uint16_t magic, const void *
     assert(self);
     assert(magic < FUSE_MAGIC_COUNT);
 
+    // Return a shared value if there is one
+    switch (magic)
+    {
+    case FUSE_MAGIC_NULL:
+        if (self->null != NULL)
+        {
+            return self->null;
+        }
+        break;
+    case FUSE_MAGIC_BOOL:
+        if (self->bool_[user_data ? 1 : 0] != NULL)
+        {
+            return self->bool_[user_data ? 1 : 0];
+        }
+        break;
+    case FUSE_MAGIC_U8:
+        if ((uint8_t)(uintptr_t)user_data < FUSE_IMMORTAL_U8 && self->u8[(uint8_t)(uintptr_t)user_data] != NULL)
+        {
+            return self->u8[(uint8_t)(uintptr_t)user_data];
+        }
+        break;
+    }
+
     // Allocate memory for the value - retain count is zero
     return fuse_alloc_ex(self, magic, user_data, file, line);
 }
 
+/** @brief Create several new autoreleased values of the same type
+ */
+bool fuse_new_values_batch_ex(fuse_t *self, const uint16_t magic, size_t n, fuse_value_t **out, const char *file, const int line)
+{
+    assert(self);
+    assert(magic < FUSE_MAGIC_COUNT);
+    assert(out || n == 0);
+
+    // Allocate memory for the values - retain count is zero
+    return fuse_alloc_batch_ex(self, magic, n, (void **)out, file, line);
+}
+
+/** @brief Release several values
+ */
+void fuse_release_batch(fuse_t *self, size_t n, fuse_value_t **values)
+{
+    assert(self);
+    assert(values || n == 0);
+
+    // Copy the values in blocks, skipping immediate values which are not allocated,
+    // and decrement the reference counts
+    void *ptrs[FUSE_ALLOCATOR_BATCH];
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (values[i] != NULL && !fuse_value_is_imm(values[i]))
+        {
+            ptrs[k++] = values[i];
+        }
+        if (k == FUSE_ALLOCATOR_BATCH || (i == n - 1 && k > 0))
+        {
+            fuse_allocator_release_batch(self->allocator, k, ptrs);
+            k = 0;
+        }
+    }
+}
+
 /** @brief Retain the value and return it.
  */
 fuse_value_t *fuse_retain(fuse_t *self, void *value)
 {
     assert(self);
-    assert(value == NULL || fuse_allocator_magic(self->allocator, (fuse_value_t *)value) < FUSE_MAGIC_COUNT);
+    assert(value == NULL || fuse_value_is_imm(value) || fuse_allocator_magic(self->allocator, (fuse_value_t *)value) < FUSE_MAGIC_COUNT);
 
     // Retain value
-    if (value != NULL)
+    if (value != NULL && !fuse_value_is_imm(value))
     {
         fuse_allocator_retain(self->allocator, (fuse_value_t *)value);
     }
@@ -72,16 +133,13 @@ fuse_value_t *fuse_retain(fuse_t *self, void *value)
 void fuse_release(fuse_t *self, void *value)
 {
     assert(self);
-    assert(value == NULL || fuse_allocator_magic(self->allocator, (fuse_value_t *)value) < FUSE_MAGIC_COUNT);
+    assert(value == NULL || fuse_value_is_imm(value) || fuse_allocator_magic(self->allocator, (fuse_value_t *)value) < FUSE_MAGIC_COUNT);
 
-    // Decrement the reference count
-    if (value != NULL)
+    // Decrement the reference count, which places the value on the list of values
+    // to be drained when it reaches zero
+    if (value != NULL && !fuse_value_is_imm(value))
     {
-        if (fuse_allocator_release(self->allocator, (fuse_value_t *)value))
-        {
-            // Indicate we should drain the memory pool
-            self->drain = true;
-        }
+        fuse_allocator_release(self->allocator, (fuse_value_t *)value);
     }
 }
 
@@ -103,9 +161,175 @@ uint16_t fuse_value_type(fuse_t *self, void *value) {
         return FUSE_MAGIC_NULL;
     }
 
-    // TODO: We should check that this is a valid pointer value in the allocator pool
-    // or else we could get a segfault - so return NULL
+    // Immediate values contain the magic number
+    if (fuse_value_is_imm(value)) {
+        return fuse_value_imm_magic(value);
+    }
+
+    // The shared values are never freed, so they are classified without asking the
+    // allocator, which may take a lock
+    if (value == self->null) {
+        return FUSE_MAGIC_NULL;
+    }
+    if (value == self->bool_[0] || value == self->bool_[1]) {
+        return FUSE_MAGIC_BOOL;
+    }
+    for (size_t i = 0; i < FUSE_IMMORTAL_U8; i++) {
+        if (value == self->u8[i]) {
+            return FUSE_MAGIC_U8;
+        }
+    }
+
+    // Check that this is a valid pointer value in the allocator pool, or else
+    // return NULL
+    if (!fuse_allocator_valid(self->allocator, value)) {
+        return FUSE_MAGIC_NULL;
+    }
 
     // Get the magic number
     return fuse_allocator_magic(self->allocator, (fuse_value_t *)value);
 }
+
+/** @brief Create a new immediate value for a small scalar
+ */
+fuse_value_t *fuse_new_imm_ex(fuse_t *self, const uint16_t magic, int64_t v, const char *file, const int line)
+{
+    assert(self);
+
+    // Check the value fits in the pointer
+    const int64_t max = ((int64_t)1 << (sizeof(uintptr_t) * 8 - FUSE_VALUE_IMM_SHIFT - 1)) - 1;
+    bool fits = (v >= -max - 1) && (v <= max);
+    switch (magic)
+    {
+    case FUSE_MAGIC_NULL:
+    case FUSE_MAGIC_BOOL:
+    case FUSE_MAGIC_U8:
+    case FUSE_MAGIC_U16:
+    case FUSE_MAGIC_U32:
+    case FUSE_MAGIC_S8:
+    case FUSE_MAGIC_S16:
+    case FUSE_MAGIC_S32:
+        break;
+    default:
+        assert(false);
+        return NULL;
+    }
+
+    // Return an immediate value, or allocate a value if it does not fit
+    if (fits)
+    {
+        return (fuse_value_t *)(((uintptr_t)(intptr_t)v << FUSE_VALUE_IMM_SHIFT) | ((uintptr_t)magic << 1) | 1);
+    }
+    else
+    {
+        return fuse_new_value_ex(self, magic, (void *)(intptr_t)v, file, line);
+    }
+}
+
+/** @brief Return the integer value of a bool or integer value
+ */
+int64_t fuse_value_int(fuse_t *self, fuse_value_t *value)
+{
+    assert(self);
+
+    // Immediate values contain the value
+    if (value == NULL)
+    {
+        return 0;
+    }
+    if (fuse_value_is_imm(value))
+    {
+        return fuse_value_imm_int(value);
+    }
+
+    // Read allocated values
+    switch (fuse_allocator_magic(self->allocator, value))
+    {
+    case FUSE_MAGIC_BOOL:
+        return *(bool *)value ? 1 : 0;
+    case FUSE_MAGIC_U8:
+        return *(uint8_t *)value;
+    case FUSE_MAGIC_U16:
+        return *(uint16_t *)value;
+    case FUSE_MAGIC_U32:
+        return *(uint32_t *)value;
+    case FUSE_MAGIC_U64:
+        return (int64_t)*(uint64_t *)value;
+    case FUSE_MAGIC_S8:
+        return *(int8_t *)value;
+    case FUSE_MAGIC_S16:
+        return *(int16_t *)value;
+    case FUSE_MAGIC_S32:
+        return *(int32_t *)value;
+    case FUSE_MAGIC_S64:
+        return *(int64_t *)value;
+    default:
+        return 0;
+    }
+}
+
+/** @brief Create the shared values for NULL, true, false and small integers
+ */
+bool fuse_value_immortal_init(fuse_t *self)
+{
+    assert(self);
+
+    // Allocate the values retained, and then mark them as immortal
+    self->null = fuse_alloc_retained_ex(self, FUSE_MAGIC_NULL, NULL, __FILE__, __LINE__);
+    if (self->null == NULL)
+    {
+        return false;
+    }
+    fuse_allocator_immortal(self->allocator, self->null);
+    for (size_t i = 0; i < 2; i++)
+    {
+        self->bool_[i] = fuse_alloc_retained_ex(self, FUSE_MAGIC_BOOL, (void *)i, __FILE__, __LINE__);
+        if (self->bool_[i] == NULL)
+        {
+            return false;
+        }
+        fuse_allocator_immortal(self->allocator, self->bool_[i]);
+    }
+    for (size_t i = 0; i < FUSE_IMMORTAL_U8; i++)
+    {
+        self->u8[i] = fuse_alloc_retained_ex(self, FUSE_MAGIC_U8, (void *)i, __FILE__, __LINE__);
+        if (self->u8[i] == NULL)
+        {
+            return false;
+        }
+        fuse_allocator_immortal(self->allocator, self->u8[i]);
+    }
+
+    // Return success
+    return true;
+}
+
+/** @brief Free the shared values for NULL, true, false and small integers
+ */
+void fuse_value_immortal_destroy(fuse_t *self)
+{
+    assert(self);
+
+    // Free the values which were created
+    if (self->null != NULL)
+    {
+        fuse_free(self, self->null);
+        self->null = NULL;
+    }
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (self->bool_[i] != NULL)
+        {
+            fuse_free(self, self->bool_[i]);
+            self->bool_[i] = NULL;
+        }
+    }
+    for (size_t i = 0; i < FUSE_IMMORTAL_U8; i++)
+    {
+        if (self->u8[i] != NULL)
+        {
+            fuse_free(self, self->u8[i]);
+            self->u8[i] = NULL;
+        }
+    }
+}
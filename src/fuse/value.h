@@ -19,4 +19,20 @@ struct fuse_value_instance
     struct fuse_value_instance *next; ///< The next value in the list  (when the value is part of a list)
 };
 
+/** @brief Create the shared values for NULL, true, false and small integers
+ *
+ * The shared values are immortal, so retain and release do nothing and they
+ * are never drained.
+ *
+ * @param self The fuse instance
+ * @return True if the values were created
+ */
+bool fuse_value_immortal_init(fuse_t *self);
+
+/** @brief Free the shared values for NULL, true, false and small integers
+ *
+ * @param self The fuse instance
+ */
+void fuse_value_immortal_destroy(fuse_t *self);
+
 #endif
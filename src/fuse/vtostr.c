@@ -26,6 +26,24 @@ size_t vtostr_internal(fuse_t *self, char *buf, size_t sz, size_t i, fuse_value_
         }
     }
 
+    // Immediate values are formatted from the pointer
+    if (fuse_value_is_imm(v))
+    {
+        switch (fuse_value_imm_magic(v))
+        {
+        case FUSE_MAGIC_NULL:
+            return cstrtostr_internal(buf, sz, i, quoted ? FUSE_PRINTF_NULL_JSON : NULL);
+        case FUSE_MAGIC_BOOL:
+            return cstrtostr_internal(buf, sz, i, fuse_value_imm_int(v) ? FUSE_PRINTF_TRUE : FUSE_PRINTF_FALSE);
+        case FUSE_MAGIC_U8:
+        case FUSE_MAGIC_U16:
+        case FUSE_MAGIC_U32:
+            return utostr_internal(buf, sz, i, (uint64_t)fuse_value_imm_int(v), 0);
+        default:
+            return itostr_internal(buf, sz, i, fuse_value_imm_int(v), 0);
+        }
+    }
+
     int16_t magic = fuse_allocator_magic(self->allocator, v);
     assert(magic < FUSE_MAGIC_COUNT);
 
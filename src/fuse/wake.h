@@ -0,0 +1,55 @@
+/** @file wake.h
+ *  @brief Private function prototypes and structure definitions for wake-ups
+ *
+ * A wake-up blocks the run loop until an event is placed on its event queue,
+ * or a timeout expires. Signalling a wake-up is safe from any thread, from a
+ * signal handler, and on the Pico from an interrupt handler or the other core.
+ * A signal which arrives before the run loop waits is not lost, so the run loop
+ * can check its event queue and then wait without a race.
+ *
+ * On Linux the wake-up is an eventfd, on Darwin it is a non-blocking pipe, and
+ * on the Pico it is a flag with the SEV and WFE instructions.
+ */
+#ifndef FUSE_PRIVATE_WAKE_H
+#define FUSE_PRIVATE_WAKE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Represents a wake-up
+ */
+struct fuse_wake
+{
+#if defined(TARGET_PICO)
+    _Atomic bool pending; ///< True if the wake-up has been signalled
+#elif defined(TARGET_LINUX)
+    int fd; ///< The eventfd
+#else
+    int fd[2]; ///< The read and write ends of the pipe
+#endif
+};
+
+/** @brief Initialise a wake-up
+ *
+ * @param wake The wake-up
+ * @returns False if the wake-up could not be created
+ */
+bool fuse_wake_init(struct fuse_wake *wake);
+
+/** @brief Release resources for a wake-up
+ */
+void fuse_wake_destroy(struct fuse_wake *wake);
+
+/** @brief Signal a wake-up, waking the run loop if it is waiting
+ */
+void fuse_wake_signal(struct fuse_wake *wake);
+
+/** @brief Block until the wake-up is signalled or the timeout expires, then clear the signal
+ *
+ * @param wake The wake-up
+ * @param ms The timeout, in milliseconds
+ */
+void fuse_wake_wait(struct fuse_wake *wake, uint32_t ms);
+
+#endif
@@ -0,0 +1,81 @@
+#if defined(TARGET_DARWIN)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fuse/fuse.h>
+#include "wake.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+/** @brief Initialise a wake-up
+ */
+bool fuse_wake_init(struct fuse_wake *wake)
+{
+    assert(wake);
+    if (pipe(wake->fd) != 0)
+    {
+        wake->fd[0] = wake->fd[1] = -1;
+        return false;
+    }
+
+    // Neither end of the pipe blocks, so a full pipe means a wake-up is pending
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(wake->fd[i], F_SETFL, fcntl(wake->fd[i], F_GETFL) | O_NONBLOCK);
+        fcntl(wake->fd[i], F_SETFD, FD_CLOEXEC);
+    }
+    return true;
+}
+
+/** @brief Release resources for a wake-up
+ */
+void fuse_wake_destroy(struct fuse_wake *wake)
+{
+    assert(wake);
+    for (int i = 0; i < 2; i++)
+    {
+        if (wake->fd[i] >= 0)
+        {
+            close(wake->fd[i]);
+            wake->fd[i] = -1;
+        }
+    }
+}
+
+/** @brief Signal a wake-up
+ */
+void fuse_wake_signal(struct fuse_wake *wake)
+{
+    assert(wake);
+    uint8_t value = 1;
+    while (write(wake->fd[1], &value, sizeof(value)) < 0 && errno == EINTR)
+    {
+        continue;
+    }
+}
+
+/** @brief Block until the wake-up is signalled or the timeout expires
+ */
+void fuse_wake_wait(struct fuse_wake *wake, uint32_t ms)
+{
+    assert(wake);
+
+    // Wait for the pipe to become readable
+    struct pollfd pfd = {.fd = wake->fd[0], .events = POLLIN};
+    if (poll(&pfd, 1, (int)ms) <= 0)
+    {
+        return;
+    }
+
+    // Empty the pipe
+    uint8_t buf[64];
+    ssize_t n;
+    do
+    {
+        n = read(wake->fd[0], buf, sizeof(buf));
+    } while (n > 0 || (n < 0 && errno == EINTR));
+}
+
+#endif
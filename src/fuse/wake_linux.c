@@ -0,0 +1,69 @@
+#if defined(TARGET_LINUX)
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <fuse/fuse.h>
+#include "wake.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+/** @brief Initialise a wake-up
+ */
+bool fuse_wake_init(struct fuse_wake *wake)
+{
+    assert(wake);
+    wake->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return wake->fd >= 0;
+}
+
+/** @brief Release resources for a wake-up
+ */
+void fuse_wake_destroy(struct fuse_wake *wake)
+{
+    assert(wake);
+    if (wake->fd >= 0)
+    {
+        close(wake->fd);
+        wake->fd = -1;
+    }
+}
+
+/** @brief Signal a wake-up
+ */
+void fuse_wake_signal(struct fuse_wake *wake)
+{
+    assert(wake);
+
+    // The counter only overflows after 2^64 - 1 signals without a wait, in which
+    // case the wake-up is already pending
+    uint64_t value = 1;
+    while (write(wake->fd, &value, sizeof(value)) < 0 && errno == EINTR)
+    {
+        continue;
+    }
+}
+
+/** @brief Block until the wake-up is signalled or the timeout expires
+ */
+void fuse_wake_wait(struct fuse_wake *wake, uint32_t ms)
+{
+    assert(wake);
+
+    // Wait for the counter to become non-zero
+    struct pollfd pfd = {.fd = wake->fd, .events = POLLIN};
+    if (poll(&pfd, 1, (int)ms) <= 0)
+    {
+        return;
+    }
+
+    // Reset the counter
+    uint64_t value;
+    while (read(wake->fd, &value, sizeof(value)) < 0 && errno == EINTR)
+    {
+        continue;
+    }
+}
+
+#endif
@@ -0,0 +1,56 @@
+#if defined(TARGET_PICO)
+#include <fuse/fuse.h>
+#include <hardware/sync.h>
+#include <pico/time.h>
+#include "wake.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+/** @brief Initialise a wake-up
+ */
+bool fuse_wake_init(struct fuse_wake *wake)
+{
+    assert(wake);
+    atomic_init(&wake->pending, false);
+    return true;
+}
+
+/** @brief Release resources for a wake-up
+ */
+void fuse_wake_destroy(struct fuse_wake *wake)
+{
+    assert(wake);
+}
+
+/** @brief Signal a wake-up
+ */
+void fuse_wake_signal(struct fuse_wake *wake)
+{
+    assert(wake);
+
+    // Set the flag, then send an event to both cores, which wakes a core waiting in WFE
+    // or makes its next WFE return immediately
+    atomic_store(&wake->pending, true);
+    __sev();
+}
+
+/** @brief Block until the wake-up is signalled or the timeout expires
+ */
+void fuse_wake_wait(struct fuse_wake *wake, uint32_t ms)
+{
+    assert(wake);
+
+    // Sleep in WFE until the flag is set or the timeout expires. WFE also returns for
+    // interrupts and events sent for other reasons, so check the flag each time
+    absolute_time_t timeout = make_timeout_time_ms(ms);
+    while (!atomic_exchange(&wake->pending, false))
+    {
+        if (best_effort_wfe_or_timeout(timeout))
+        {
+            return;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,26 @@
+/** @file worker.h
+ *  @brief Private function prototypes and structure definitions for worker threads
+ *
+ * Worker threads execute the events for core 0 in parallel. Each worker has a deque
+ * of events, which it fills with a batch from the event queue when it is empty,
+ * and a worker with no events steals the oldest event from another worker. Events
+ * with callbacks which are not thread-safe are passed to the first worker, which
+ * runs on the thread which called fuse_run, and is the only worker which drains
+ * released values. It only drains when no other worker is executing an event, and
+ * it waits on its own wake-up. Worker threads are only supported on Linux.
+ */
+#ifndef FUSE_PRIVATE_WORKER_H
+#define FUSE_PRIVATE_WORKER_H
+
+#include <fuse/fuse.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** @brief Run the event loop for core 0 on several workers, until the exit code is set
+ *
+ * @param self The fuse application
+ * @param workers The number of workers, including the calling thread
+ */
+void fuse_worker_run(fuse_t *self, size_t workers);
+
+#endif
@@ -0,0 +1,391 @@
+#if defined(TARGET_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#include <fuse/fuse.h>
+#include "deque.h"
+#include "event.h"
+#include "fuse.h"
+#include "lock.h"
+#include "ring.h"
+#include "wake.h"
+#include "worker.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// DECLARATIONS
+
+/** @brief Represents a worker
+ */
+struct fuse_worker
+{
+    struct fuse_workers *workers; ///< The workers
+    size_t index;                 ///< The index of the worker, which is zero for the calling thread
+    pthread_t thread;             ///< The thread, if the worker is not the calling thread
+    bool started;                 ///< True if the thread was started
+    struct fuse_deque deque;      ///< Events taken by the worker, which other workers can steal
+};
+
+/** @brief Represents the workers for the run loop
+ */
+struct fuse_workers
+{
+    fuse_t *self;                               ///< The fuse application
+    size_t count;                               ///< The number of workers
+    fuse_lock_t lock;                           ///< Lock for taking events from the event queue
+    struct fuse_ring pinned;                    ///< Events which are executed on the first worker
+    struct fuse_wake wake;                      ///< Wake-up for the first worker, when events are pinned or values can be drained
+    _Atomic size_t busy;                        ///< The number of other workers which are executing an event
+    _Atomic bool draining;                      ///< True while the first worker is trying to drain released values
+    struct fuse_worker worker[FUSE_WORKER_MAX]; ///< The workers
+};
+
+/** @brief Run the event loop for a worker
+ */
+static void fuse_worker_loop(struct fuse_worker *worker);
+
+/** @brief Thread entry point for a worker
+ */
+static void *fuse_worker_thread(void *arg);
+
+/** @brief Return the next event for a worker to execute
+ */
+static fuse_event_t *fuse_worker_next(struct fuse_worker *worker);
+
+/** @brief Take a batch of events from the event queue into the deque for a worker
+ */
+static bool fuse_worker_refill(struct fuse_worker *worker);
+
+/** @brief Pass an event to the first worker
+ */
+static void fuse_worker_pin(struct fuse_worker *worker, fuse_event_t *evt);
+
+/** @brief Execute an event on a worker, and release it
+ */
+static void fuse_worker_exec(struct fuse_worker *worker, fuse_event_t *evt);
+
+/** @brief Drain released values on the first worker, when no other worker is
+ *         executing an event
+ */
+static size_t fuse_worker_drain(struct fuse_worker *worker, size_t cap);
+
+///////////////////////////////////////////////////////////////////////////////
+// PUBLIC METHODS
+
+/** @brief Run the event loop for core 0 on several workers, until the exit code is set
+ */
+void fuse_worker_run(fuse_t *self, size_t workers)
+{
+    assert(self);
+    assert(workers > 0 && workers <= FUSE_WORKER_MAX);
+
+    // Set up the workers. Without a wake-up for the first worker, there is only one
+    // worker
+    struct fuse_workers state;
+    state.self = self;
+    state.count = fuse_wake_init(&state.wake) ? workers : 1;
+    atomic_init(&state.busy, 0);
+    atomic_init(&state.draining, false);
+    fuse_lock_init(&state.lock);
+    fuse_ring_init(&state.pinned);
+    for (size_t i = 0; i < workers; i++)
+    {
+        state.worker[i].workers = &state;
+        state.worker[i].index = i;
+        state.worker[i].started = false;
+        fuse_deque_init(&state.worker[i].deque);
+    }
+
+    // Start the threads for the additional workers, and run the first worker on the
+    // calling thread. A worker whose thread could not be started has an empty deque
+    workers = state.count;
+    fuse_debugf(self, "fuse_worker_run: starting %lu workers\n", workers);
+    for (size_t i = 1; i < workers; i++)
+    {
+        state.worker[i].started = (pthread_create(&state.worker[i].thread, NULL, fuse_worker_thread, &state.worker[i]) == 0);
+    }
+    fuse_worker_loop(&state.worker[0]);
+    for (size_t i = 1; i < workers; i++)
+    {
+        if (state.worker[i].started)
+        {
+            pthread_join(state.worker[i].thread, NULL);
+        }
+    }
+
+    // Release the events which were taken from the queue but not executed
+    fuse_event_t *evt;
+    for (size_t i = 0; i < workers; i++)
+    {
+        while ((evt = fuse_deque_steal(&state.worker[i].deque)) != NULL)
+        {
+            fuse_release_event(self, evt);
+        }
+    }
+    while ((evt = fuse_ring_pop(&state.pinned)) != NULL)
+    {
+        fuse_release_event(self, evt);
+    }
+    fuse_lock_destroy(&state.lock);
+    if (workers > 1)
+    {
+        fuse_wake_destroy(&state.wake);
+    }
+    fuse_debugf(self, "fuse_worker_run: exited the run loop (exit_code=%d)\n", self->exit_code);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PRIVATE METHODS
+
+/** @brief Thread entry point for a worker
+ */
+static void *fuse_worker_thread(void *arg)
+{
+    assert(arg);
+    fuse_worker_loop((struct fuse_worker *)arg);
+    return NULL;
+}
+
+/** @brief Run the event loop for a worker
+ */
+static void fuse_worker_loop(struct fuse_worker *worker)
+{
+    assert(worker);
+    fuse_t *self = worker->workers->self;
+
+    while (!self->exit_code)
+    {
+        // Execute a batch of events, until there are no events or the dispatch budget
+        // is reached
+        size_t executed = 0;
+        size_t limit = self->dispatch_events;
+        uint64_t start = self->dispatch_us ? fuse_clock_us() : 0;
+
+        // Only the first worker drains released values, so the other workers execute
+        // one event per batch when there is memory pressure
+        if (worker->index != 0 && fuse_allocator_pressure(self->allocator))
+        {
+            limit = 1;
+        }
+        while (!self->exit_code && executed < limit)
+        {
+            if (executed > 0 && self->dispatch_us && fuse_clock_us() - start >= self->dispatch_us)
+            {
+                break;
+            }
+            fuse_event_t *evt = fuse_worker_next(worker);
+            if (evt == NULL)
+            {
+                break;
+            }
+
+            // Pass the event to the first worker when a callback is not thread-safe
+            if (worker->index != 0 && !fuse_event_threadsafe(self, 0, evt))
+            {
+                fuse_worker_pin(worker, evt);
+                continue;
+            }
+
+            // Drain released values early when there is memory pressure
+            if (executed == 0 && worker->index == 0 && fuse_allocator_pressure(self->allocator))
+            {
+                fuse_worker_drain(worker, FUSE_DRAIN_PRESSURE);
+            }
+
+            // Call the event callbacks, then release the event
+            fuse_worker_exec(worker, evt);
+            executed++;
+        }
+
+        // Only the first worker drains released values, so the other workers wake it
+        // when they have executed events
+        size_t drained = 0;
+        if (worker->index == 0)
+        {
+            drained = fuse_worker_drain(worker, executed > 10 ? executed : 10);
+        }
+        else if (executed > 0)
+        {
+            fuse_wake_signal(&worker->workers->wake);
+        }
+
+        // Block until an event is queued, or the exit code is set. The first worker
+        // has its own wake-up, so that a wake-up for it is not taken by another worker
+        if (executed == 0 && drained == 0)
+        {
+            bool first = worker->index == 0 && worker->workers->count > 1;
+            fuse_wake_wait(first ? &worker->workers->wake : &self->wake[0], FUSE_RUNLOOP_IDLE);
+        }
+    }
+
+    // The wake-up is reset by the worker which receives it, so pass it on to the
+    // other workers so that they also exit
+    fuse_wake_signal(&self->wake[0]);
+    if (worker->workers->count > 1)
+    {
+        fuse_wake_signal(&worker->workers->wake);
+    }
+}
+
+/** @brief Execute an event on a worker, and release it
+ */
+static void fuse_worker_exec(struct fuse_worker *worker, fuse_event_t *evt)
+{
+    assert(worker);
+    assert(evt);
+    struct fuse_workers *workers = worker->workers;
+    fuse_t *self = workers->self;
+
+    // The first worker drains released values between events, so it cannot free
+    // values which its own callbacks use
+    if (worker->index == 0)
+    {
+        fuse_exec_event(self, 0, evt);
+        fuse_release_event(self, evt);
+        return;
+    }
+
+    // Other workers are counted as busy while they execute the event, so that the
+    // first worker does not drain values which the callbacks use. A worker which
+    // finds a drain in progress waits for it to finish
+    while (true)
+    {
+        atomic_fetch_add(&workers->busy, 1);
+        if (!atomic_load(&workers->draining))
+        {
+            break;
+        }
+        atomic_fetch_sub(&workers->busy, 1);
+        while (atomic_load(&workers->draining))
+        {
+            sched_yield();
+        }
+    }
+    fuse_exec_event(self, 0, evt);
+    fuse_release_event(self, evt);
+    atomic_fetch_sub(&workers->busy, 1);
+}
+
+/** @brief Drain released values on the first worker, when no other worker is
+ *         executing an event
+ */
+static size_t fuse_worker_drain(struct fuse_worker *worker, size_t cap)
+{
+    assert(worker);
+    assert(worker->index == 0);
+    struct fuse_workers *workers = worker->workers;
+
+    // Mark the drain before checking for busy workers, and a worker marks itself
+    // busy before checking for a drain, so that at least one of them sees the other.
+    // When a worker is busy the drain is skipped, and the worker wakes the first
+    // worker when it has finished
+    size_t drained = 0;
+    atomic_store(&workers->draining, true);
+    if (atomic_load(&workers->busy) == 0)
+    {
+        drained = fuse_drain(workers->self, cap);
+    }
+    atomic_store(&workers->draining, false);
+    return drained;
+}
+
+/** @brief Return the next event for a worker to execute
+ */
+static fuse_event_t *fuse_worker_next(struct fuse_worker *worker)
+{
+    assert(worker);
+    struct fuse_workers *workers = worker->workers;
+
+    // The first worker executes the events which were passed to it first
+    fuse_event_t *evt;
+    if (worker->index == 0 && (evt = fuse_ring_pop(&workers->pinned)) != NULL)
+    {
+        return evt;
+    }
+
+    // Take the oldest event from the deque for the worker, refilling it from the
+    // event queue when it is empty
+    if ((evt = fuse_deque_steal(&worker->deque)) != NULL)
+    {
+        return evt;
+    }
+    if (fuse_worker_refill(worker) && (evt = fuse_deque_steal(&worker->deque)) != NULL)
+    {
+        return evt;
+    }
+
+    // Steal an event from another worker
+    for (size_t i = 1; i < workers->count; i++)
+    {
+        struct fuse_worker *victim = &workers->worker[(worker->index + i) % workers->count];
+        if ((evt = fuse_deque_steal(&victim->deque)) != NULL)
+        {
+            return evt;
+        }
+    }
+
+    // There are no events
+    return NULL;
+}
+
+/** @brief Take a batch of events from the event queue into the deque for a worker
+ */
+static bool fuse_worker_refill(struct fuse_worker *worker)
+{
+    assert(worker);
+    struct fuse_workers *workers = worker->workers;
+    fuse_t *self = workers->self;
+
+    // Take events up to the dispatch budget, or the free space in the deque
+    size_t space = FUSE_DEQUE_SIZE - fuse_deque_count(&worker->deque);
+    size_t max = self->dispatch_events < space ? self->dispatch_events : space;
+    if (max == 0)
+    {
+        return false;
+    }
+
+    // Only one worker takes events from the event queue at a time
+    fuse_event_t *evt[FUSE_EVENT_DISPATCH_MAX];
+    fuse_lock_acquire(&workers->lock);
+    size_t count = fuse_take_events(self, 0, evt, max);
+    fuse_lock_release(&workers->lock);
+
+    // Only the owner pushes onto the deque, so there is space for the events
+    for (size_t i = 0; i < count; i++)
+    {
+        bool success = fuse_deque_push(&worker->deque, evt[i]);
+        assert(success);
+        (void)success;
+    }
+
+    // Wake idle workers so that they can steal from the batch
+    if (count > 1 && workers->count > 1)
+    {
+        fuse_wake_signal(&self->wake[0]);
+    }
+    return count > 0;
+}
+
+/** @brief Pass an event to the first worker
+ */
+static void fuse_worker_pin(struct fuse_worker *worker, fuse_event_t *evt)
+{
+    assert(worker);
+    assert(evt);
+    struct fuse_workers *workers = worker->workers;
+    fuse_t *self = workers->self;
+
+    // The first worker empties the ring before it executes any other event, so
+    // wait for a free slot when the ring is full
+    while (!fuse_ring_push(&workers->pinned, evt))
+    {
+        if (self->exit_code)
+        {
+            fuse_release_event(self, evt);
+            return;
+        }
+        fuse_wake_signal(&workers->wake);
+        sched_yield();
+    }
+    fuse_wake_signal(&workers->wake);
+}
+
+#endif
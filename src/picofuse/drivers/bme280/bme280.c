@@ -119,6 +119,7 @@ bool fuse_bme280_read(fuse_t *self, fuse_bme280_t *bme280, uint32_t periodic_ms)
     if (bme280->timer != NULL)
     {
         fuse_debugf(self, "fuse_bme280_read: cancelling existing timer\n");
+        fuse_unregister_callback(self, FUSE_EVENT_TIMER, 0, (fuse_value_t *)bme280->timer, fuse_bme280_timer_callback);
         fuse_timer_cancel(self, bme280->timer);
         bme280->timer = NULL;
     }
@@ -131,6 +132,15 @@ bool fuse_bme280_read(fuse_t *self, fuse_bme280_t *bme280, uint32_t periodic_ms)
         return false;
     }
 
+    // Set timer handler, only for this timer - on core 0
+    if (!fuse_register_source_callback(self, FUSE_EVENT_TIMER, 0, (fuse_value_t *)bme280->timer, fuse_bme280_timer_callback, bme280))
+    {
+        fuse_debugf(self, "fuse_bme280_read: could not register a timer callback\n");
+        fuse_timer_cancel(self, bme280->timer);
+        bme280->timer = NULL;
+        return false;
+    }
+
     // Return success
     return true;
 }
@@ -180,9 +190,6 @@ static bool fuse_bme280_init(fuse_t *self, fuse_value_t *value, const void *user
         return false;
     }
 
-    // Set timer handler - on core 0
-    fuse_register_callback(self, FUSE_EVENT_TIMER, 0, fuse_bme280_timer_callback);
-
     // Read the compensation parameters
     bme280_read_compensation_parameters(self, ctx);
 
@@ -206,6 +213,7 @@ static void fuse_bme280_destroy(fuse_t *self, fuse_value_t *value)
     // If there is a timer, then cancel it
     if (ctx->timer != NULL)
     {
+        fuse_unregister_callback(self, FUSE_EVENT_TIMER, 0, (fuse_value_t *)ctx->timer, fuse_bme280_timer_callback);
         fuse_timer_cancel(self, ctx->timer);
     }
 
@@ -220,11 +228,7 @@ static void fuse_bme280_timer_callback(fuse_t *self, fuse_event_t *evt, void *us
     assert(self);
     assert(evt);
 
-    // Get the BME280 context
-    if (fuse_value_type(self, user_data) != FUSE_MAGIC_BME280)
-    {
-        return;
-    }
+    assert(fuse_value_type(self, user_data) == FUSE_MAGIC_BME280);
 
     // Get the BME280 context
     fuse_bme280_t *ctx = (fuse_bme280_t *)user_data;
@@ -237,8 +241,10 @@ static void fuse_bme280_timer_callback(fuse_t *self, fuse_event_t *evt, void *us
         return;
     }
 
-    // Create the event with the measurement as the user_data
-    assert(fuse_new_event(self, (fuse_value_t *)ctx, FUSE_EVENT_BME280, measurement));
+    // Create the event with a copy of the measurement, which the callbacks receive
+    // as the user_data, so the next measurement cannot overwrite it. The event is dropped
+    // and counted if there is memory pressure
+    fuse_new_event_payload(self, (fuse_value_t *)ctx, FUSE_EVENT_BME280, measurement, sizeof(fuse_bme280_measurement_t));
 }
 
 /** @brief Append a JSON representation of the BME driver
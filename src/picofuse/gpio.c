@@ -264,7 +264,7 @@ static void fuse_gpio_callback(uint pin, uint32_t events)
     fuse_gpio_t *source = fuse_gpio_pin[pin];
     if (self && pin)
     {
-        fuse_event_t *evt = fuse_new_event(self, (fuse_value_t *)source, FUSE_EVENT_GPIO, (void *)events);
-        assert(evt);
+        // The event is dropped and counted if there is memory pressure
+        fuse_new_event(self, (fuse_value_t *)source, FUSE_EVENT_GPIO, (void *)events);
     }
 }
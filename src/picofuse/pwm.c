@@ -368,8 +368,9 @@ static inline void fuse_pwm_callback(fuse_t *self, fuse_pwm_t *pwm)
 {
     assert(self);
     assert(pwm);
-    fuse_event_t *evt = fuse_new_event(self, (fuse_value_t *)pwm, FUSE_EVENT_PWM, pwm);
-    assert(evt);
+
+    // The event is dropped and counted if there is memory pressure
+    fuse_new_event(self, (fuse_value_t *)pwm, FUSE_EVENT_PWM, pwm);
 }
 
 /** @brief PWM interrupt callback - wrap
@@ -66,8 +66,8 @@ static bool fuse_watchdog_init(fuse_t *self, fuse_value_t *value, const void *us
         return false;
     }
 
-    // Callback for timer event
-    bool success = fuse_register_callback(self, FUSE_EVENT_TIMER, 0, fuse_watchdog_callback);
+    // Callback for timer event, only for the watchdog timer
+    bool success = fuse_register_source_callback(self, FUSE_EVENT_TIMER, 0, (fuse_value_t *)watchdog->timer, fuse_watchdog_callback, watchdog);
     assert(success);
 
     // Enable the watchdog, requiring the watchdog to be updated by callback
@@ -90,6 +90,7 @@ static void fuse_watchdog_destroy(fuse_t *self, fuse_value_t *value)
     fuse_watchdog_t *watchdog = (fuse_watchdog_t *)value;
 
     // Cancel the timer
+    fuse_unregister_callback(self, FUSE_EVENT_TIMER, 0, (fuse_value_t *)watchdog->timer, fuse_watchdog_callback);
     fuse_timer_cancel(self, watchdog->timer);
 
     // Remove instance
@@ -1,6 +1,12 @@
 
 #include <fuse/fuse.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
+
+// Private headers, to check how memory blocks were allocated
+#include "alloc.h"
+#include "alloc_slab.h"
 
 void fuse_allocator_walk_callback(void *ptr, size_t size, uint16_t magic, const char *file, int line, void *data)
 {
@@ -8,6 +14,45 @@ void fuse_allocator_walk_callback(void *ptr, size_t size, uint16_t magic, const
     (*count)++;
 }
 
+/** @brief A fixed region of memory for the static allocator
+ */
+static uint8_t test_region[256 * 1024];
+
+static fuse_allocator_t *test_static_new(void)
+{
+    return fuse_allocator_static_new(test_region, sizeof(test_region));
+}
+
+/** @brief The allocators which are tested, and whether they use the fixed region
+ */
+static const struct
+{
+    const char *name;
+    fuse_allocator_t *(*new)(void);
+    bool region;
+} test_allocators[] = {
+    {"builtin", fuse_allocator_builtin_new, false},
+    {"slab", fuse_allocator_slab_new, false},
+    {"static", test_static_new, true},
+};
+
+/** @brief Run a test for each allocator
+ */
+static int test_each_allocator(int (*test)(fuse_allocator_t *allocator, bool region))
+{
+    for (size_t i = 0; i < sizeof(test_allocators) / sizeof(test_allocators[0]); i++)
+    {
+        printf("  %s allocator\n", test_allocators[i].name);
+        fuse_allocator_t *allocator = test_allocators[i].new();
+        assert(allocator);
+        if (test(allocator, test_allocators[i].region) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int TEST_001()
 {
     fuse_allocator_t *builtin = fuse_allocator_builtin_new();
@@ -44,10 +89,768 @@ int TEST_002()
     return 0;
 }
 
+int TEST_003()
+{
+    fuse_allocator_t *pool = fuse_allocator_slab_new();
+    assert(pool != NULL);
+
+    void *ptrs[1024];
+
+    // Create 1024 memory blocks, of varying sizes including large blocks
+    printf("Allocating 1024 slab memory blocks\n");
+    for (int i = 0; i < 1024; i++)
+    {
+        size_t size = (i % 2) ? i : (i % 64);
+        void *ptr = fuse_allocator_malloc(pool, size, 0xFF, __FILE__, __LINE__);
+        assert(ptr != NULL);
+        memset(ptr, 0xFF, size);
+        ptrs[i] = ptr;
+    }
+
+    // Free half the memory blocks, and allocate them again
+    printf("Reallocating 512 slab memory blocks\n");
+    for (int i = 0; i < 1024; i += 2)
+    {
+        fuse_allocator_free(pool, ptrs[i]);
+    }
+    for (int i = 0; i < 1024; i += 2)
+    {
+        ptrs[i] = fuse_allocator_malloc(pool, 16, 0xFF, __FILE__, __LINE__);
+        assert(ptrs[i] != NULL);
+    }
+
+    // Free 1024 memory blocks
+    printf("Free 1024 slab memory blocks\n");
+    for (int i = 0; i < 1024; i++)
+    {
+        fuse_allocator_free(pool, ptrs[i]);
+    }
+
+    // Destroy the pool
+    fuse_allocator_destroy(pool);
+    return 0;
+}
+
+int TEST_004()
+{
+    fuse_t *self = fuse_new_ex(fuse_allocator_slab_new());
+    assert(self != NULL);
+
+    // Create a list of values, and a large data value
+    printf("Creating values with slab allocator\n");
+    fuse_list_t *list = (fuse_list_t *)fuse_retain(self, fuse_new_list(self));
+    assert(list != NULL);
+    for (int i = 0; i < 1000; i++)
+    {
+        assert(fuse_list_append(self, list, fuse_new_u8(self, i)));
+    }
+    assert(fuse_list_append(self, list, fuse_new_data(self, 4096)));
+    assert(fuse_list_count(self, list) == 1001);
+
+    // Release the list, and destroy the application
+    fuse_release(self, list);
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_005()
+{
+    static uint8_t region[64 * 1024];
+    fuse_allocator_t *pool = fuse_allocator_static_new(region, sizeof(region));
+    assert(pool != NULL);
+
+    void *ptrs[1024];
+
+    // Allocate until the region is exhausted
+    printf("Allocating static memory blocks until exhausted\n");
+    int n = 0;
+    while (n < 1024)
+    {
+        void *ptr = fuse_allocator_malloc(pool, 100, 0xFF, __FILE__, __LINE__);
+        if (ptr == NULL)
+        {
+            break;
+        }
+        assert((void *)ptr >= (void *)region && (void *)ptr < (void *)region + sizeof(region));
+        ptrs[n++] = ptr;
+    }
+    assert(n > 0 && n < 1024);
+
+    // Blocks larger than the largest size class are not allocated
+    assert(fuse_allocator_malloc(pool, 16 * 1024, 0xFF, __FILE__, __LINE__) == NULL);
+
+    // Free all blocks, and allocate them again from the bins
+    printf("Reallocating %d static memory blocks\n", n);
+    for (int i = 0; i < n; i++)
+    {
+        fuse_allocator_free(pool, ptrs[i]);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        ptrs[i] = fuse_allocator_malloc(pool, 128, 0xFF, __FILE__, __LINE__);
+        assert(ptrs[i] != NULL);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        fuse_allocator_free(pool, ptrs[i]);
+    }
+
+    // Destroy the pool
+    fuse_allocator_destroy(pool);
+
+    // Create an application in the region
+    fuse_t *self = fuse_new_ex(fuse_allocator_static_new(region, sizeof(region)));
+    assert(self != NULL);
+    fuse_list_t *list = fuse_new_list(self);
+    for (int i = 0; i < 100; i++)
+    {
+        assert(fuse_list_append(self, list, fuse_new_u8(self, i)));
+    }
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_006()
+{
+    fuse_t *self = fuse_new();
+    assert(self != NULL);
+
+    // Create a retained list of values, and some autoreleased values
+    printf("Draining autoreleased values\n");
+    fuse_list_t *list = (fuse_list_t *)fuse_retain(self, fuse_new_list(self));
+    assert(list != NULL);
+    for (int i = 0; i < 10000; i++)
+    {
+        assert(fuse_list_append(self, list, fuse_new_u8(self, i)));
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        assert(fuse_new_u8(self, 100 + i));
+    }
+
+    // Only the autoreleased values are drained
+    assert(fuse_drain(self, 0) == 10);
+    assert(fuse_drain(self, 0) == 0);
+
+    // Releasing the list drains the list and its values in a single pass
+    fuse_release(self, list);
+    assert(fuse_drain(self, 0) == 10001);
+
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+struct test_007_context
+{
+    fuse_t *self;
+    fuse_value_t *shared;
+};
+
+void *TEST_007_thread(void *data)
+{
+    struct test_007_context *ctx = (struct test_007_context *)data;
+    for (int i = 0; i < 10000; i++)
+    {
+        fuse_retain(ctx->self, ctx->shared);
+        fuse_release(ctx->self, ctx->shared);
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+        fuse_value_t *value = fuse_retain(ctx->self, fuse_new_data(ctx->self, 1));
+        assert(value);
+        fuse_release(ctx->self, value);
+    }
+    return NULL;
+}
+
+void *TEST_007_held(void *data)
+{
+    // Values created on a thread which does not drain are held until released
+    return fuse_new_data((fuse_t *)data, 1);
+}
+
+int TEST_007()
+{
+    // Retain and release values from several threads at once
+    fuse_t *self = fuse_new_ex(fuse_allocator_slab_new());
+    assert(self);
+
+    struct test_007_context ctx = {
+        .self = self,
+        .shared = fuse_retain(self, fuse_new_data(self, 1)),
+    };
+    assert(ctx.shared);
+
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++)
+    {
+        assert(pthread_create(&threads[i], NULL, TEST_007_thread, &ctx) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    // The shared value is still retained, and each value released by the threads
+    // is drained exactly once
+    assert(fuse_drain(self, 0) == 4000);
+    fuse_release(self, ctx.shared);
+    assert(fuse_drain(self, 0) == 1);
+
+    // A value created on another thread is not drained before it is retained
+    pthread_t thread;
+    void *held = NULL;
+    assert(pthread_create(&thread, NULL, TEST_007_held, self) == 0);
+    assert(pthread_join(thread, &held) == 0);
+    assert(held);
+    assert(fuse_drain(self, 0) == 0);
+    assert(fuse_value_type(self, held) == FUSE_MAGIC_DATA);
+    fuse_retain(self, held);
+    fuse_release(self, held);
+    assert(fuse_drain(self, 0) == 1);
+
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+void *TEST_008_thread(void *data)
+{
+    fuse_allocator_t *allocator = (fuse_allocator_t *)data;
+    void *ptr[100];
+    for (int i = 0; i < 100; i++)
+    {
+        for (int j = 0; j < 100; j++)
+        {
+            ptr[j] = fuse_allocator_malloc(allocator, 1 + (i + j) % 300, 0, __FILE__, __LINE__);
+            assert(ptr[j]);
+        }
+        for (int j = 0; j < 100; j++)
+        {
+            fuse_allocator_free(allocator, ptr[j]);
+        }
+    }
+    return NULL;
+}
+
+int TEST_008()
+{
+    // Allocate and free memory blocks from more threads than there are magazines,
+    // so memory blocks move between the magazines and the depot
+    fuse_allocator_t *allocator = fuse_allocator_slab_new();
+    assert(allocator);
+
+    pthread_t threads[16];
+    for (int i = 0; i < 16; i++)
+    {
+        assert(pthread_create(&threads[i], NULL, TEST_008_thread, allocator) == 0);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    fuse_allocator_destroy(allocator);
+    return 0;
+}
+
+int TEST_009()
+{
+    // Report the number of bytes used for each value
+    fuse_t *self = fuse_new();
+    assert(self);
+
+    size_t cur0, u8cur0, listcur0;
+    size_t count0 = fuse_memcount(self, FUSE_MAGIC_ANY, &cur0);
+    size_t u8count0 = fuse_memcount(self, FUSE_MAGIC_U8, &u8cur0);
+    size_t listcount0 = fuse_memcount(self, FUSE_MAGIC_LIST, &listcur0);
+
+    // Small integers are shared values, which are stored in list nodes, so use
+    // values which are allocated
+    fuse_list_t *list = (fuse_list_t *)fuse_retain(self, fuse_new_list(self));
+    assert(list);
+    for (int i = 0; i < 1000; i++)
+    {
+        assert(fuse_list_append(self, list, (fuse_value_t *)fuse_new_u8(self, 100 + i % 100)));
+    }
+
+    // The counts for each type are exact, and add up to the total
+    size_t cur1, u8cur1, listcur1;
+    size_t count1 = fuse_memcount(self, FUSE_MAGIC_ANY, &cur1);
+    size_t u8count1 = fuse_memcount(self, FUSE_MAGIC_U8, &u8cur1);
+    size_t listcount1 = fuse_memcount(self, FUSE_MAGIC_LIST, &listcur1);
+    assert(count1 - count0 == 1001);
+    assert(u8count1 - u8count0 == 1000);
+    assert(listcount1 - listcount0 == 1);
+    assert(cur1 - cur0 == (u8cur1 - u8cur0) + (listcur1 - listcur0));
+
+    // Every U8 value uses the same number of bytes, which includes the header
+    assert((u8cur1 - u8cur0) % 1000 == 0);
+    size_t bytes = (u8cur1 - u8cur0) / 1000;
+    printf("TEST_009: %zu bytes for each U8 value\n", bytes);
+    assert(bytes > sizeof(uint8_t));
+
+    // Values which leave the list can be appended to another list
+    fuse_list_t *other = (fuse_list_t *)fuse_retain(self, fuse_new_list(self));
+    assert(other);
+    fuse_value_t *value;
+    while ((value = fuse_list_pop(self, list)) != NULL)
+    {
+        assert(fuse_list_append(self, other, value));
+    }
+    assert(fuse_list_count(self, other) == 1000);
+
+    fuse_release(self, list);
+    fuse_release(self, other);
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_010()
+{
+    // Profile allocations by type and allocation site
+    fuse_t *self = fuse_new();
+    assert(self);
+
+    fuse_list_t *list = (fuse_list_t *)fuse_retain(self, fuse_new_list(self));
+    assert(list);
+    for (int i = 0; i < 10; i++)
+    {
+        assert(fuse_list_append(self, list, (fuse_value_t *)fuse_new_u8(self, 100 + i)));
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        assert(fuse_list_pop(self, list));
+    }
+    assert(fuse_drain(self, 0) == 5);
+
+    // Serialize the profile
+    fuse_value_t *profile = (fuse_value_t *)fuse_new_profile(self);
+    assert(profile);
+    char buf[2048];
+    size_t n = vtostr(self, buf, sizeof(buf), profile, true);
+    assert(n < sizeof(buf));
+    printf("TEST_010: %s\n", buf);
+    assert(buf[0] == '{' && buf[n - 1] == '}');
+    assert(strstr(buf, "\"LIST\":{"));
+    assert(strstr(buf, "\"U8\":{"));
+#ifdef FUSE_PROFILE
+    assert(strstr(buf, "\"allocs\":10,\"frees\":5"));
+    assert(strstr(buf, "\"type\":\"U8\""));
+#endif
+
+    // Serialize the profile as text, with one line for each type
+    n = vtostr(self, buf, sizeof(buf), profile, false);
+    assert(n < sizeof(buf));
+    printf("TEST_010: %s\n", buf);
+    assert(strncmp(buf, "cur=", 4) == 0);
+    assert(strstr(buf, "\nU8 cur="));
+#ifdef FUSE_PROFILE
+    assert(strstr(buf, "allocs=10 frees=5"));
+    assert(strstr(buf, "main.c:") && strstr(buf, " U8 cur="));
+#endif
+
+    fuse_release(self, list);
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_011_allocator(fuse_allocator_t *allocator, bool region)
+{
+    (void)region;
+    assert(allocator);
+
+    // Allocate blocks of several sizes, including a large block
+    void *ptr[4];
+    size_t size[4] = {1, 100, 500, 8000};
+    for (int i = 0; i < 4; i++)
+    {
+        ptr[i] = fuse_allocator_malloc(allocator, size[i], 0, __FILE__, __LINE__);
+        assert(ptr[i]);
+    }
+
+    // Allocated blocks are valid, but not pointers into them or other memory
+    int local = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        assert(fuse_allocator_valid(allocator, ptr[i]));
+        assert(!fuse_allocator_valid(allocator, (char *)ptr[i] + 8));
+    }
+    assert(!fuse_allocator_valid(allocator, NULL));
+    assert(!fuse_allocator_valid(allocator, &local));
+    assert(!fuse_allocator_valid(allocator, (void *)TEST_011_allocator));
+
+    // Freed blocks are not valid
+    for (int i = 0; i < 4; i++)
+    {
+        fuse_allocator_free(allocator, ptr[i]);
+        assert(!fuse_allocator_valid(allocator, ptr[i]));
+    }
+
+    fuse_allocator_destroy(allocator);
+    return 0;
+}
+
+int TEST_011()
+{
+    // Validate arbitrary pointers for each allocator
+    assert(test_each_allocator(TEST_011_allocator) == 0);
+
+    // Check value types
+    fuse_t *self = fuse_new();
+    assert(self);
+    int local = 0;
+    fuse_value_t *value = (fuse_value_t *)fuse_new_u8(self, 1);
+    assert(fuse_value_type(self, value) == FUSE_MAGIC_U8);
+    assert(fuse_value_type(self, &local) == FUSE_MAGIC_NULL);
+    assert(fuse_value_type(self, NULL) == FUSE_MAGIC_NULL);
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_012()
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+
+    // NULL, true, false and small integers are shared, and are not allocated
+    printf("Shared values\n");
+    size_t count;
+    count = fuse_memcount(self, FUSE_MAGIC_ANY, NULL);
+    assert(fuse_new_null(self) == fuse_new_null(self));
+    assert(fuse_new_bool(self, true) == fuse_new_bool(self, true));
+    assert(fuse_new_bool(self, false) != fuse_new_bool(self, true));
+    assert(fuse_new_u8(self, 1) == fuse_new_u8(self, 1));
+    assert(fuse_new_u8(self, 200) != fuse_new_u8(self, 200));
+    size_t count2;
+    count2 = fuse_memcount(self, FUSE_MAGIC_ANY, NULL);
+    assert(count2 == count + 2);
+
+    // Retain and release do nothing, and shared values are never drained
+    fuse_value_t *value = fuse_retain(self, fuse_new_u8(self, 1));
+    fuse_release(self, value);
+    fuse_release(self, value);
+    assert(fuse_drain(self, 0) == 2);
+    assert(fuse_value_type(self, value) == FUSE_MAGIC_U8);
+    assert(*(uint8_t *)value == 1);
+
+    // Shared values are stored in list nodes, so the same value can be in a list
+    // more than once
+    fuse_list_t *list = (fuse_list_t *)fuse_retain(self, fuse_new_list(self));
+    assert(list);
+    fuse_value_t *elem = fuse_list_append(self, list, value);
+    assert(elem == value);
+    assert(fuse_list_append(self, list, value) == value);
+    assert(fuse_list_append(self, list, fuse_new_null(self)));
+    assert(fuse_list_count(self, list) == 3);
+    assert(fuse_list_next(self, list, NULL) == value);
+    assert(fuse_list_pop(self, list) == fuse_new_null(self));
+    fuse_release(self, list);
+    assert(fuse_drain(self, 0) == 4);
+    assert(fuse_value_type(self, value) == FUSE_MAGIC_U8);
+
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_013_allocator(fuse_allocator_t *allocator)
+{
+    fuse_t *self = fuse_new_ex(allocator);
+    assert(self);
+
+    // Allocate a batch of values, which are not shared
+    printf("Batch allocation\n");
+    static fuse_value_t *values[1000];
+    size_t count;
+    count = fuse_memcount(self, FUSE_MAGIC_ANY, NULL);
+    assert(fuse_new_values_batch(self, FUSE_MAGIC_U8, 1000, values));
+    size_t count2;
+    count2 = fuse_memcount(self, FUSE_MAGIC_ANY, NULL);
+    assert(count2 == count + 1000);
+    for (int i = 0; i < 1000; i++)
+    {
+        assert(fuse_value_type(self, values[i]) == FUSE_MAGIC_U8);
+        assert(*(uint8_t *)values[i] == 0);
+        *(uint8_t *)values[i] = (uint8_t)i;
+        fuse_retain(self, values[i]);
+    }
+
+    // Release the batch, including shared and immediate values
+    fuse_release(self, values[0]);
+    fuse_release(self, values[1]);
+    values[0] = fuse_new_null(self);
+    values[1] = fuse_new_imm_u8(self, 1);
+    fuse_release_batch(self, 1000, values);
+    assert(fuse_drain(self, 0) == 1000);
+    count2 = fuse_memcount(self, FUSE_MAGIC_ANY, NULL);
+    assert(count2 == count);
+
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_013()
+{
+    assert(TEST_013_allocator(fuse_allocator_builtin_new()) == 0);
+    assert(TEST_013_allocator(fuse_allocator_slab_new()) == 0);
+
+    // A batch which does not fit in a fixed region allocates nothing, and the memory
+    // blocks which were taken are available again
+    static char region[64 * 1024];
+    fuse_t *self = fuse_new_ex(fuse_allocator_static_new(region, sizeof(region)));
+    assert(self);
+    static fuse_value_t *values[1000];
+    size_t count = fuse_memcount(self, FUSE_MAGIC_ANY, NULL);
+    assert(!fuse_new_values_batch(self, FUSE_MAGIC_U8, 1000, values));
+    assert(fuse_memcount(self, FUSE_MAGIC_ANY, NULL) == count);
+    assert(fuse_new_values_batch(self, FUSE_MAGIC_U8, 100, values));
+    assert(fuse_memcount(self, FUSE_MAGIC_ANY, NULL) == count + 100);
+    assert(fuse_drain(self, 0) == 100);
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_014_allocator(fuse_allocator_t *allocator, bool region)
+{
+    (void)region;
+    fuse_t *self = fuse_new_ex(allocator);
+    assert(self);
+
+    // Grow a data value one byte at a time, which only moves it occasionally
+    fuse_value_t *data = fuse_retain(self, fuse_new_data(self, 1));
+    assert(data);
+    ((uint8_t *)data)[0] = 0;
+    size_t moves = 0;
+    for (size_t i = 1; i < 2000; i++)
+    {
+        fuse_value_t *resized = fuse_data_resize(self, data, i + 1);
+        assert(resized);
+        assert(fuse_value_type(self, resized) == FUSE_MAGIC_DATA);
+        assert(((uint8_t *)resized)[i] == 0);
+        if (resized != data)
+        {
+            fuse_retain(self, resized);
+            fuse_release(self, data);
+            data = resized;
+            moves++;
+        }
+        ((uint8_t *)data)[i] = (uint8_t)i;
+    }
+    printf("TEST_014: %lu moves for 2000 bytes\n", moves);
+    assert(moves < 20);
+
+    // The memory statistics account for the capacity which was reserved, rather
+    // than the size
+    fuse_drain(self, 0);
+    size_t bytes;
+    assert(fuse_memcount(self, FUSE_MAGIC_DATA, &bytes) == 1);
+    assert(bytes >= 2048);
+    for (size_t i = 0; i < 2000; i++)
+    {
+        assert(((uint8_t *)data)[i] == (uint8_t)i);
+    }
+
+    // Shrink the data value, and check the memory statistics
+    size_t cur;
+    fuse_memstats(self, &cur, NULL);
+    fuse_value_t *resized = fuse_data_resize(self, data, 1000);
+    assert(resized);
+    if (resized != data)
+    {
+        fuse_retain(self, resized);
+        fuse_release(self, data);
+        data = resized;
+    }
+    fuse_drain(self, 0);
+    size_t cur2;
+    fuse_memstats(self, &cur2, NULL);
+    assert(cur2 < cur);
+
+    fuse_release(self, data);
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_014()
+{
+    printf("Resizing data values\n");
+    assert(test_each_allocator(TEST_014_allocator) == 0);
+    return 0;
+}
+
+int TEST_015_allocator(fuse_allocator_t *allocator, bool region)
+{
+    bool large = !region;
+    fuse_t *self = fuse_new_ex(allocator);
+    assert(self);
+
+    // Allocate aligned data values of several sizes
+    size_t align[] = {16, 32, 64};
+    size_t size[] = {1, 100, 5000};
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            fuse_value_t *data = fuse_new_data_aligned(self, size[j], align[i]);
+            if (!large)
+            {
+                // The static allocator cannot align memory blocks
+                assert(data == NULL);
+                continue;
+            }
+            assert(data);
+            assert(((uintptr_t)data & (align[i] - 1)) == 0);
+            assert(fuse_value_type(self, data) == FUSE_MAGIC_DATA);
+            memset(data, 0xFF, size[j]);
+
+            // Resizing the data keeps the alignment
+            fuse_value_t *resized = fuse_data_resize(self, data, size[j] * 4);
+            assert(resized);
+            assert(((uintptr_t)resized & (align[i] - 1)) == 0);
+            assert(((uint8_t *)resized)[size[j] - 1] == 0xFF);
+        }
+    }
+
+    // Allocate a large data value, which is mapped on Linux
+    if (large)
+    {
+        fuse_allocator_set_mmap(allocator, 64 * 1024, FUSE_ALLOCATOR_MMAP_POPULATE);
+        fuse_value_t *data = fuse_new_data_aligned(self, 4 * 1024 * 1024, 64);
+        assert(data);
+        assert(((uintptr_t)data & 63) == 0);
+        memset(data, 0xFF, 4 * 1024 * 1024);
+        assert(fuse_allocator_valid(allocator, data));
+#if defined(__linux__)
+        assert(FUSE_ALLOCATOR_HEADER(data)->flags & FUSE_ALLOCATOR_FLAG_MMAP);
+#endif
+        assert(fuse_new_data(self, 128 * 1024));
+
+        // A mapping which is advised to use hugepages is aligned to a hugepage
+        fuse_allocator_set_mmap(allocator, 64 * 1024, FUSE_ALLOCATOR_MMAP_POPULATE | FUSE_ALLOCATOR_MMAP_HUGEPAGE);
+        data = fuse_new_data(self, 3 * 1024 * 1024);
+        assert(data);
+        memset(data, 0xFF, 3 * 1024 * 1024);
+#if defined(__linux__)
+        struct fuse_allocator_header *block = FUSE_ALLOCATOR_HEADER(data);
+        assert(block->flags & FUSE_ALLOCATOR_FLAG_MMAP);
+        struct fuse_allocator_prefix *prefix = (struct fuse_allocator_prefix *)block - 1;
+        assert(((uintptr_t)prefix->base & (FUSE_ALLOCATOR_HUGEPAGE - 1)) == 0);
+        assert((prefix->length & (FUSE_ALLOCATOR_HUGEPAGE - 1)) == 0);
+#endif
+    }
+
+    assert(fuse_drain(self, 0) > 0 || !large);
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_015()
+{
+    printf("Aligned data values\n");
+    assert(test_each_allocator(TEST_015_allocator) == 0);
+    return 0;
+}
+
+/** @brief The memory blocks of the values destroyed by TEST_016_destroy
+ */
+static void *TEST_016_blocks[4];
+static size_t TEST_016_count;
+
+/** @brief Destroy a value, and allocate another value while the application is being
+ *         destroyed, which is drained in the same pass
+ */
+static void TEST_016_destroy(fuse_t *self, fuse_value_t *value)
+{
+    assert(TEST_016_count < 4);
+    TEST_016_blocks[TEST_016_count++] = value;
+    if (TEST_016_count < 4)
+    {
+        assert(fuse_new_value_ex(self, FUSE_MAGIC_WATCHDOG, NULL, __FILE__, __LINE__));
+    }
+}
+
+int TEST_016_allocator(fuse_allocator_t *allocator, bool region)
+{
+    size_t depth = region ? 100 : 1000;
+    size_t width = 8;
+    fuse_t *self = fuse_new_ex(allocator);
+    assert(self);
+
+    // Create a deep list of lists, each with some data values, which is only
+    // released when the application is destroyed
+    fuse_list_t *root = (fuse_list_t *)fuse_new_list(self);
+    assert(root);
+    fuse_list_t *list = root;
+    for (size_t i = 0; i < depth; i++)
+    {
+        for (size_t j = 0; j < width; j++)
+        {
+            assert(fuse_list_append(self, list, fuse_new_data(self, 16 + j)));
+        }
+        fuse_list_t *child = (fuse_list_t *)fuse_new_list(self);
+        assert(child);
+        assert(fuse_list_append(self, list, (fuse_value_t *)child));
+        list = child;
+    }
+
+    // Register a type, which is not otherwise registered on this target, whose
+    // destroy callback allocates values. No other value in this test has the same
+    // size class, so a freed memory block would be the next one reused
+    assert(!fuse_is_registered_value(self, FUSE_MAGIC_WATCHDOG));
+    fuse_value_desc_t type = {
+        .size = 256,
+        .name = "TEST_016",
+        .destroy = TEST_016_destroy,
+    };
+    fuse_register_value_type(self, FUSE_MAGIC_WATCHDOG, type);
+    TEST_016_count = 0;
+    assert(fuse_new_value_ex(self, FUSE_MAGIC_WATCHDOG, NULL, __FILE__, __LINE__));
+
+    // All the values are released in one pass, without leaks, including the values
+    // allocated by the destroy callbacks
+    bool wholesale = allocator->malloc == fuse_allocator_slab_malloc;
+    assert(fuse_destroy(self) == 0);
+    assert(TEST_016_count == 4);
+
+    // The slab and static allocators release their memory wholesale, so memory blocks
+    // freed during the teardown are not reused by the values allocated after them
+    if (wholesale)
+    {
+        for (size_t i = 0; i < 4; i++)
+        {
+            for (size_t j = i + 1; j < 4; j++)
+            {
+                assert(TEST_016_blocks[i] != TEST_016_blocks[j]);
+            }
+        }
+    }
+    return 0;
+}
+
+int TEST_016()
+{
+    printf("Tearing down nested values\n");
+    assert(test_each_allocator(TEST_016_allocator) == 0);
+    return 0;
+}
+
 int main()
 {
     assert(TEST_001() == 0);
     assert(TEST_002() == 0);
+    assert(TEST_003() == 0);
+    assert(TEST_004() == 0);
+    assert(TEST_005() == 0);
+    assert(TEST_006() == 0);
+    assert(TEST_007() == 0);
+    assert(TEST_008() == 0);
+    assert(TEST_009() == 0);
+    assert(TEST_010() == 0);
+    assert(TEST_011() == 0);
+    assert(TEST_012() == 0);
+    assert(TEST_013() == 0);
+    assert(TEST_014() == 0);
+    assert(TEST_015() == 0);
+    assert(TEST_016() == 0);
 
     // Return success
     return 0;
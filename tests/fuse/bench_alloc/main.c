@@ -0,0 +1,440 @@
+#include <fuse/fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+ * Allocator micro-benchmarks
+ *
+ * Each workload is run against every allocator backend, and one JSON object is
+ * written to stdout for each run, so the results can be compared with jq or
+ * loaded into a spreadsheet. The first argument is a scale factor for the number
+ * of operations (default 1).
+ *
+ * Each run is made in a child process, because the peak resident set size of a
+ * process never decreases. The peak_rss_kb reported for a run is then the peak
+ * for that run alone, and can be compared across backends.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+// DECLARATIONS
+
+#define BENCH_OPS 100000                  ///< The number of operations in each workload, before scaling
+#define BENCH_REGION (32 * 1024 * 1024)   ///< The size of the region for the static allocator
+#define BENCH_DATA_MAX 8192               ///< The largest DATA buffer, which the static allocator can allocate
+
+/** @brief Represents an allocator backend
+ */
+struct bench_backend
+{
+    const char *name;
+    fuse_allocator_t *(*new)(void);
+};
+
+/** @brief Represents the result of a workload
+ */
+struct bench_result
+{
+    size_t ops;   ///< The number of operations
+    size_t fails; ///< The number of operations which could not allocate memory
+    double ns;    ///< The elapsed time, in nanoseconds
+};
+
+/** @brief Represents a workload, which is run against a backend in a child process
+ */
+struct bench_workload
+{
+    const char *name;
+    size_t param;
+    void (*run)(const struct bench_backend *backend, size_t param, size_t n);
+};
+
+static uint8_t bench_region[BENCH_REGION];
+
+///////////////////////////////////////////////////////////////////////////////
+// BACKENDS
+
+static fuse_allocator_t *bench_builtin_new(void)
+{
+    return fuse_allocator_builtin_new();
+}
+
+static fuse_allocator_t *bench_slab_new(void)
+{
+    return fuse_allocator_slab_new();
+}
+
+static fuse_allocator_t *bench_static_new(void)
+{
+    return fuse_allocator_static_new(bench_region, sizeof(bench_region));
+}
+
+static struct bench_backend bench_backends[] = {
+    {"builtin", bench_builtin_new},
+    {"slab", bench_slab_new},
+    {"static", bench_static_new},
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// UTILITIES
+
+/** @brief Return a monotonic time in nanoseconds
+ */
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/** @brief Return the peak resident set size of the process, in kilobytes
+ *
+ * The peak is only for one run, as each run is made in its own child process.
+ */
+static long bench_peak_rss(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#if defined(TARGET_DARWIN)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+/** @brief A small deterministic random number generator, so runs are comparable
+ */
+static uint32_t bench_rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/** @brief Write one result as a JSON object
+ */
+static void bench_report(fuse_t *self, const char *backend, const char *workload, size_t param, struct bench_result *result)
+{
+    size_t max = 0;
+    fuse_memstats(self, NULL, &max);
+    double secs = result->ns / 1e9;
+    printf("{\"backend\":\"%s\",\"workload\":\"%s\",\"param\":%lu,\"ops\":%lu,\"fails\":%lu,\"ns\":%.0f,\"ops_per_sec\":%.0f,\"ns_per_op\":%.1f,\"max_bytes\":%lu,\"peak_rss_kb\":%ld}\n",
+           backend, workload, param, result->ops, result->fails, result->ns,
+           secs > 0 ? (double)result->ops / secs : 0.0,
+           result->ops > 0 ? result->ns / (double)result->ops : 0.0,
+           max, bench_peak_rss());
+    fflush(stdout);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// WORKLOADS
+
+/** @brief Allocate memory blocks of mixed sizes, then free them
+ */
+static void bench_malloc_free(fuse_allocator_t *allocator, size_t n, struct bench_result *alloc, struct bench_result *freed)
+{
+    void **ptrs = calloc(n, sizeof(void *));
+    uint32_t state = 1;
+
+    double start = bench_now();
+    for (size_t i = 0; i < n; i++)
+    {
+        // Mostly small blocks, with the occasional larger one
+        size_t size = (bench_rand(&state) % 16 == 0) ? 1024 : 8 + (bench_rand(&state) % 120);
+        ptrs[i] = fuse_allocator_malloc(allocator, size, FUSE_MAGIC_DATA, __FILE__, __LINE__);
+        if (ptrs[i] == NULL)
+        {
+            alloc->fails++;
+        }
+    }
+    alloc->ns = bench_now() - start;
+    alloc->ops = n;
+
+    start = bench_now();
+    for (size_t i = 0; i < n; i++)
+    {
+        if (ptrs[i] != NULL)
+        {
+            fuse_allocator_free(allocator, ptrs[i]);
+        }
+    }
+    freed->ns = bench_now() - start;
+    freed->ops = n - alloc->fails;
+    free(ptrs);
+}
+
+/** @brief Retain and release a single value
+ */
+static void bench_retain_release(fuse_t *self, size_t n, struct bench_result *result)
+{
+    fuse_value_t *value = fuse_retain(self, fuse_new_data(self, 16));
+    double start = bench_now();
+    for (size_t i = 0; i < n; i++)
+    {
+        fuse_retain(self, value);
+        fuse_release(self, value);
+    }
+    result->ns = bench_now() - start;
+    result->ops = n;
+    fuse_release(self, value);
+    fuse_drain(self, 0);
+}
+
+/** @brief Drain a fixed number of released values, with a number of live values in the heap
+ */
+static void bench_drain(fuse_t *self, size_t live, size_t n, struct bench_result *result)
+{
+    fuse_value_t **values = calloc(live, sizeof(fuse_value_t *));
+    for (size_t i = 0; i < live; i++)
+    {
+        values[i] = fuse_retain(self, fuse_new_data(self, 16));
+        if (values[i] == NULL)
+        {
+            result->fails++;
+        }
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        if (fuse_new_data(self, 16) == NULL)
+        {
+            result->fails++;
+        }
+    }
+
+    double start = bench_now();
+    result->ops = fuse_drain(self, 0);
+    result->ns = bench_now() - start;
+
+    for (size_t i = 0; i < live; i++)
+    {
+        if (values[i] != NULL)
+        {
+            fuse_release(self, values[i]);
+        }
+    }
+    fuse_drain(self, 0);
+    free(values);
+}
+
+/** @brief Create events, take them from the queue and drain them
+ */
+static void bench_event_churn(fuse_t *self, size_t n, struct bench_result *result)
+{
+    double start = bench_now();
+    for (size_t i = 0; i < n; i++)
+    {
+        fuse_value_t *data = fuse_new_data(self, 32);
+        if (data == NULL || fuse_new_event(self, data, FUSE_EVENT_NULL, NULL) == NULL)
+        {
+            result->fails++;
+        }
+        while (fuse_next_event(self, 0))
+        {
+            // Discard the event
+        }
+        if (i % 64 == 63)
+        {
+            fuse_drain(self, 0);
+        }
+    }
+    fuse_drain(self, 0);
+    result->ns = bench_now() - start;
+    result->ops = n;
+}
+
+/** @brief Build lists of values and release them
+ */
+static void bench_list_build(fuse_t *self, size_t n, size_t width, struct bench_result *result)
+{
+    double start = bench_now();
+    size_t ops = 0;
+    while (ops < n)
+    {
+        fuse_list_t *list = (fuse_list_t *)fuse_new_list(self);
+        if (list == NULL)
+        {
+            result->fails++;
+            break;
+        }
+        for (size_t i = 0; i < width; i++, ops++)
+        {
+            fuse_value_t *value = (i % 2) ? fuse_new_data(self, 8) : fuse_new_u8(self, i);
+            if (value == NULL || fuse_list_append(self, list, value) == NULL)
+            {
+                result->fails++;
+            }
+        }
+        fuse_drain(self, 0);
+    }
+    result->ns = bench_now() - start;
+    result->ops = ops;
+}
+
+/** @brief Allocate and grow DATA buffers of random sizes
+ */
+static void bench_data_buffers(fuse_t *self, size_t n, struct bench_result *result)
+{
+    uint32_t state = 1;
+    double start = bench_now();
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t size = 1 + bench_rand(&state) % (BENCH_DATA_MAX / 2);
+        fuse_value_t *data = fuse_new_data(self, size);
+        if (data == NULL)
+        {
+            result->fails++;
+            continue;
+        }
+        memset(data, 0, size);
+        if (fuse_data_resize(self, data, size * 2) == NULL)
+        {
+            result->fails++;
+        }
+        if (i % 64 == 63)
+        {
+            fuse_drain(self, 0);
+        }
+    }
+    fuse_drain(self, 0);
+    result->ns = bench_now() - start;
+    result->ops = n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RUNS
+
+/** @brief Raw allocator throughput
+ */
+static void bench_run_malloc(const struct bench_backend *backend, size_t param, size_t n)
+{
+    fuse_allocator_t *allocator = backend->new();
+    assert(allocator);
+    fuse_t *self = fuse_new_ex(allocator);
+    assert(self);
+    struct bench_result alloc = {0}, freed = {0};
+    bench_malloc_free(allocator, n, &alloc, &freed);
+    bench_report(self, backend->name, "malloc", param, &alloc);
+    bench_report(self, backend->name, "free", param, &freed);
+    fuse_destroy(self);
+}
+
+/** @brief Reference counting
+ */
+static void bench_run_retain_release(const struct bench_backend *backend, size_t param, size_t n)
+{
+    fuse_t *self = fuse_new_ex(backend->new());
+    assert(self);
+    struct bench_result result = {0};
+    bench_retain_release(self, n, &result);
+    bench_report(self, backend->name, "retain_release", param, &result);
+    fuse_destroy(self);
+}
+
+/** @brief Drain cost against the number of live values in the heap
+ */
+static void bench_run_drain(const struct bench_backend *backend, size_t param, size_t n)
+{
+    (void)n;
+    fuse_t *self = fuse_new_ex(backend->new());
+    assert(self);
+    struct bench_result result = {0};
+    bench_drain(self, param, 10000, &result);
+    bench_report(self, backend->name, "drain", param, &result);
+    fuse_destroy(self);
+}
+
+/** @brief Event churn
+ */
+static void bench_run_event_churn(const struct bench_backend *backend, size_t param, size_t n)
+{
+    fuse_t *self = fuse_new_ex(backend->new());
+    assert(self);
+    struct bench_result result = {0};
+    bench_event_churn(self, n, &result);
+    bench_report(self, backend->name, "event_churn", param, &result);
+    fuse_destroy(self);
+}
+
+/** @brief Building lists
+ */
+static void bench_run_list_build(const struct bench_backend *backend, size_t param, size_t n)
+{
+    fuse_t *self = fuse_new_ex(backend->new());
+    assert(self);
+    struct bench_result result = {0};
+    bench_list_build(self, n, param, &result);
+    bench_report(self, backend->name, "list_build", param, &result);
+    fuse_destroy(self);
+}
+
+/** @brief DATA buffers
+ */
+static void bench_run_data_buffers(const struct bench_backend *backend, size_t param, size_t n)
+{
+    fuse_t *self = fuse_new_ex(backend->new());
+    assert(self);
+    struct bench_result result = {0};
+    bench_data_buffers(self, n, &result);
+    bench_report(self, backend->name, "data_buffers", param, &result);
+    fuse_destroy(self);
+}
+
+static struct bench_workload bench_workloads[] = {
+    {"malloc", 0, bench_run_malloc},
+    {"retain_release", 0, bench_run_retain_release},
+    {"drain", 1000, bench_run_drain},
+    {"drain", 10000, bench_run_drain},
+    {"drain", 100000, bench_run_drain},
+    {"event_churn", 0, bench_run_event_churn},
+    {"list_build", 100, bench_run_list_build},
+    {"data_buffers", BENCH_DATA_MAX, bench_run_data_buffers},
+};
+
+/** @brief Run a workload against a backend in a child process, and wait for it
+ */
+static void bench_run(const struct bench_backend *backend, const struct bench_workload *workload, size_t n)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        fprintf(stderr, "bench_alloc: cannot fork for %s/%s\n", backend->name, workload->name);
+        return;
+    }
+    if (pid == 0)
+    {
+        workload->run(backend, workload->param, n);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "bench_alloc: %s/%s failed\n", backend->name, workload->name);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MAIN
+
+int main(int argc, char **argv)
+{
+    size_t scale = (argc > 1) ? (size_t)atoi(argv[1]) : 1;
+    size_t n = BENCH_OPS * (scale > 0 ? scale : 1);
+
+    for (size_t b = 0; b < sizeof(bench_backends) / sizeof(bench_backends[0]); b++)
+    {
+        for (size_t w = 0; w < sizeof(bench_workloads) / sizeof(bench_workloads[0]); w++)
+        {
+            bench_run(&bench_backends[b], &bench_workloads[w], n);
+        }
+    }
+    return 0;
+}
@@ -1,5 +1,9 @@
 #include <fuse/fuse.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <time.h>
 
 int TEST_001(fuse_t *self)
 {
@@ -18,10 +22,778 @@ int TEST_001(fuse_t *self)
     return 0;
 }
 
+int TEST_002()
+{
+    fuse_allocator_t *allocator = fuse_allocator_builtin_new();
+    fuse_t *self = fuse_new_ex(allocator);
+    assert(self);
+    fuse_debugf(self, "TEST_002 event memory budget\n");
+
+    // Set a budget with room for some events above the high watermark
+    size_t cur;
+    fuse_memstats(self, &cur, NULL);
+    fuse_allocator_set_budget(allocator, cur + 4096, cur + 1024);
+
+    // Events are created until the budget is exhausted, and then dropped
+    size_t created = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        if (fuse_new_event(self, (fuse_value_t *)self, FUSE_EVENT_NULL, NULL))
+        {
+            created++;
+        }
+    }
+    fuse_debugf(self, "  created=%lu dropped=%lu\n", created, fuse_event_drops(self, FUSE_EVENT_NULL));
+    assert(created > 0 && created < 1000);
+    assert(fuse_event_drops(self, FUSE_EVENT_NULL) == 1000 - created);
+    assert(fuse_alloc(self, FUSE_MAGIC_DATA, (void *)4096) == NULL);
+
+    // Above the high watermark, low-priority events are shed
+    fuse_set_event_policy(self, FUSE_EVENT_POLICY_SHED, 1 << FUSE_EVENT_TIMER);
+    while (fuse_next_event(self, 0))
+    {
+        fuse_drain(self, 0);
+    }
+    fuse_drain(self, 0);
+    for (int i = 0; i < 1000; i++)
+    {
+        fuse_new_event(self, (fuse_value_t *)self, FUSE_EVENT_TIMER, NULL);
+    }
+    size_t shed = fuse_event_drops(self, FUSE_EVENT_TIMER);
+    assert(shed > 0 && shed < 1000);
+    assert(fuse_new_event(self, (fuse_value_t *)self, FUSE_EVENT_NULL, NULL));
+
+    // Above the high watermark, all events are rejected
+    fuse_set_event_policy(self, FUSE_EVENT_POLICY_REJECT, 0);
+    size_t drops = fuse_event_drops(self, FUSE_EVENT_NULL);
+    assert(fuse_new_event(self, (fuse_value_t *)self, FUSE_EVENT_NULL, NULL) == NULL);
+    assert(fuse_event_drops(self, FUSE_EVENT_NULL) == drops + 1);
+
+    // Empty the queue and remove the budget
+    while (fuse_next_event(self, 0))
+    {
+        fuse_drain(self, 0);
+    }
+    fuse_drain(self, 0);
+    fuse_allocator_set_budget(allocator, 0, 0);
+    fuse_set_event_policy(self, FUSE_EVENT_POLICY_ACCEPT, 0);
+
+    // Return success
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+#define TEST_003_PRODUCERS 4
+#define TEST_003_EVENTS 20000
+
+struct TEST_003_producer
+{
+    fuse_t *self;
+    uintptr_t id;
+};
+
+static uintptr_t TEST_003_last[TEST_003_PRODUCERS];
+
+void *TEST_003_produce(void *arg)
+{
+    struct TEST_003_producer *producer = arg;
+    for (uintptr_t i = 1; i <= TEST_003_EVENTS; i++)
+    {
+        // Retry when the event queue is full
+        while (fuse_new_event(producer->self, (fuse_value_t *)producer->self, FUSE_EVENT_NULL, (void *)((producer->id << 24) | i)) == NULL)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void TEST_003_consume(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    uintptr_t p = (uintptr_t)user_data >> 24;
+    assert(p < TEST_003_PRODUCERS);
+    assert(((uintptr_t)user_data & 0xFFFFFF) == TEST_003_last[p] + 1);
+    TEST_003_last[p]++;
+}
+
+int TEST_003()
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+    fuse_debugf(self, "TEST_003 event queue with several producers\n");
+
+    // The queue is bounded, so events are dropped when it is full
+    size_t created = 0;
+    while (fuse_new_event(self, (fuse_value_t *)self, FUSE_EVENT_NULL, NULL) != NULL)
+    {
+        created++;
+    }
+    assert(created > 0);
+    assert(fuse_event_drops(self, FUSE_EVENT_NULL) == 1);
+    while (fuse_next_event(self, 0))
+    {
+        created--;
+    }
+    assert(created == 0);
+    fuse_drain(self, 0);
+
+    // Start the producers
+    pthread_t threads[TEST_003_PRODUCERS];
+    struct TEST_003_producer producers[TEST_003_PRODUCERS];
+    for (uintptr_t p = 0; p < TEST_003_PRODUCERS; p++)
+    {
+        producers[p] = (struct TEST_003_producer){self, p};
+        assert(pthread_create(&threads[p], NULL, TEST_003_produce, &producers[p]) == 0);
+    }
+
+    // Consume the events, which are in order for each producer
+    assert(fuse_register_callback(self, FUSE_EVENT_NULL, 0, TEST_003_consume));
+    size_t consumed = 0;
+    while (consumed < TEST_003_PRODUCERS * TEST_003_EVENTS)
+    {
+        fuse_event_t *evt = fuse_next_event(self, 0);
+        if (evt == NULL)
+        {
+            fuse_drain(self, TEST_003_EVENTS);
+            continue;
+        }
+        fuse_exec_event(self, 0, evt);
+        consumed++;
+    }
+    for (size_t p = 0; p < TEST_003_PRODUCERS; p++)
+    {
+        assert(pthread_join(threads[p], NULL) == 0);
+    }
+    fuse_debugf(self, "  consumed=%lu dropped=%lu\n", consumed, fuse_event_drops(self, FUSE_EVENT_NULL));
+    assert(fuse_next_event(self, 0) == NULL);
+
+    // Return success
+    fuse_drain(self, 0);
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+#define TEST_004_EVENTS 10
+
+static double TEST_004_sent[TEST_004_EVENTS];
+static double TEST_004_latency[TEST_004_EVENTS];
+static int TEST_004_received;
+static pthread_t TEST_004_thread;
+
+double TEST_004_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+void *TEST_004_produce(void *arg)
+{
+    fuse_t *self = arg;
+    for (int i = 0; i < TEST_004_EVENTS; i++)
+    {
+        // Wait long enough for the run loop to be idle, then send an event
+        sleep_ms(20);
+        TEST_004_sent[i] = TEST_004_now();
+        assert(fuse_new_event(self, (fuse_value_t *)self, FUSE_EVENT_NULL, (void *)(uintptr_t)i));
+    }
+    return NULL;
+}
+
+void TEST_004_consume(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    uintptr_t i = (uintptr_t)user_data;
+    assert(i == (uintptr_t)TEST_004_received);
+    TEST_004_latency[TEST_004_received++] = TEST_004_now() - TEST_004_sent[i];
+    if (TEST_004_received == TEST_004_EVENTS)
+    {
+        fuse_exit(self, 0);
+    }
+}
+
+int TEST_004_run(fuse_t *self)
+{
+    assert(fuse_register_callback(self, FUSE_EVENT_NULL, 0, TEST_004_consume));
+    assert(pthread_create(&TEST_004_thread, NULL, TEST_004_produce, self) == 0);
+    return 0;
+}
+
+int TEST_004()
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+    fuse_debugf(self, "TEST_004 run loop wakes up for each event\n");
+
+    // The run loop blocks until each event is queued, rather than polling
+    fuse_run(self, TEST_004_run);
+    assert(pthread_join(TEST_004_thread, NULL) == 0);
+    double total = 0;
+    for (int i = 0; i < TEST_004_EVENTS; i++)
+    {
+        total += TEST_004_latency[i];
+    }
+    fuse_debugf(self, "  average latency=%dus\n", (int)(total * 1000 / TEST_004_EVENTS));
+
+    // The exact latency depends on the load on the machine, but a run loop which
+    // only woke up when the one second idle timeout expired would take far longer
+    for (int i = 0; i < TEST_004_EVENTS; i++)
+    {
+        assert(TEST_004_latency[i] < 500);
+    }
+
+    // Return success
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+#define TEST_005_EVENTS 100
+
+static uintptr_t TEST_005_next;
+
+void TEST_005_consume(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    // Events are executed in order, across batches
+    assert((uintptr_t)user_data == TEST_005_next);
+    TEST_005_next++;
+
+    // Use some time, so that the time budget ends batches early
+    double start = TEST_004_now();
+    while (TEST_004_now() - start < 0.01)
+    {
+        continue;
+    }
+    if (TEST_005_next == TEST_005_EVENTS)
+    {
+        fuse_exit(self, 0);
+    }
+}
+
+int TEST_005_run(fuse_t *self)
+{
+    assert(fuse_register_callback(self, FUSE_EVENT_NULL, 0, TEST_005_consume));
+    for (uintptr_t i = 0; i < TEST_005_EVENTS; i++)
+    {
+        assert(fuse_new_event(self, (fuse_value_t *)self, FUSE_EVENT_NULL, (void *)i));
+    }
+    return 0;
+}
+
+int TEST_005(size_t events, uint32_t us)
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+    fuse_debugf(self, "TEST_005 batched dispatch events=%lu us=%u\n", events, us);
+
+    // All the events are executed, whatever the dispatch budget
+    TEST_005_next = 0;
+    fuse_set_dispatch(self, events, us);
+    fuse_run(self, TEST_005_run);
+    assert(TEST_005_next == TEST_005_EVENTS);
+
+    // Return success
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+#define TEST_006_EVENTS 20
+
+static size_t TEST_006_high, TEST_006_low, TEST_006_run;
+
+void TEST_006_high_consume(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    // High priority events are served first, in runs of at most FUSE_EVENT_STARVATION
+    assert((uintptr_t)user_data == TEST_006_high);
+    TEST_006_high++;
+    TEST_006_run++;
+    assert(TEST_006_run <= FUSE_EVENT_STARVATION);
+}
+
+void TEST_006_low_consume(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    // A low priority event is served after each full run of high priority events
+    assert((uintptr_t)user_data == TEST_006_low);
+    assert(TEST_006_high == TEST_006_EVENTS || TEST_006_run == FUSE_EVENT_STARVATION);
+    TEST_006_low++;
+    TEST_006_run = 0;
+}
+
+int TEST_006()
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+    fuse_debugf(self, "TEST_006 event priority\n");
+    assert(fuse_register_callback(self, FUSE_EVENT_GPIO, 0, TEST_006_high_consume));
+    assert(fuse_register_callback(self, FUSE_EVENT_ADC, 0, TEST_006_low_consume));
+
+    // Place low priority events on the queue, followed by high priority events
+    fuse_set_event_priority(self, FUSE_EVENT_ADC, FUSE_EVENT_PRIORITY_LOW);
+    for (uintptr_t i = 0; i < TEST_006_EVENTS; i++)
+    {
+        assert(fuse_new_event(self, (fuse_value_t *)self, FUSE_EVENT_ADC, (void *)i));
+    }
+    for (uintptr_t i = 0; i < TEST_006_EVENTS; i++)
+    {
+        assert(fuse_new_event_priority(self, (fuse_value_t *)self, FUSE_EVENT_GPIO, FUSE_EVENT_PRIORITY_HIGH, (void *)i));
+    }
+
+    // Execute the events in the order they are served
+    TEST_006_high = TEST_006_low = TEST_006_run = 0;
+    fuse_event_t *evt;
+    while ((evt = fuse_next_event(self, 0)) != NULL)
+    {
+        fuse_exec_event(self, 0, evt);
+    }
+    assert(TEST_006_high == TEST_006_EVENTS);
+    assert(TEST_006_low == TEST_006_EVENTS);
+
+    // Return success
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+#define TEST_007_SOURCES 40
+
+static size_t TEST_007_calls[TEST_007_SOURCES];
+static size_t TEST_007_any;
+
+void TEST_007_source(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    // Called with the user data of the registration, only for its own source
+    size_t *calls = user_data;
+    assert(calls >= TEST_007_calls && calls < TEST_007_calls + TEST_007_SOURCES);
+    (*calls)++;
+}
+
+void TEST_007_source_any(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    // Called with the user data of the event, for every source
+    assert((uintptr_t)user_data < TEST_007_SOURCES);
+    TEST_007_any++;
+}
+
+int TEST_007()
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+    fuse_debugf(self, "TEST_007 callbacks for a source\n");
+
+    // Register a callback for each source, which is more than the callbacks
+    // which could be registered for an event type previously
+    fuse_value_t *sources[TEST_007_SOURCES];
+    for (size_t i = 0; i < TEST_007_SOURCES; i++)
+    {
+        sources[i] = fuse_retain(self, fuse_new_data(self, 8));
+        assert(sources[i]);
+        TEST_007_calls[i] = 0;
+        assert(fuse_register_source_callback(self, FUSE_EVENT_TIMER, 0, sources[i], TEST_007_source, &TEST_007_calls[i]));
+    }
+    assert(fuse_register_callback(self, FUSE_EVENT_TIMER, 0, TEST_007_source_any));
+    TEST_007_any = 0;
+
+    // Each source gets one event, and every other source gets a second one
+    for (uintptr_t i = 0; i < TEST_007_SOURCES; i++)
+    {
+        assert(fuse_new_event(self, sources[i], FUSE_EVENT_TIMER, (void *)i));
+        if (i % 2 == 0)
+        {
+            assert(fuse_new_event(self, sources[i], FUSE_EVENT_TIMER, (void *)i));
+        }
+    }
+
+    // Events of another type from the same sources have no callbacks
+    assert(fuse_new_event(self, sources[0], FUSE_EVENT_GPIO, NULL));
+
+    fuse_event_t *evt;
+    while ((evt = fuse_next_event(self, 0)) != NULL)
+    {
+        fuse_exec_event(self, 0, evt);
+    }
+    for (size_t i = 0; i < TEST_007_SOURCES; i++)
+    {
+        assert(TEST_007_calls[i] == (i % 2 == 0 ? 2 : 1));
+    }
+    assert(TEST_007_any == TEST_007_SOURCES + TEST_007_SOURCES / 2);
+
+    // Unregister the callbacks for the odd sources, and for any source
+    for (size_t i = 1; i < TEST_007_SOURCES; i += 2)
+    {
+        assert(fuse_unregister_callback(self, FUSE_EVENT_TIMER, 0, sources[i], TEST_007_source));
+        assert(fuse_unregister_callback(self, FUSE_EVENT_TIMER, 0, sources[i], TEST_007_source) == false);
+    }
+    assert(fuse_unregister_callback(self, FUSE_EVENT_TIMER, 0, NULL, TEST_007_source_any));
+    for (uintptr_t i = 0; i < TEST_007_SOURCES; i++)
+    {
+        assert(fuse_new_event(self, sources[i], FUSE_EVENT_TIMER, (void *)i));
+    }
+    while ((evt = fuse_next_event(self, 0)) != NULL)
+    {
+        fuse_exec_event(self, 0, evt);
+    }
+    for (size_t i = 0; i < TEST_007_SOURCES; i++)
+    {
+        assert(TEST_007_calls[i] == (i % 2 == 0 ? 3 : 1));
+    }
+    assert(TEST_007_any == TEST_007_SOURCES + TEST_007_SOURCES / 2);
+
+    // Release the sources. The remaining callbacks are released when the
+    // application is destroyed
+    for (size_t i = 0; i < TEST_007_SOURCES; i++)
+    {
+        fuse_release(self, sources[i]);
+    }
+
+    // Return success
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+#define TEST_008_EVENTS 1000
+
+static void *TEST_008_data;
+
+void TEST_008_consume(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    TEST_008_data = user_data;
+}
+
+int TEST_008()
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+    fuse_debugf(self, "TEST_008 event coalescing\n");
+
+    fuse_value_t *burst = fuse_retain(self, fuse_new_data(self, 8));
+    fuse_value_t *other = fuse_retain(self, fuse_new_data(self, 8));
+    assert(burst && other);
+    assert(fuse_set_event_coalesce(self, burst, FUSE_EVENT_PWM, true));
+    assert(fuse_register_callback(self, FUSE_EVENT_PWM, 0, TEST_008_consume));
+
+    // A burst of events from the coalescing source is a single event on the queue,
+    // even though the burst is larger than the queue, with the latest user data
+    fuse_event_t *pending = NULL;
+    for (uintptr_t i = 1; i <= TEST_008_EVENTS; i++)
+    {
+        fuse_event_t *evt = fuse_new_event(self, burst, FUSE_EVENT_PWM, (void *)i);
+        assert(evt);
+        assert(pending == NULL || evt == pending);
+        pending = evt;
+    }
+    assert(fuse_event_drops(self, FUSE_EVENT_PWM) == 0);
+
+    // Events of another type, or from another source, are not coalesced
+    assert(fuse_new_event(self, burst, FUSE_EVENT_GPIO, NULL) != pending);
+    assert(fuse_new_event(self, other, FUSE_EVENT_PWM, NULL) != pending);
+    assert(fuse_new_event(self, other, FUSE_EVENT_PWM, NULL) != pending);
+
+    // Take the coalesced event, after which a new event is created for the source
+    fuse_event_t *evt = fuse_next_event(self, 0);
+    assert(evt == pending);
+    fuse_exec_event(self, 0, evt);
+    assert(TEST_008_data == (void *)TEST_008_EVENTS);
+    assert(fuse_event_count(self, evt) == TEST_008_EVENTS);
+    fuse_event_t *next = fuse_new_event(self, burst, FUSE_EVENT_PWM, (void *)1);
+    assert(next != NULL && next != evt);
+
+    // The other events were not coalesced
+    size_t count = 0;
+    while ((evt = fuse_next_event(self, 0)) != NULL)
+    {
+        assert(fuse_event_count(self, evt) == 1);
+        count++;
+    }
+    assert(count == 4);
+
+    // Disable coalescing for the source
+    assert(fuse_set_event_coalesce(self, burst, FUSE_EVENT_PWM, false));
+    assert(fuse_new_event(self, burst, FUSE_EVENT_PWM, NULL) != fuse_new_event(self, burst, FUSE_EVENT_PWM, NULL));
+
+    // There is a limit on the number of coalescing sources
+    fuse_value_t *sources[FUSE_EVENT_COALESCE_COUNT + 1];
+    for (size_t i = 0; i <= FUSE_EVENT_COALESCE_COUNT; i++)
+    {
+        sources[i] = fuse_retain(self, fuse_new_data(self, 8));
+        assert(fuse_set_event_coalesce(self, sources[i], FUSE_EVENT_ADC, true) == (i < FUSE_EVENT_COALESCE_COUNT));
+    }
+    for (size_t i = 0; i <= FUSE_EVENT_COALESCE_COUNT; i++)
+    {
+        assert(fuse_set_event_coalesce(self, sources[i], FUSE_EVENT_ADC, false));
+        fuse_release(self, sources[i]);
+    }
+
+    // A coalescing source is retained until coalescing is disabled, or the
+    // application is destroyed
+    fuse_value_t *retained = fuse_retain(self, fuse_new_data(self, 8));
+    assert(fuse_set_event_coalesce(self, retained, FUSE_EVENT_ADC, true));
+    fuse_release(self, retained);
+    fuse_drain(self, 0);
+    assert(fuse_new_event(self, retained, FUSE_EVENT_ADC, NULL) == fuse_new_event(self, retained, FUSE_EVENT_ADC, NULL));
+
+    // Return success
+    fuse_release(self, burst);
+    fuse_release(self, other);
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+#define TEST_009_EVENTS 10
+
+struct TEST_009_payload
+{
+    uint32_t seq;
+    float value;
+};
+
+static uint32_t TEST_009_next;
+
+void TEST_009_consume(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    // The callback receives the copy of the payload as it was when the event was created
+    struct TEST_009_payload *payload = user_data;
+    size_t size = 0;
+    assert(fuse_event_payload(self, evt, &size) == payload);
+    assert(size == sizeof(struct TEST_009_payload));
+    assert(payload->seq == TEST_009_next);
+    assert(payload->value == (float)TEST_009_next / 2);
+    TEST_009_next++;
+}
+
+int TEST_009()
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+    fuse_debugf(self, "TEST_009 events with a payload\n");
+    assert(fuse_register_callback(self, FUSE_EVENT_ADC, 0, TEST_009_consume));
+
+    // Create the events, reusing the same payload memory. The events are taken from
+    // the pool, so no memory is allocated
+    size_t cur = 0, count = 0;
+    count = fuse_memcount(self, FUSE_MAGIC_ANY, &cur);
+    struct TEST_009_payload payload;
+    for (uint32_t i = 0; i < TEST_009_EVENTS; i++)
+    {
+        payload.seq = i;
+        payload.value = (float)i / 2;
+        assert(fuse_new_event_payload(self, (fuse_value_t *)self, FUSE_EVENT_ADC, &payload, sizeof(payload)));
+    }
+    size_t cur2 = 0, count2 = 0;
+    count2 = fuse_memcount(self, FUSE_MAGIC_ANY, &cur2);
+    assert(cur2 == cur && count2 == count);
+
+    // Execute the events
+    TEST_009_next = 0;
+    fuse_event_t *evt;
+    while ((evt = fuse_next_event(self, 0)) != NULL)
+    {
+        fuse_exec_event(self, 0, evt);
+    }
+    assert(TEST_009_next == TEST_009_EVENTS);
+
+    // An event without a payload has no payload
+    assert(fuse_new_event(self, (fuse_value_t *)self, FUSE_EVENT_NULL, NULL));
+    evt = fuse_next_event(self, 0);
+    assert(evt);
+    assert(fuse_event_payload(self, evt, NULL) == NULL);
+
+    // Return success
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+#define TEST_010_WORKERS 4
+#define TEST_010_EVENTS 20000
+#define TEST_010_PINNED 10
+
+static pthread_t TEST_010_main;
+static _Atomic size_t TEST_010_executed;
+static _Atomic size_t TEST_010_pinned;
+static _Atomic bool TEST_010_other;
+static pthread_t TEST_010_producer;
+
+void TEST_010_work(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    // Note whether any event was executed on another worker
+    if (!pthread_equal(pthread_self(), TEST_010_main))
+    {
+        atomic_store(&TEST_010_other, true);
+    }
+    for (volatile int i = 0; i < 1000; i++)
+    {
+        continue;
+    }
+
+    // Values created by the callback are not drained while it runs
+    fuse_list_t *list = (fuse_list_t *)fuse_retain(self, fuse_new_list(self));
+    assert(list);
+    fuse_value_t *element = fuse_retain(self, fuse_new_data(self, 8));
+    assert(element);
+    assert(fuse_list_append(self, list, element));
+    fuse_release(self, element);
+    assert(fuse_list_count(self, list) == 1);
+    fuse_release(self, list);
+    if (atomic_fetch_add(&TEST_010_executed, 1) + 1 == TEST_010_EVENTS)
+    {
+        fuse_exit(self, 0);
+    }
+}
+
+void TEST_010_pinned_work(fuse_t *self, fuse_event_t *evt, void *user_data)
+{
+    // Callbacks which are not thread-safe are only called on the calling thread
+    assert(pthread_equal(pthread_self(), TEST_010_main));
+    atomic_fetch_add(&TEST_010_pinned, 1);
+}
+
+void *TEST_010_produce(void *arg)
+{
+    fuse_t *self = arg;
+    for (uintptr_t i = 0; i < TEST_010_EVENTS; i++)
+    {
+        uint8_t type = (i % TEST_010_PINNED == 0) ? FUSE_EVENT_GPIO : FUSE_EVENT_NULL;
+        while (fuse_new_event(self, (fuse_value_t *)self, type, NULL) == NULL)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+int TEST_010_run(fuse_t *self)
+{
+    assert(fuse_register_callback(self, FUSE_EVENT_NULL, 0, TEST_010_work));
+    assert(fuse_set_callback_threadsafe(self, FUSE_EVENT_NULL, 0, NULL, TEST_010_work, true));
+    assert(fuse_register_callback(self, FUSE_EVENT_GPIO, 0, TEST_010_work));
+    assert(fuse_set_callback_threadsafe(self, FUSE_EVENT_GPIO, 0, NULL, TEST_010_work, true));
+    assert(fuse_register_callback(self, FUSE_EVENT_GPIO, 0, TEST_010_pinned_work));
+    assert(fuse_set_callback_threadsafe(self, FUSE_EVENT_GPIO, 0, NULL, TEST_010_pinned_work, true) == true);
+    assert(fuse_set_callback_threadsafe(self, FUSE_EVENT_GPIO, 0, NULL, TEST_010_pinned_work, false) == true);
+    assert(fuse_set_callback_threadsafe(self, FUSE_EVENT_ADC, 0, NULL, TEST_010_work, true) == false);
+
+    // Post the events once the callbacks are registered
+    assert(pthread_create(&TEST_010_producer, NULL, TEST_010_produce, self) == 0);
+    return 0;
+}
+
+int TEST_010()
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+    fuse_debugf(self, "TEST_010 run loop with several workers\n");
+    assert(fuse_set_workers(self, 0) == false);
+    assert(fuse_set_workers(self, FUSE_WORKER_MAX + 1) == false);
+    assert(fuse_set_workers(self, TEST_010_WORKERS));
+
+    // Every event is executed once, with thread-safe callbacks on any worker
+    TEST_010_main = pthread_self();
+    atomic_store(&TEST_010_executed, 0);
+    atomic_store(&TEST_010_pinned, 0);
+    atomic_store(&TEST_010_other, false);
+    fuse_run(self, TEST_010_run);
+    assert(pthread_join(TEST_010_producer, NULL) == 0);
+    assert(atomic_load(&TEST_010_executed) == TEST_010_EVENTS);
+    assert(atomic_load(&TEST_010_pinned) == TEST_010_EVENTS / TEST_010_PINNED);
+    assert(atomic_load(&TEST_010_other));
+
+    // Return success
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
+int TEST_011()
+{
+    fuse_t *self = fuse_new();
+    assert(self);
+    fuse_debugf(self, "TEST_011 event routes\n");
+
+    fuse_value_t *sources[FUSE_EVENT_ROUTE_COUNT + 1];
+    for (size_t i = 0; i < FUSE_EVENT_ROUTE_COUNT + 1; i++)
+    {
+        sources[i] = fuse_retain(self, fuse_new_data(self, 8));
+        assert(sources[i]);
+    }
+
+    // By default events are placed on every queue
+    assert(fuse_new_event(self, sources[0], FUSE_EVENT_ADC, NULL));
+    assert(fuse_next_event(self, 0) != NULL);
+    assert(fuse_next_event(self, 0) == NULL);
+
+    // There is no queue for core 1, so events routed there are dropped
+    assert(fuse_set_event_route(self, FUSE_EVENT_ADC, NULL, FUSE_EVENT_ROUTE_CORE1));
+    assert(fuse_new_event(self, sources[0], FUSE_EVENT_ADC, NULL) == NULL);
+    assert(fuse_event_drops(self, FUSE_EVENT_ADC) == 1);
+    assert(fuse_next_event(self, 0) == NULL);
+
+    // Events of other types are not affected
+    assert(fuse_new_event(self, sources[0], FUSE_EVENT_GPIO, NULL));
+    assert(fuse_next_event(self, 0) != NULL);
+
+    // The route for a source overrides the route for the event type
+    assert(fuse_set_event_route(self, FUSE_EVENT_ADC, sources[0], FUSE_EVENT_ROUTE_CORE0));
+    assert(fuse_new_event(self, sources[0], FUSE_EVENT_ADC, NULL));
+    assert(fuse_new_event(self, sources[1], FUSE_EVENT_ADC, NULL) == NULL);
+    assert(fuse_next_event(self, 0) != NULL);
+    assert(fuse_next_event(self, 0) == NULL);
+
+    // Removing the route for the source restores the route for the event type
+    assert(fuse_set_event_route(self, FUSE_EVENT_ADC, sources[0], FUSE_EVENT_ROUTE_DEFAULT));
+    assert(fuse_new_event(self, sources[0], FUSE_EVENT_ADC, NULL) == NULL);
+    assert(fuse_event_drops(self, FUSE_EVENT_ADC) == 3);
+
+    // Posting an event places it on one queue, whatever the route
+    assert(fuse_post_event(self, 0, sources[1], FUSE_EVENT_ADC, NULL));
+    assert(fuse_post_event(self, 1, sources[1], FUSE_EVENT_ADC, NULL) == NULL);
+    assert(fuse_next_event(self, 0) != NULL);
+    assert(fuse_next_event(self, 0) == NULL);
+
+    // The number of sources with their own route is limited
+    for (size_t i = 0; i < FUSE_EVENT_ROUTE_COUNT; i++)
+    {
+        assert(fuse_set_event_route(self, FUSE_EVENT_ADC, sources[i], FUSE_EVENT_ROUTE_ALL));
+    }
+    assert(fuse_set_event_route(self, FUSE_EVENT_ADC, sources[FUSE_EVENT_ROUTE_COUNT], FUSE_EVENT_ROUTE_ALL) == false);
+    assert(fuse_set_event_route(self, FUSE_EVENT_ADC, sources[0], FUSE_EVENT_ROUTE_DEFAULT));
+    assert(fuse_set_event_route(self, FUSE_EVENT_ADC, sources[FUSE_EVENT_ROUTE_COUNT], FUSE_EVENT_ROUTE_ALL));
+    assert(fuse_new_event(self, sources[FUSE_EVENT_ROUTE_COUNT], FUSE_EVENT_ADC, NULL));
+    assert(fuse_new_event(self, sources[0], FUSE_EVENT_ADC, NULL) == NULL);
+    assert(fuse_next_event(self, 0) != NULL);
+
+    // Restore the route for the event type
+    assert(fuse_set_event_route(self, FUSE_EVENT_ADC, NULL, FUSE_EVENT_ROUTE_DEFAULT));
+    assert(fuse_new_event(self, sources[0], FUSE_EVENT_ADC, NULL));
+    assert(fuse_next_event(self, 0) != NULL);
+
+    // A source with its own route is retained by the route, and released when the
+    // route is removed or the application is destroyed
+    assert(fuse_set_event_route(self, FUSE_EVENT_ADC, sources[1], FUSE_EVENT_ROUTE_CORE1));
+    for (size_t i = 0; i < FUSE_EVENT_ROUTE_COUNT + 1; i++)
+    {
+        fuse_release(self, sources[i]);
+    }
+    fuse_drain(self, 0);
+    assert(fuse_new_event(self, sources[1], FUSE_EVENT_ADC, NULL) == NULL);
+    assert(fuse_set_event_route(self, FUSE_EVENT_ADC, sources[2], FUSE_EVENT_ROUTE_DEFAULT));
+
+    // Return success
+    assert(fuse_destroy(self) == 0);
+    return 0;
+}
+
 int main()
 {
     fuse_t *self = fuse_new();
     assert(self);
     assert(TEST_001(self) == 0);
     assert(fuse_destroy(self) == 0);
+    assert(TEST_002() == 0);
+    assert(TEST_003() == 0);
+    assert(TEST_004() == 0);
+    assert(TEST_005(1, 0) == 0);
+    assert(TEST_005(7, 0) == 0);
+    assert(TEST_005(FUSE_EVENT_DISPATCH_MAX, 0) == 0);
+    assert(TEST_005(FUSE_EVENT_DISPATCH_MAX, 30) == 0);
+    assert(TEST_006() == 0);
+    assert(TEST_007() == 0);
+    assert(TEST_008() == 0);
+    assert(TEST_009() == 0);
+    assert(TEST_010() == 0);
+    assert(TEST_011() == 0);
 }
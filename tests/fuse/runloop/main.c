@@ -1,5 +1,7 @@
 #include <fuse/fuse.h>
 
+static fuse_timer_t *TEST_001_timer = NULL;
+
 void TEST_001_callback(fuse_t *self, fuse_event_t *evt, void *user_data)
 {
     // Callback when the timer matures
@@ -13,7 +15,9 @@ void TEST_001_callback(fuse_t *self, fuse_event_t *evt, void *user_data)
     fuse_printf(self," Iter: %d\n", i++);
     if (i == 5)
     {
-        // TODO: release the event source, or maybe cancel the timer
+        // Cancel the timer and exit. The timer thread may still hold an event when
+        // the run loop exits, which must not be reported as a leak by fuse_destroy
+        fuse_timer_cancel(self, TEST_001_timer);
         fuse_exit(self, 0);
     }
 }
@@ -25,9 +29,9 @@ int TEST_001(fuse_t *self)
     // Register a callback for the timer event on Core 0
     assert(fuse_register_callback(self,FUSE_EVENT_TIMER,0,TEST_001_callback));
 
-    // Schedule timer to run every second
-    fuse_timer_t *timer = fuse_timer_schedule(self, 1000, true, (void* )100);
-    assert(timer);
+    // Schedule timer to run every 100ms
+    TEST_001_timer = fuse_timer_schedule(self, 100, true, (void* )100);
+    assert(TEST_001_timer);
     return 0;
 }
 
@@ -390,6 +390,75 @@ int TEST_018(fuse_t *self)
     return 0;
 }
 
+int TEST_019(fuse_t *self)
+{
+    fuse_debugf(self, "Immediate values\n");
+
+    // Immediate values are not allocated
+    size_t count;
+    count = fuse_memcount(self, FUSE_MAGIC_ANY, NULL);
+    fuse_value_t *values[] = {
+        fuse_new_imm_null(self),
+        fuse_new_imm_bool(self, true),
+        fuse_new_imm_u8(self, 200),
+        fuse_new_imm_s32(self, -12345),
+    };
+    const char *expected[] = {"(null)", "true", "200", "-12345"};
+    uint16_t magic[] = {FUSE_MAGIC_NULL, FUSE_MAGIC_BOOL, FUSE_MAGIC_U8, FUSE_MAGIC_S32};
+    for (int i = 0; i < 4; i++)
+    {
+        assert(values[i]);
+        assert(fuse_value_is_imm(values[i]));
+        assert(fuse_value_type(self, values[i]) == magic[i]);
+
+        // Retain and release have no effect
+        assert(fuse_retain(self, values[i]) == values[i]);
+        fuse_release(self, values[i]);
+
+        // sprintf the value
+        assert(fuse_sprintf(self, buf, n, "%v", values[i]) > 0);
+        fuse_debugf(self, "  value=%s\n", buf);
+        assert_cstr_eq(expected[i], buf);
+    }
+    size_t count2;
+    count2 = fuse_memcount(self, FUSE_MAGIC_ANY, NULL);
+    assert(count == count2);
+    assert(fuse_value_int(self, values[2]) == 200);
+    assert(fuse_value_int(self, values[3]) == -12345);
+
+    // Appending to a list stores the immediate value itself, in a node
+    size_t nodes = fuse_memcount(self, FUSE_MAGIC_NODE, NULL);
+    fuse_list_t *list = (fuse_list_t *)fuse_retain(self, fuse_new_list(self));
+    assert(list);
+    for (int i = 0; i < 4; i++)
+    {
+        assert(fuse_list_append(self, list, values[i]) == values[i]);
+    }
+    assert(fuse_list_append(self, list, values[3]) == values[3]);
+    assert(fuse_memcount(self, FUSE_MAGIC_NODE, NULL) - nodes == 5);
+
+    // Iterating returns the immediate values, including the repeated value
+    fuse_value_t *elem = NULL;
+    for (int i = 0; i < 5; i++)
+    {
+        elem = fuse_list_next(self, list, elem);
+        assert(elem == values[i < 4 ? i : 3]);
+    }
+    assert(fuse_list_next(self, list, elem) == NULL);
+    vtostr(self, buf, n, (fuse_value_t *)list, true);
+    assert_cstr_eq("[null,true,200,-12345,-12345]", buf);
+
+    // Popping returns the immediate value
+    elem = fuse_list_pop(self, list);
+    assert(elem == values[3]);
+    assert(fuse_value_is_imm(elem));
+    assert(fuse_value_int(self, elem) == -12345);
+    fuse_release(self, list);
+
+    // Return success
+    return 0;
+}
+
 int main()
 {
     fuse_t *self = fuse_new();
@@ -412,5 +481,6 @@ int main()
     assert(TEST_016(self) == 0);
     assert(TEST_017(self) == 0);
     assert(TEST_018(self) == 0);
+    assert(TEST_019(self) == 0);
     assert(fuse_destroy(self) == 0);
 }